@@ -7,3 +7,6 @@ COMPONENT_SRCDIRS := src .
 
 ## Compile DMP code only if enabled in menuconfig
 $(call compile_only_if,$(CONFIG_MPU_ENABLE_DMP),src/MPUdmp.o)
+
+## Compile virtual device code only if enabled in menuconfig
+$(call compile_only_if,$(CONFIG_MPU_VIRTUAL_DEVICE),src/MPUsim.o)
@@ -12,7 +12,7 @@
  *  - Read sensor data from FIFO
  *  - Perform Self-Test check
  *  - Calibrate sensor data output using offset registers
- *  - Calculate Tilt Angles
+ *  - Estimate orientation with a Madgwick filter (AHRS)
  * 
  * @note
  * To try this example: \n
@@ -33,10 +33,13 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
 #include "sdkconfig.h"
 
 #include "MPU.hpp"
+#include "mpu/ahrs.hpp"
+#include "mpu/fifo.hpp"
 #include "mpu/math.hpp"
 #include "mpu/types.hpp"
 
@@ -82,6 +85,13 @@ static void mpuISR(void*);
 static void mpuTask(void*);
 static void printTask(void*);
 
+// Attitude handed from mpuTask to printTask, only the newest one matters
+struct Attitude
+{
+    float roll, pitch, yaw;
+};
+static QueueHandle_t attitudeBox;
+
 // Main
 extern "C" void app_main()
 {
@@ -93,6 +103,8 @@ extern "C" void app_main()
 #elif defined CONFIG_MPU_SPI
     spi.begin(MOSI, MISO, SCLK);
 #endif
+    // Latest attitude, a single slot overwritten by mpuTask
+    attitudeBox = xQueueCreate(1, sizeof(Attitude));
     // Create a task to setup mpu and read sensor data
     xTaskCreate(mpuTask, "mpuTask", 4 * 1024, nullptr, 6, nullptr);
     // Create a task to print angles
@@ -102,7 +114,6 @@ extern "C" void app_main()
 /* Tasks */
 
 static MPU_t MPU;
-float roll{0}, pitch{0}, yaw{0};
 
 static void mpuTask(void*)
 {
@@ -152,7 +163,8 @@ static void mpuTask(void*)
     // Setup FIFO
     ESP_ERROR_CHECK(MPU.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
     ESP_ERROR_CHECK(MPU.setFIFOEnabled(true));
-    constexpr uint16_t kFIFOPacketSize = 12;
+    mpud::FIFOReader fifo(MPU);
+    ESP_ERROR_CHECK(fifo.begin());  // packet size from the FIFO configuration
 
     // Setup Interrupt
     constexpr gpio_config_t kGPIOConfig{
@@ -170,66 +182,36 @@ static void mpuTask(void*)
 
     // Ready to start reading
     ESP_ERROR_CHECK(MPU.resetFIFO());  // start clean
+    fifo.clear();
 
     // Reading Loop
+    mpud::AHRS ahrs(mpud::AHRS_MADGWICK);
+    const mpud::scale_t scale = mpud::math::makeScale(kAccelFS, kGyroFS);
     while (true) {
         // Wait for notification from mpuISR
-        uint32_t notificationValue = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        if (notificationValue > 1) {
-            ESP_LOGW(TAG, "Task Notification higher than 1, value: %d", notificationValue);
-            MPU.resetFIFO();
-            continue;
-        }
-        // Check FIFO count
-        uint16_t fifocount = MPU.getFIFOCount();
-        if (esp_err_t err = MPU.lastError()) {
-            ESP_LOGE(TAG, "Error reading fifo count, %#X", err);
-            MPU.resetFIFO();
-            continue;
-        }
-        if (fifocount > kFIFOPacketSize * 2) {
-            if (!(fifocount % kFIFOPacketSize)) {
-                ESP_LOGE(TAG, "Sample Rate too high!, not keeping up the pace!, count: %d", fifocount);
-            }
-            else {
-                ESP_LOGE(TAG, "FIFO Count misaligned! Expected: %d, Actual: %d", kFIFOPacketSize, fifocount);
-            }
-            MPU.resetFIFO();
-            continue;
-        }
-        // Burst read data from FIFO
-        uint8_t buffer[kFIFOPacketSize];
-        if (esp_err_t err = MPU.readFIFO(kFIFOPacketSize, buffer)) {
+        // (missed notifications only mean more samples waiting in the FIFO)
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Burst read FIFO count and data, usually a single sample is ready at each interrupt
+        constexpr size_t kMaxSamples = 16;
+        mpud::fifo_sample_t samples[kMaxSamples];
+        size_t count = 0;
+        if (esp_err_t err = fifo.read(samples, kMaxSamples, &count)) {
             ESP_LOGE(TAG, "Error reading sensor data, %#X", err);
             MPU.resetFIFO();
+            fifo.clear();
             continue;
         }
-        // Format
-        mpud::raw_axes_t rawAccel, rawGyro;
-        rawAccel.x = buffer[0] << 8 | buffer[1];
-        rawAccel.y = buffer[2] << 8 | buffer[3];
-        rawAccel.z = buffer[4] << 8 | buffer[5];
-        rawGyro.x  = buffer[6] << 8 | buffer[7];
-        rawGyro.y  = buffer[8] << 8 | buffer[9];
-        rawGyro.z  = buffer[10] << 8 | buffer[11];
-        // Calculate tilt angle
+        // on FIFO overflow the reader realigns on the next packet, no need to reset it
+        if (fifo.getLostSamples() > 0) {
+            ESP_LOGW(TAG, "Sample Rate too high!, not keeping up the pace!, samples lost: %u", fifo.getLostSamples());
+        }
+        // Fusion, each sample stepped by its timestamp (measured, not 1 / kSampleRate)
         // range: (roll[-180,180]  pitch[-90,90]  yaw[-180,180])
-        constexpr double kRadToDeg = 57.2957795131;
-        constexpr float kDeltaTime = 1.f / kSampleRate;
-        float gyroRoll             = roll + mpud::math::gyroDegPerSec(rawGyro.x, kGyroFS) * kDeltaTime;
-        float gyroPitch            = pitch + mpud::math::gyroDegPerSec(rawGyro.y, kGyroFS) * kDeltaTime;
-        float gyroYaw              = yaw + mpud::math::gyroDegPerSec(rawGyro.z, kGyroFS) * kDeltaTime;
-        float accelRoll            = atan2(-rawAccel.x, rawAccel.z) * kRadToDeg;
-        float accelPitch = atan2(rawAccel.y, sqrt(rawAccel.x * rawAccel.x + rawAccel.z * rawAccel.z)) * kRadToDeg;
-        // Fusion
-        roll  = gyroRoll * 0.95f + accelRoll * 0.05f;
-        pitch = gyroPitch * 0.95f + accelPitch * 0.05f;
-        yaw   = gyroYaw;
-        // correct yaw
-        if (yaw > 180.f)
-            yaw -= 360.f;
-        else if (yaw < -180.f)
-            yaw += 360.f;
+        ahrs.update(samples, count, scale);
+        const mpud::float_axes_t euler = ahrs.getEuler();
+        // publish the newest attitude, replacing the one printTask has not seen yet
+        const Attitude attitude{euler.x, euler.y, euler.z};
+        xQueueOverwrite(attitudeBox, &attitude);
     }
     vTaskDelete(nullptr);
 }
@@ -237,8 +219,10 @@ static void mpuTask(void*)
 static void printTask(void*)
 {
     vTaskDelay(2000 / portTICK_PERIOD_MS);
+    Attitude latest{0, 0, 0};
     while (true) {
-        printf("Pitch: %+6.1f \t Roll: %+6.1f \t Yaw: %+6.1f \n", pitch, roll, yaw);
+        xQueuePeek(attitudeBox, &latest, 0);  // kept if none published yet
+        printf("Pitch: %+6.1f \t Roll: %+6.1f \t Yaw: %+6.1f \n", latest.pitch, latest.roll, latest.yaw);
         vTaskDelay(50 / portTICK_PERIOD_MS);
     }
 }
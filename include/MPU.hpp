@@ -12,6 +12,7 @@
  *  MPU library requires I2Cbus or SPIbus library.
  *  Select the communication protocol in `menuconfig`
  *  and include the corresponding library to project components.
+ *  With `CONFIG_MPU_VIRTUAL_DEVICE`, a simulated chip is used instead (see mpu/sim.hpp).
  *
  * @note
  *  The following is taken in the code:
@@ -29,7 +30,10 @@
 #include "esp_err.h"
 #include "sdkconfig.h"
 
-#ifdef CONFIG_MPU_I2C
+#if defined CONFIG_MPU_VIRTUAL_DEVICE
+#include "mpu/sim.hpp"
+
+#elif defined CONFIG_MPU_I2C
 #if !defined I2CBUS_COMPONENT_TRUE
 #error ''MPU component requires I2Cbus library. \
 Make sure the I2Cbus library is included in your components directory. \
@@ -55,6 +59,7 @@ See MPUs README.md for more information.''
 namespace mpud
 {
 class MPU;
+class Calibrator;
 }
 
 /*! Easy alias for MPU class */
@@ -80,10 +85,14 @@ class MPU
     mpu_bus_t& getBus();
     mpu_addr_handle_t getAddr();
     esp_err_t lastError();
+    MPU& setRegisterCacheEnabled(bool enable);
+    bool getRegisterCacheEnabled();
+    void invalidateRegisterCache();
     //! \}
     //! \name Setup
     //! \{
-    esp_err_t initialize();
+    esp_err_t initialize(const mpu_config_t& config = MPU_DEFAULT_CONFIG);
+    esp_err_t warmStart(const mpu_config_t& config = MPU_DEFAULT_CONFIG, bool* warm = nullptr);
     esp_err_t reset();
     esp_err_t setSleep(bool enable);
     esp_err_t testConnection();
@@ -100,6 +109,10 @@ class MPU
     uint16_t getSampleRate();
     clock_src_t getClockSource();
     dlpf_t getDigitalLowPassFilter();
+    esp_err_t saveConfig(config_snapshot_t* snapshot);
+    esp_err_t restoreConfig(const config_snapshot_t& snapshot);
+    static int snapshotIndex(uint8_t regAddr);
+    esp_err_t applyConfig(const mpu_config_t& config);
     //! \}
     //! \name Power management
     //! \{
@@ -123,7 +136,10 @@ class MPU
     esp_err_t setAccelOffset(raw_axes_t bias);
     raw_axes_t getGyroOffset();
     raw_axes_t getAccelOffset();
+    esp_err_t getAccelFactoryTrim(raw_axes_t* trim);
     esp_err_t computeOffsets(raw_axes_t* accel, raw_axes_t* gyro);
+    esp_err_t checkCalibration(const calib_record_t& record, float maxTempDelta = 10.f);
+    esp_err_t applyCalibration(const calib_record_t& record);
     //! \}
     //! \name Interrupt
     //! \{
@@ -141,10 +157,17 @@ class MPU
     esp_err_t resetFIFO();
     uint16_t getFIFOCount();
     esp_err_t readFIFO(size_t length, uint8_t* data);
+    esp_err_t readFIFOWithCount(size_t length, uint8_t* data, uint16_t* count);
+    esp_err_t readFIFOPackets(size_t packetSize, size_t maxPackets, uint8_t* data, size_t* packets);
     esp_err_t writeFIFO(size_t length, const uint8_t* data);
     fifo_mode_t getFIFOMode();
     fifo_config_t getFIFOConfig();
     bool getFIFOEnabled();
+    static fifo_layout_t fifoLayout(fifo_config_t config, const uint8_t slaveLength[4]);
+#if defined CONFIG_MPU6500
+    esp_err_t setFIFOSize(fifo_size_t size);
+    fifo_size_t getFIFOSize();
+#endif
     //! \}
     //! \name Auxiliary I2C Master
     //! \{
@@ -241,18 +264,37 @@ class MPU
 #endif
     esp_err_t sensors(raw_axes_t* accel, raw_axes_t* gyro, int16_t* temp);
     esp_err_t sensors(sensors_t* sensors, size_t extsens_len = 0);
+    esp_err_t sensorsWithStatus(sensors_t* sensors, int_stat_t* status, size_t extsens_len = 0);
     //! \}
 
  protected:
+    friend class Calibrator;  // self-test evaluation
     esp_err_t accelSelfTest(raw_axes_t& regularBias, raw_axes_t& selfTestBias, uint8_t* result);
     esp_err_t gyroSelfTest(raw_axes_t& regularBias, raw_axes_t& selfTestBias, uint8_t* result);
-    esp_err_t getBiases(accel_fs_t accelFS, gyro_fs_t gyroFS, raw_axes_t* accelBias, raw_axes_t* gyroBias,
-                        bool selftest);
+    esp_err_t writeConfig(const mpu_config_t& config, bool* rateChanged);
+#if defined CONFIG_MPU_AK89xx
+    esp_err_t setCompassSampleRate(uint16_t rate);
+    esp_err_t compassSetup();
+    bool compassSetupKept(const uint8_t* image);
+#endif
+    esp_err_t cachedReadBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t* data);
+    esp_err_t cachedReadBytes(uint8_t regAddr, size_t length, uint8_t* data);
+    esp_err_t cachedWriteBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data);
+    esp_err_t cachedWriteBytes(uint8_t regAddr, size_t length, const uint8_t* data);
+    void cacheStore(uint8_t regAddr, size_t length, const uint8_t* data);
+    void cacheInvalidate(uint8_t regAddr, size_t length);
+    bool cacheHit(uint8_t regAddr, size_t length);
 
-    mpu_bus_t* bus;         /*!< Communication bus pointer, I2C / SPI */
-    mpu_addr_handle_t addr; /*!< I2C address / SPI device handle */
-    uint8_t buffer[16];     /*!< Commom buffer for temporary data */
-    esp_err_t err;          /*!< Holds last error code */
+    mpu_bus_t* bus;              /*!< Communication bus pointer, I2C / SPI */
+    mpu_addr_handle_t addr;      /*!< I2C address / SPI device handle */
+    uint8_t buffer[16];          /*!< Commom buffer for temporary data */
+    esp_err_t err;               /*!< Holds last error code */
+    bool regCacheEnabled;        /*!< Serve configuration registers from regCache */
+    uint32_t regCacheValid[4];   /*!< One valid bit per register in regCache */
+    uint8_t regCache[128];       /*!< Write-through shadow of configuration registers */
+    bool fifoSpeculated;         /*!< Last readFIFOPackets() read past the FIFO count */
+    raw_axes_t accelFactoryTrim; /*!< Accel offset registers right after reset, see getAccelFactoryTrim() */
+    bool factoryTrimValid;       /*!< accelFactoryTrim read by initialize() */
 };
 
 }  // namespace mpud
@@ -274,7 +316,11 @@ inline MPU::MPU(mpu_bus_t& bus) : MPU(bus, MPU_DEFAULT_ADDR_HANDLE) {}
  * @param bus Bus protocol object of type `I2Cbus` or `SPIbus`.
  * @param addr I2C address (`mpu_i2caddr_t`) or SPI device handle (`spi_device_handle_t`).
  */
-inline MPU::MPU(mpu_bus_t& bus, mpu_addr_handle_t addr) : bus{&bus}, addr{addr}, buffer{0}, err{ESP_OK} {}
+inline MPU::MPU(mpu_bus_t& bus, mpu_addr_handle_t addr)
+    : bus{&bus}, addr{addr}, buffer{0}, err{ESP_OK}, regCacheEnabled{false}, regCacheValid{0}, regCache{0},
+      fifoSpeculated{false}, accelFactoryTrim{}, factoryTrimValid{false}
+{
+}
 /** Default Destructor, does nothing. */
 inline MPU::~MPU() = default;
 /**
@@ -284,6 +330,7 @@ inline MPU::~MPU() = default;
 inline MPU& MPU::setBus(mpu_bus_t& bus)
 {
     this->bus = &bus;
+    invalidateRegisterCache();
     return *this;
 }
 /**
@@ -300,6 +347,7 @@ inline mpu_bus_t& MPU::getBus()
 inline MPU& MPU::setAddr(mpu_addr_handle_t addr)
 {
     this->addr = addr;
+    invalidateRegisterCache();
     return *this;
 }
 /**
@@ -314,44 +362,80 @@ inline esp_err_t MPU::lastError()
 {
     return err;
 }
+/**
+ * @brief Enable / disable the register cache.
+ *
+ * When enabled, configuration registers are shadowed in RAM (write-through):
+ * getters are served without bus traffic and bit-field setters need a single write.
+ * Sensor data, status, FIFO and reset registers always go to the bus.
+ *
+ * @attention
+ *  The cache assumes this object is the only one writing to the chip configuration.
+ *  Call invalidateRegisterCache() if anything else does (another MPU object, a power cycle).
+ *  reset() invalidates the cache.
+ */
+inline MPU& MPU::setRegisterCacheEnabled(bool enable)
+{
+    regCacheEnabled = enable;
+    invalidateRegisterCache();
+    return *this;
+}
+/*! Return register cache enable state. */
+inline bool MPU::getRegisterCacheEnabled()
+{
+    return regCacheEnabled;
+}
+/*! Drop all cached register values, next accesses reload them from the chip. */
+inline void MPU::invalidateRegisterCache()
+{
+    for (auto& valid : regCacheValid) valid = 0;
+}
 /*! Read a single bit from a register*/
 inline esp_err_t MPU::readBit(uint8_t regAddr, uint8_t bitNum, uint8_t* data)
 {
+    if (regCacheEnabled) return cachedReadBits(regAddr, bitNum, 1, data);
     return err = bus->readBit(addr, regAddr, bitNum, data);
 }
 /*! Read a range of bits from a register */
 inline esp_err_t MPU::readBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t* data)
 {
+    if (regCacheEnabled) return cachedReadBits(regAddr, bitStart, length, data);
     return err = bus->readBits(addr, regAddr, bitStart, length, data);
 }
 /*! Read a single register */
 inline esp_err_t MPU::readByte(uint8_t regAddr, uint8_t* data)
 {
+    if (regCacheEnabled) return cachedReadBytes(regAddr, 1, data);
     return err = bus->readByte(addr, regAddr, data);
 }
 /*! Read data from sequence of registers */
 inline esp_err_t MPU::readBytes(uint8_t regAddr, size_t length, uint8_t* data)
 {
+    if (regCacheEnabled) return cachedReadBytes(regAddr, length, data);
     return err = bus->readBytes(addr, regAddr, length, data);
 }
 /*! Write a single bit to a register */
 inline esp_err_t MPU::writeBit(uint8_t regAddr, uint8_t bitNum, uint8_t data)
 {
+    if (regCacheEnabled) return cachedWriteBits(regAddr, bitNum, 1, data != 0);
     return err = bus->writeBit(addr, regAddr, bitNum, data);
 }
 /*! Write a range of bits to a register */
 inline esp_err_t MPU::writeBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data)
 {
+    if (regCacheEnabled) return cachedWriteBits(regAddr, bitStart, length, data);
     return err = bus->writeBits(addr, regAddr, bitStart, length, data);
 }
 /*! Write a value to a register */
 inline esp_err_t MPU::writeByte(uint8_t regAddr, uint8_t data)
 {
+    if (regCacheEnabled) return cachedWriteBytes(regAddr, 1, &data);
     return err = bus->writeByte(addr, regAddr, data);
 }
 /*! Write a sequence to data to a sequence of registers */
 inline esp_err_t MPU::writeBytes(uint8_t regAddr, size_t length, const uint8_t* data)
 {
+    if (regCacheEnabled) return cachedWriteBytes(regAddr, length, data);
     return err = bus->writeBytes(addr, regAddr, length, data);
 }
 
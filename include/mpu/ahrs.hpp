@@ -0,0 +1,119 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/ahrs.hpp
+ * @brief Quaternion orientation filter (AHRS), Madgwick and Mahony.
+ *
+ * @details
+ *  `AHRS` fuses gyroscope and accelerometer samples (6-axis), and optionally the AK89xx
+ *  magnetometer (9-axis), into the orientation of the sensor relative to the earth frame
+ *  (x north, y west, z up), as a quaternion. Float-only, no heap, a few hundred cycles per sample.
+ *
+ *  Batches are filtered straight from the FIFO: `fifo_sample_t` arrays or `SampleBatch`,
+ *  converted with a `scale_t` and stepped by the time between sample timestamps, so lost
+ *  samples and clock drift do not bias the integration. The first sample after reset()
+ *  aligns the orientation to gravity (and to the magnetic heading in 9-axis mode), the
+ *  filter then only tracks.
+ *
+ *  Magnetometer samples are in the AK89xx frame, as read from the FIFO or heading(), and are
+ *  rotated to the accel/gyro frame by the filter. Hard-iron offsets must already be removed.
+ *
+ * @code
+ *  mpud::AHRS ahrs(mpud::AHRS_MADGWICK);
+ *  const mpud::scale_t scale = mpud::math::makeScale(mpud::ACCEL_FS_4G, mpud::GYRO_FS_500DPS);
+ *  fifo.read(samples, 32, &count);
+ *  ahrs.update(samples, count, scale);
+ *  mpud::float_axes_t euler = ahrs.getEuler();  // roll, pitch, yaw [º]
+ * @endcode
+ * */
+
+#ifndef _MPU_AHRS_HPP_
+#define _MPU_AHRS_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MPU.hpp"
+#include "mpu/batch.hpp"
+#include "mpu/math.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Attitude and heading reference system, Madgwick or Mahony filter */
+class AHRS
+{
+ public:
+    static constexpr float kDefaultBeta = 0.1f;  /*!< Madgwick gain, gyro error [rad/s] corrected per second */
+    static constexpr float kDefaultKp   = 1.0f;  /*!< Mahony proportional gain */
+    static constexpr float kDefaultKi   = 0.0f;  /*!< Mahony integral gain, tracks gyro bias when non-zero */
+    static constexpr float kMaxStep     = 0.1f;  /*!< Longest step [s], for gaps between timestamps */
+
+    explicit AHRS(ahrs_filter_t filter = AHRS_MADGWICK);
+    void reset();
+    void reset(const quat_t& orientation);
+    AHRS& setFilter(ahrs_filter_t filter);
+    AHRS& setBeta(float beta);
+    AHRS& setGains(float kp, float ki);
+    ahrs_filter_t getFilter();
+    const quat_t& getQuaternion();
+    float_axes_t getEuler();
+    float_axes_t getGyroBias();
+    void update(const float_axes_t& gyro, const float_axes_t& accel, float dt);
+    void update(const float_axes_t& gyro, const float_axes_t& accel, const float_axes_t& mag, float dt);
+    void update(const fifo_sample_t* samples, size_t count, const math::scale_t& scale, bool useMag = false);
+    template <size_t N>
+    void update(const SampleBatch<N>& batch, const math::scale_t& scale, bool useMag = false);
+
+ protected:
+    float step(int64_t timestamp);
+    void align(const float_axes_t& accel, const float_axes_t* mag);
+    void madgwick(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    void madgwick(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+    void mahony(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    void mahony(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+    void integrate(float gx, float gy, float gz, float dt);
+
+    ahrs_filter_t filter;   /*!< Algorithm */
+    quat_t q;               /*!< Orientation */
+    float beta;             /*!< Madgwick gain */
+    float kp;               /*!< Mahony proportional gain */
+    float ki;               /*!< Mahony integral gain */
+    float_axes_t integral;  /*!< Mahony integral feedback, negated gyro bias [rad/s] */
+    int64_t lastTimestamp;  /*!< Timestamp of the previous batch sample, 0 after reset */
+    bool aligned;           /*!< Orientation initialized from the first sample */
+};
+
+/**
+ * @brief Filter a structure-of-arrays batch, stepping by the sample timestamps.
+ * @param scale Conversion factors of the full-scale configuration the batch was sampled with.
+ * @param useMag Use the magnetometer columns (9-axis), if the FIFO holds compass data.
+ */
+template <size_t N>
+void AHRS::update(const SampleBatch<N>& batch, const math::scale_t& scale, bool useMag)
+{
+    for (size_t i = 0; i < batch.count; i++) {
+        const float dt = step(batch.timestamp[i]);
+        float_axes_t gyro, accel;
+        for (int j = 0; j < 3; j++) {
+            gyro[j]  = batch.gyro[j][i] * scale.gyro_rps;
+            accel[j] = batch.accel[j][i] * scale.accel;
+        }
+#if defined CONFIG_MPU_AK89xx
+        if (useMag) {
+            update(gyro, accel, math::magToGyroFrame(batch.mag[0][i], batch.mag[1][i], batch.mag[2][i]), dt);
+            continue;
+        }
+#endif
+        update(gyro, accel, dt);
+    }
+}
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_AHRS_HPP_ */
@@ -0,0 +1,106 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/batch.hpp
+ * @brief Fixed-capacity structure-of-arrays sample batch.
+ *
+ * @details
+ *  Each axis of each sensor is a contiguous array, so per-axis math over a whole batch runs as
+ *  plain loops over arrays instead of striding through `fifo_sample_t` structs.
+ *  `FIFOReader::read(SampleBatch&)` fills it straight from the FIFO.
+ *
+ *  Vectorization depends on the trip count: GCC 12 at -O2 vectorizes a loop over the whole
+ *  capacity (known at compile time, `N` multiple of 8) but not a loop over a runtime `count`,
+ *  which then runs no faster than the struct loop; -O3 vectorizes it too. Fill the batch up
+ *  (e.g. with a FIFO watermark) and loop to capacity() in hot passes.
+ *
+ * @code
+ *  static mpud::SampleBatch<64> batch;
+ *  fifo.setWatermark(batch.capacity());
+ *  batch.clear();
+ *  fifo.waitWatermark();
+ *  fifo.read(batch, &count);  // appends
+ *  if (batch.count == batch.capacity()) {
+ *      for (size_t i = 0; i < batch.capacity(); i++) sum += batch.accel[2][i];
+ *  }
+ * @endcode
+ * */
+
+#ifndef _MPU_BATCH_HPP_
+#define _MPU_BATCH_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/**
+ * @brief Batch of up to `N` samples, stored as structure of arrays.
+ * @note Prefer `N` multiple of 8, the arrays are 16-byte aligned for vector loads.
+ */
+template <size_t N>
+struct SampleBatch
+{
+    alignas(16) int16_t accel[3][N];  //!< accelerometer, [axis][sample]
+    alignas(16) int16_t gyro[3][N];   //!< gyroscope, [axis][sample]
+    alignas(16) int16_t temp[N];      //!< temperature
+#if defined CONFIG_MPU_AK89xx
+    alignas(16) int16_t mag[3][N];  //!< magnetometer, [axis][sample]
+#endif
+    alignas(16) int64_t timestamp[N];  //!< estimated sampling time, host clock [us]
+    size_t count;                      //!< samples in the batch
+
+    SampleBatch() : count{0} {}
+
+    /*! Return the number of samples the batch holds. */
+    static constexpr size_t capacity() { return N; }
+
+    /*! Return the number of samples that can still be added. */
+    size_t room() const { return N - count; }
+
+    /*! Remove all samples. */
+    void clear() { count = 0; }
+
+    /*! Return the columns starting at sample `first`, to be filled by a reader. */
+    sample_columns_t columns(size_t first = 0)
+    {
+        sample_columns_t cols;
+        for (int i = 0; i < 3; i++) {
+            cols.accel[i] = &accel[i][first];
+            cols.gyro[i]  = &gyro[i][first];
+#if defined CONFIG_MPU_AK89xx
+            cols.mag[i] = &mag[i][first];
+#endif
+        }
+        cols.temp      = &temp[first];
+        cols.timestamp = &timestamp[first];
+        return cols;
+    }
+
+    /*! Return sample `i` as a struct. */
+    fifo_sample_t sample(size_t i) const
+    {
+        fifo_sample_t s;
+        for (int j = 0; j < 3; j++) {
+            s.accel.xyz[j] = accel[j][i];
+            s.gyro.xyz[j]  = gyro[j][i];
+#if defined CONFIG_MPU_AK89xx
+            s.mag.xyz[j] = mag[j][i];
+#endif
+        }
+        s.temp      = temp[i];
+        s.timestamp = timestamp[i];
+        return s;
+    }
+};
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_BATCH_HPP_ */
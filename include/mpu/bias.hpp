@@ -0,0 +1,122 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/bias.hpp
+ * @brief Background gyro bias tracking while the sensor is still.
+ *
+ * @details
+ *  `GyroBiasTracker` watches the sample stream in fixed windows. A window is still when the
+ *  standard deviation of every gyro and accel axis is under a threshold, and the mean acceleration
+ *  did not move since the previous window (the sensor did not tilt). The gyro mean of a still
+ *  window is the bias: it is blended into the estimate, fast at first (plain average of the still
+ *  windows) and then with a fixed gain, which follows the drift with temperature.
+ *
+ *  On MPU6000 / MPU6050 / MPU9150 the hardware zero-motion detection can veto windows too: pass
+ *  `getMotionDetectStatus() & MOT_STAT_ZEROMOTION` to setZeroMotion() as it changes. A rotation at
+ *  constant rate about the vertical axis is not seen by the accelerometer, the hardware detection
+ *  (or a compass) is the only way to rule it out.
+ *
+ *  The estimate can be removed in software (`gyro - getBiasRaw()`) or pushed into the gyro offset
+ *  registers with pushToHardware(); samples measured before the push are skipped by timestamp.
+ *
+ * @code
+ *  mpud::GyroBiasTracker tracker(mpud::ACCEL_FS_4G, mpud::GYRO_FS_500DPS);
+ *  fifo.read(batch, &count);
+ *  if (tracker.update(batch) > 0 && tracker.getStillWindows() > 10) {
+ *      tracker.pushToHardware(MPU);
+ *  }
+ * @endcode
+ * */
+
+#ifndef _MPU_BIAS_HPP_
+#define _MPU_BIAS_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "mpu/batch.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Online gyro bias estimator, learns while the sensor is still */
+class GyroBiasTracker
+{
+ public:
+    static constexpr size_t kDefaultWindow   = 100;    /*!< Samples per window */
+    static constexpr float kDefaultGyroStd   = 0.15f;  /*!< Stillness threshold, gyro standard deviation [º/s] */
+    static constexpr float kDefaultAccelStd  = 0.01f;  /*!< Stillness threshold, accel standard deviation [g] */
+    static constexpr float kDefaultMinGain   = 0.05f;  /*!< Weight of a new still window once converged */
+    static constexpr size_t kMaxWindow       = 4096;   /*!< Longest window, keeps the sums in range */
+
+    GyroBiasTracker(accel_fs_t accelFS, gyro_fs_t gyroFS);
+    void reset();
+    GyroBiasTracker& setFullScale(accel_fs_t accelFS, gyro_fs_t gyroFS);
+    GyroBiasTracker& setWindow(size_t samples);
+    GyroBiasTracker& setThresholds(float gyroStd, float accelStd);
+    GyroBiasTracker& setMinGain(float gain);
+    void setZeroMotion(bool zeroMotion);
+    size_t update(const fifo_sample_t* samples, size_t count);
+    template <size_t N>
+    size_t update(const SampleBatch<N>& batch);
+    bool isStill();
+    uint32_t getStillWindows();
+    float_axes_t getBias();
+    float_axes_t getBiasRaw();
+    esp_err_t pushToHardware(MPU& mpu);
+
+ protected:
+    void add(const int16_t* gyro, const int16_t* accel);
+    bool closeWindow();
+    void clearWindow();
+
+    accel_fs_t accelFS;      /*!< Full-scale range of the samples */
+    gyro_fs_t gyroFS;        /*!< Full-scale range of the samples */
+    size_t window;           /*!< Samples per window */
+    float gyroVarMax;        /*!< Stillness threshold, gyro variance [LSB^2] */
+    float accelVarMax;       /*!< Stillness threshold, accel variance [LSB^2] */
+    float accelStdMax;       /*!< Stillness threshold, accel mean change between windows [LSB] */
+    float minGain;           /*!< Weight of a new still window once converged */
+    size_t filled;           /*!< Samples in the current window */
+    int32_t gyroSum[3];      /*!< Sum of the window samples */
+    int64_t gyroSumSq[3];    /*!< Sum of squares of the window samples */
+    int32_t accelSum[3];     /*!< Sum of the window samples */
+    int64_t accelSumSq[3];   /*!< Sum of squares of the window samples */
+    float_axes_t prevAccel;  /*!< Mean acceleration of the previous window [LSB] */
+    bool prevValid;          /*!< prevAccel holds a full window */
+    bool motionSeen;         /*!< Hardware reported motion during the window */
+    bool zeroMotion;         /*!< Latest hardware zero-motion status */
+    bool still;              /*!< Last window was still */
+    uint32_t stillWindows;   /*!< Still windows since reset */
+    float_axes_t bias;       /*!< Estimated bias [LSB] */
+    int64_t skipUntil;       /*!< Samples up to this timestamp are ignored, after pushToHardware() [us] */
+};
+
+/**
+ * @brief Add a structure-of-arrays batch.
+ * @return Number of still windows completed (bias updates).
+ */
+template <size_t N>
+size_t GyroBiasTracker::update(const SampleBatch<N>& batch)
+{
+    size_t updates = 0;
+    for (size_t i = 0; i < batch.count; i++) {
+        if (batch.timestamp[i] <= skipUntil) continue;
+        const int16_t gyro[3]  = {batch.gyro[0][i], batch.gyro[1][i], batch.gyro[2][i]};
+        const int16_t accel[3] = {batch.accel[0][i], batch.accel[1][i], batch.accel[2][i]};
+        add(gyro, accel);
+        if (filled == window && closeWindow()) updates++;
+    }
+    return updates;
+}
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_BIAS_HPP_ */
@@ -0,0 +1,145 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/calibration.hpp
+ * @brief Non-blocking offset computation and self-test.
+ *
+ * @details
+ *  `Calibrator` runs the same procedure as `MPU::computeOffsets()` and `MPU::selfTest()` (which are
+ *  built on it) as a state machine: start, then poll() from the application loop or a timer until
+ *  the state is `CALIB_DONE` or `CALIB_FAILED`, then take the result. poll() never waits, it does
+ *  the bus work that is due, a few milliseconds at most, and tells how long until the next step
+ *  is; the settle and FIFO fill times pass while the task does other work.
+ *
+ *  The MPU configuration is saved on start with MPU::saveConfig() and restored with
+ *  MPU::restoreConfig() when done, on failure and on abort(), a few bursts each. The MPU must be
+ *  still, as horizontal as possible and facing up, and must not be used by the application until
+ *  the calibration ends.
+ *
+ *  Timing: the sensors are awake, so after configuration they settle within the gyro start-up time
+ *  (30 ms in the datasheets); enabling self-test needs 20 ms (InvenSense self-test application
+ *  note). The FIFO is filled only once settled and drained in bursts. The self-test capture keeps
+ *  the configuration of the regular one, only the self-test bits change, and settles while the
+ *  regular capture is read: about 200 ms for the whole self-test.
+ *
+ *  Captures last longer than the FIFO holds at 1 kHz (1 kB is 85 packets), so they are drained
+ *  while sampling, every half FIFO; poll() must be called at least that often, as the returned
+ *  wait time asks. A FIFO found full is reset (its head is no longer on a packet boundary) and the
+ *  capture goes on. Packets further than a few standard deviations from the running mean (bumps,
+ *  bus glitches) are left out of the average.
+ *
+ *  Warm boot: getRecord() returns the result with what is needed to re-apply it later (factory
+ *  trim read by MPU::initialize(), compass ASA values, temperature, chip model). pack() serializes
+ *  it into a versioned, checksummed blob for the application to store (NVS, flash, RTC memory); on
+ *  the next boot unpack() it, check it with MPU::checkCalibration() and apply it with
+ *  MPU::applyCalibration(), a few bus transactions instead of a new calibration.
+ *
+ * @code
+ *  mpud::Calibrator cal(MPU);
+ *  cal.startOffsets();
+ *  while (cal.busy()) {
+ *      int64_t waitUs;
+ *      cal.poll(&waitUs);
+ *      publishOtherTelemetry();
+ *  }
+ *  mpud::raw_axes_t accelOffset, gyroOffset;
+ *  if (cal.getOffsets(&accelOffset, &gyroOffset) == ESP_OK) {
+ *      MPU.setAccelOffset(accelOffset);
+ *      MPU.setGyroOffset(gyroOffset);
+ *  }
+ *  mpud::calib_record_t record;
+ *  cal.getRecord(&record);
+ *  uint8_t blob[mpud::Calibrator::kRecordSize];
+ *  mpud::Calibrator::pack(record, blob);  // store it
+ *
+ *  // next boot, after initialize()
+ *  if (mpud::Calibrator::unpack(blob, sizeof(blob), &record) == ESP_OK &&
+ *      MPU.checkCalibration(record) == ESP_OK) {
+ *      MPU.applyCalibration(record);
+ *  }
+ * @endcode
+ * */
+
+#ifndef _MPU_CALIBRATION_HPP_
+#define _MPU_CALIBRATION_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Offset computation and self-test state machine */
+class Calibrator
+{
+ public:
+    static constexpr int64_t kSettleUs         = 50000;  /*!< Settle time after configuration [us] */
+    static constexpr int64_t kSelfTestSettleUs = 20000;  /*!< Settle time after enabling self-test [us] */
+    static constexpr int64_t kSampleUs         = 100000; /*!< Sampling time of the offset capture [us] */
+    static constexpr int64_t kSelfTestSampleUs = 50000;  /*!< Sampling time of each self-test capture [us] */
+    static constexpr int kPacketsPerPoll       = 16;     /*!< FIFO packets read by one poll(), in one burst */
+    static constexpr uint8_t kRecordVersion    = 1;      /*!< Layout version of packed records */
+    static constexpr size_t kRecordSize        = 30;     /*!< Bytes of a packed record */
+
+    explicit Calibrator(MPU& mpu);
+    esp_err_t startOffsets();
+    esp_err_t startSelfTest();
+    esp_err_t poll(int64_t* waitUs = nullptr);
+    esp_err_t run();
+    esp_err_t abort();
+    calib_state_t getState();
+    bool busy();
+    esp_err_t getOffsets(raw_axes_t* accel, raw_axes_t* gyro);
+    esp_err_t getSelfTest(selftest_t* result);
+    esp_err_t getRecord(calib_record_t* record);
+    int getSampleCount();
+    int getRejectedCount();
+    static void pack(const calib_record_t& record, uint8_t data[kRecordSize]);
+    static esp_err_t unpack(const uint8_t* data, size_t length, calib_record_t* record);
+
+ protected:
+    esp_err_t start(bool selfTest, accel_fs_t accelFS, gyro_fs_t gyroFS);
+    esp_err_t beginCapture(int next);
+    esp_err_t endCapture();
+    esp_err_t countCapture();
+    esp_err_t readCapture();
+    esp_err_t closeCapture();
+    esp_err_t finish();
+    esp_err_t fail(esp_err_t error);
+    esp_err_t restore();
+
+    MPU* mpu;                     /*!< MPU under calibration */
+    calib_state_t state;          /*!< Current step */
+    bool selfTest;                /*!< Self-test job, otherwise offsets */
+    int capture;                  /*!< Current capture: 0 regular, 1 self-test */
+    int64_t deadline;             /*!< Time the current step ends [us] */
+    int64_t nextDrain;            /*!< Time the FIFO is due to be drained while sampling [us] */
+    int64_t drainUs;              /*!< FIFO drain interval, half the FIFO capacity [us] */
+    uint16_t fifoCapacity;        /*!< FIFO size [bytes] */
+    accel_fs_t accelFS;           /*!< Full-scale range of the captures */
+    gyro_fs_t gyroFS;             /*!< Full-scale range of the captures */
+    int pendingPackets;           /*!< Packets counted in the FIFO and not read yet */
+    int samples;                  /*!< Packets averaged in the current capture */
+    int rejected;                 /*!< Packets rejected as outliers in the current capture */
+    float mean[6];                /*!< Running mean of accel and gyro axes [LSB] */
+    float m2[6];                  /*!< Running sum of squared deviations of accel and gyro axes [LSB^2] */
+    config_snapshot_t saved;      /*!< Configuration saved on start */
+    raw_axes_t accelBias[2];      /*!< Average per capture, gravity removed */
+    raw_axes_t gyroBias[2];       /*!< Average per capture */
+    uint8_t whoami;               /*!< Chip model, for the record */
+    int16_t temperature;          /*!< Temperature during the capture, for the record */
+    selftest_t result;            /*!< Self-test result */
+    esp_err_t err;                /*!< Holds last error code */
+};
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_CALIBRATION_HPP_ */
@@ -0,0 +1,125 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/ekf.hpp
+ * @brief Error-state (multiplicative) Kalman filter for attitude and gyro bias.
+ *
+ * @details
+ *  `AttitudeEKF` keeps the orientation as a unit quaternion and the gyro bias as nominal state,
+ *  and a 6 x 6 covariance of their errors: small rotation (3) and bias (3). The gyro drives
+ *  the prediction; each accelerometer axis (and magnetometer axis) is a scalar update, so
+ *  there is no matrix inverse. After the updates the error is folded into the nominal state.
+ *
+ *  Compared to `AHRS`, the gyro bias is estimated online with its uncertainty, and the
+ *  accelerometer noise grows with the distance of the measured magnitude from 1 g, so
+ *  vibration and linear acceleration pull the attitude less. The magnetometer only corrects
+ *  the heading, never the tilt.
+ *
+ *  Float-only, no heap; same inputs as `AHRS` (accel in g, gyro in rad/s, FIFO batches
+ *  stepped by their timestamps, AK89xx magnetometer frame for batches).
+ *
+ * @code
+ *  mpud::AttitudeEKF ekf;
+ *  fifo.read(batch, &count);
+ *  ekf.update(batch, mpud::math::makeScale(mpud::ACCEL_FS_4G, mpud::GYRO_FS_500DPS));
+ *  mpud::float_axes_t bias = ekf.getGyroBias();  // [rad/s]
+ * @endcode
+ * */
+
+#ifndef _MPU_EKF_HPP_
+#define _MPU_EKF_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MPU.hpp"
+#include "mpu/batch.hpp"
+#include "mpu/math.hpp"
+#include "mpu/matrix.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Attitude and gyro bias estimator, error-state extended Kalman filter */
+class AttitudeEKF
+{
+ public:
+    static constexpr float kDefaultGyroNoise  = 0.003f;   /*!< Gyro white noise [rad/s/sqrt(Hz)] */
+    static constexpr float kDefaultBiasNoise  = 0.0002f;  /*!< Gyro bias random walk [rad/s^2/sqrt(Hz)] */
+    static constexpr float kDefaultAccelNoise = 0.05f;    /*!< Accelerometer noise [g] */
+    static constexpr float kDefaultMagNoise   = 0.1f;     /*!< Magnetometer noise, normalized field */
+    static constexpr float kAccelGate         = 0.5f;     /*!< Accel updates skipped beyond 1 g +- this [g] */
+    static constexpr float kMaxStep           = 0.1f;     /*!< Longest step [s], for gaps between timestamps */
+
+    AttitudeEKF();
+    void reset();
+    void reset(const quat_t& orientation, const float_axes_t& gyroBias);
+    AttitudeEKF& setNoise(float gyroNoise, float biasNoise, float accelNoise, float magNoise);
+    const quat_t& getQuaternion();
+    float_axes_t getEuler();
+    float_axes_t getGyroBias();
+    float_axes_t getAttitudeStd();
+    float_axes_t getGyroBiasStd();
+    void update(const float_axes_t& gyro, const float_axes_t& accel, float dt);
+    void update(const float_axes_t& gyro, const float_axes_t& accel, const float_axes_t& mag, float dt);
+    void update(const fifo_sample_t* samples, size_t count, const math::scale_t& scale, bool useMag = false);
+    template <size_t N>
+    void update(const SampleBatch<N>& batch, const math::scale_t& scale, bool useMag = false);
+
+ protected:
+    static constexpr int kStates = 6;  //!< error state: rotation (3), gyro bias (3)
+    typedef Matrix<kStates, kStates> covariance_t;
+
+    float step(int64_t timestamp);
+    void predict(const float_axes_t& gyro, float dt);
+    void fuse(const float_axes_t& h, float residual, float variance, float error[kStates]);
+    void correctAccel(const float_axes_t& accel, float error[kStates]);
+    void correctMag(const float_axes_t& mag, float error[kStates]);
+    void inject(const float error[kStates]);
+
+    quat_t q;               /*!< Orientation, sensor frame to earth frame */
+    float_axes_t bias;      /*!< Gyro bias [rad/s] */
+    covariance_t P;         /*!< Error covariance */
+    float_axes_t magRef;    /*!< Normalized magnetic field, earth frame, from the first 9-axis sample */
+    float gyroNoise;        /*!< Gyro white noise [rad/s/sqrt(Hz)] */
+    float biasNoise;        /*!< Gyro bias random walk [rad/s^2/sqrt(Hz)] */
+    float accelNoise;       /*!< Accelerometer noise [g] */
+    float magNoise;         /*!< Magnetometer noise, normalized */
+    int64_t lastTimestamp;  /*!< Timestamp of the previous batch sample, 0 after reset */
+    bool aligned;           /*!< Orientation initialized from the first sample */
+    bool magAligned;        /*!< Reference field initialized */
+};
+
+/**
+ * @brief Filter a structure-of-arrays batch, stepping by the sample timestamps.
+ * @param scale Conversion factors of the full-scale configuration the batch was sampled with.
+ * @param useMag Use the magnetometer columns (9-axis), if the FIFO holds compass data.
+ */
+template <size_t N>
+void AttitudeEKF::update(const SampleBatch<N>& batch, const math::scale_t& scale, bool useMag)
+{
+    for (size_t i = 0; i < batch.count; i++) {
+        const float dt = step(batch.timestamp[i]);
+        float_axes_t gyro, accel;
+        for (int j = 0; j < 3; j++) {
+            gyro[j]  = batch.gyro[j][i] * scale.gyro_rps;
+            accel[j] = batch.accel[j][i] * scale.accel;
+        }
+#if defined CONFIG_MPU_AK89xx
+        if (useMag) {
+            update(gyro, accel, math::magToGyroFrame(batch.mag[0][i], batch.mag[1][i], batch.mag[2][i]), dt);
+            continue;
+        }
+#endif
+        update(gyro, accel, dt);
+    }
+}
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_EKF_HPP_ */
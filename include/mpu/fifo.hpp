@@ -0,0 +1,187 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/fifo.hpp
+ * @brief FIFO streaming: packet framing and batch reading.
+ *
+ * @details
+ *  `FIFOReader` derives the packet layout from the FIFO configuration of a MPU
+ *  (accel, temp, gyro axes, Aux I2C Slaves 0-3 and compass), drains the FIFO with
+ *  as few burst reads as the bus allows and decodes complete packets into
+ *  `fifo_sample_t` batches, or into structure-of-arrays columns (`SampleBatch`). Bytes of a
+ *  packet split across reads are kept for the next call.
+ *
+ *  A FIFO overflow (or a count that is not on a packet boundary) does not require `resetFIFO()`:
+ *  the reader drops the partial packet at the head of the FIFO, realigns on the next packet
+ *  boundary and reports the number of samples lost, estimated from the time elapsed since the
+ *  previous read and the sample rate.
+ *
+ *  Each sample gets a timestamp in host time (`esp_timer_get_time()`). The reader fits a line
+ *  `time = offset + period * sample index` through the time of every read (or the data-ready
+ *  interrupt time given by the caller) and the index of the newest sample in the FIFO at that
+ *  moment, which tracks the drift of the MPU internal clock against the host clock.
+ *
+ *  Batching: instead of waking on every data-ready interrupt, set a watermark with
+ *  setWatermark() and call readBatch() in a loop. The task sleeps until the FIFO is expected to hold
+ *  the watermark, from the clock fit, then drains it in bulk. A larger watermark means fewer
+ *  wake-ups and bus transactions but more latency; on MPU6500 / MPU9250 `MPU::setFIFOSize()`
+ *  allows larger batches (up to 4kB when the DMP is not used).
+ *
+ * @code
+ *  mpud::FIFOReader fifo(MPU);
+ *  MPU.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO);
+ *  MPU.setFIFOEnabled(true);
+ *  fifo.begin();  // after any change to FIFO or Aux I2C configuration
+ *  mpud::fifo_sample_t samples[32];
+ *  size_t count;
+ *  fifo.read(samples, 32, &count);
+ * @endcode
+ * */
+
+#ifndef _MPU_FIFO_HPP_
+#define _MPU_FIFO_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "mpu/batch.hpp"
+#include "mpu/ring.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Batch reader of FIFO packets */
+class FIFOReader
+{
+ public:
+    static constexpr size_t kBufferSize = 512; /*!< Bytes held between the bus and the decoder */
+
+    explicit FIFOReader(MPU& mpu);
+    esp_err_t begin();
+    esp_err_t begin(fifo_config_t config, const uint8_t slaveLength[4]);
+    void clear();
+    FIFOReader& setMaxBurstLength(size_t length);
+    const fifo_layout_t& getLayout();
+    size_t getPacketSize();
+    size_t getPending();
+    uint32_t getLostSamples();
+    uint32_t getOverflowCount();
+    float getSamplePeriod();
+    float getClockDrift();
+    esp_err_t setWatermark(size_t samples);
+    size_t getWatermark();
+    size_t getMaxWatermark();
+    esp_err_t read(fifo_sample_t* samples, size_t maxSamples, size_t* count, int_stat_t status = 0,
+                   int64_t sampleTimeUs = 0);
+    esp_err_t read(const sample_columns_t& columns, size_t maxSamples, size_t* count, int_stat_t status = 0,
+                   int64_t sampleTimeUs = 0);
+    template <size_t N>
+    esp_err_t read(SampleBatch<N>& batch, size_t* count, int_stat_t status = 0, int64_t sampleTimeUs = 0);
+    template <size_t N>
+    esp_err_t read(SampleRing<N>& ring, size_t* count, int_stat_t status = 0, int64_t sampleTimeUs = 0);
+    esp_err_t waitWatermark();
+    esp_err_t readBatch(fifo_sample_t* samples, size_t maxSamples, size_t* count);
+    void decode(const uint8_t* packet, fifo_sample_t* sample);
+    void decode(const uint8_t* packets, size_t count, fifo_sample_t* samples);
+    void decode(const uint8_t* packets, size_t count, const sample_columns_t& columns, size_t first = 0);
+    int64_t timestamp(int64_t index);
+
+ protected:
+    static constexpr int kClockFitWindow = 1024; /*!< Observations weighting the clock fit (exponential) */
+    static constexpr int kClockFitMin    = 16;   /*!< Observations before the fitted period is used */
+
+    /*! Weighted least squares sums of (sample index, time) observations, relative to a reference */
+    struct clock_fit_t
+    {
+        double w, x, y, xx, xy;  //!< sum of weights, x, y, x*x, x*y
+        int64_t index;           //!< reference sample index
+        int64_t time;            //!< reference time [us]
+        uint32_t count;          //!< observations
+    };
+
+    template <bool kTemp>
+    static void decodeKernel(const uint8_t* packets, size_t packetSize, size_t count, int mag,
+                             fifo_sample_t* samples);
+    esp_err_t readTo(fifo_sample_t* samples, const sample_columns_t* columns, size_t maxSamples, size_t* count,
+                     int_stat_t status, int64_t sampleTimeUs);
+    size_t decodePending(fifo_sample_t* samples, const sample_columns_t* columns, size_t first, size_t maxSamples);
+    esp_err_t realign(uint16_t fifoCount, size_t received, size_t* consumed);
+    void clockObserve(int64_t index, int64_t time);
+
+    MPU* mpu;                     /*!< MPU which FIFO is read */
+    fifo_layout_t layout;         /*!< Packet layout of the current FIFO configuration */
+    size_t maxBurst;              /*!< Maximum length of a single FIFO read */
+    size_t pending;               /*!< Bytes in buffer not decoded yet, less than one packet between calls */
+    size_t capacity;              /*!< FIFO size [bytes] */
+    fifo_mode_t mode;             /*!< FIFO mode, overwrite or stop when full */
+    float nominalPeriod;          /*!< Sample period from the sample rate [us], 0 if unknown */
+    float period;                 /*!< Estimated sample period [us] */
+    clock_fit_t fit;              /*!< Clock fit */
+    int64_t sampleIndex;          /*!< Index of the next sample to decode, counts lost samples too */
+    int64_t gapIndex;             /*!< Index where newest samples were lost in stop-when-full mode */
+    uint32_t gapLength;           /*!< Samples lost at gapIndex */
+    int64_t lastReadUs;           /*!< Time of the previous read */
+    size_t leftBytes;             /*!< Bytes left in the FIFO by the previous read */
+    uint32_t lost;                /*!< Samples lost before the batch of the last read */
+    uint32_t overflows;           /*!< Overflows detected since begin() */
+    bool speculated;              /*!< Last read went past the FIFO count */
+    size_t watermark;             /*!< Samples per batch for readBatch() */
+    uint8_t buffer[kBufferSize];  /*!< Raw FIFO data */
+};
+
+/**
+ * @brief Drain the FIFO into a structure-of-arrays batch, appending to the samples it holds.
+ * @param batch Batch to fill, up to its capacity.
+ * @param count Number of samples added to the batch.
+ * @see read()
+ */
+template <size_t N>
+esp_err_t FIFOReader::read(SampleBatch<N>& batch, size_t* count, int_stat_t status, int64_t sampleTimeUs)
+{
+    const esp_err_t err = read(batch.columns(batch.count), batch.room(), count, status, sampleTimeUs);
+    batch.count += *count;
+    return err;
+}
+
+/**
+ * @brief Drain the FIFO straight into a ring, as its producer.
+ *
+ * Samples are decoded in place into the free space of the ring. When the free space wraps
+ * around the end of the storage, a second read fills the start. If the ring is full nothing
+ * is read, samples wait in the FIFO (and eventually overflow, see getLostSamples()).
+ *
+ * @param ring Ring this task produces to.
+ * @param count Number of samples added to the ring.
+ * @see read()
+ */
+template <size_t N>
+esp_err_t FIFOReader::read(SampleRing<N>& ring, size_t* count, int_stat_t status, int64_t sampleTimeUs)
+{
+    *count = 0;
+    size_t room;
+    fifo_sample_t* dest = ring.prepare(&room);
+    if (room == 0) return ESP_OK;
+    esp_err_t err = read(dest, room, count, status, sampleTimeUs);
+    ring.commit(*count);
+    if (err || *count < room) return err;
+    dest = ring.prepare(&room);
+    if (room == 0) return ESP_OK;
+    const uint32_t lostBefore = lost;
+    size_t more               = 0;
+    err                       = read(dest, room, &more);
+    ring.commit(more);
+    *count += more;
+    lost += lostBefore;
+    return err;
+}
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_FIFO_HPP_ */
@@ -0,0 +1,133 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/matrix.hpp
+ * @brief Fixed-size float matrices for small filters.
+ *
+ * @details
+ *  Storage is part of the object (no heap), sizes are template parameters, so every loop has a
+ *  constant trip count the compiler unrolls: meant for the 3 to 9 state filters of this driver
+ *  (see `AttitudeEKF`), not for general linear algebra. No inverse: filters use sequential
+ *  scalar updates instead.
+ * */
+
+#ifndef _MPU_MATRIX_HPP_
+#define _MPU_MATRIX_HPP_
+
+#include <stddef.h>
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Math namespace */
+inline namespace math
+{
+/*! `R` x `C` matrix, row-major */
+template <size_t R, size_t C>
+struct Matrix
+{
+    float m[R][C];  //!< [row][column]
+
+    float* operator[](size_t row) { return m[row]; }
+    const float* operator[](size_t row) const { return m[row]; }
+
+    static Matrix zero()
+    {
+        Matrix a;
+        for (size_t i = 0; i < R; i++)
+            for (size_t j = 0; j < C; j++) a.m[i][j] = 0;
+        return a;
+    }
+
+    /*! Diagonal matrix with `value` on the diagonal */
+    static Matrix diagonal(float value)
+    {
+        Matrix a = zero();
+        for (size_t i = 0; i < R && i < C; i++) a.m[i][i] = value;
+        return a;
+    }
+
+    static Matrix identity() { return diagonal(1); }
+};
+
+template <size_t R, size_t K, size_t C>
+Matrix<R, C> operator*(const Matrix<R, K>& a, const Matrix<K, C>& b)
+{
+    Matrix<R, C> p;
+    for (size_t i = 0; i < R; i++) {
+        for (size_t j = 0; j < C; j++) {
+            float sum = 0;
+            for (size_t k = 0; k < K; k++) sum += a.m[i][k] * b.m[k][j];
+            p.m[i][j] = sum;
+        }
+    }
+    return p;
+}
+
+template <size_t R, size_t C>
+Matrix<R, C> operator+(const Matrix<R, C>& a, const Matrix<R, C>& b)
+{
+    Matrix<R, C> s;
+    for (size_t i = 0; i < R; i++)
+        for (size_t j = 0; j < C; j++) s.m[i][j] = a.m[i][j] + b.m[i][j];
+    return s;
+}
+
+template <size_t R, size_t C>
+Matrix<R, C> operator-(const Matrix<R, C>& a, const Matrix<R, C>& b)
+{
+    Matrix<R, C> s;
+    for (size_t i = 0; i < R; i++)
+        for (size_t j = 0; j < C; j++) s.m[i][j] = a.m[i][j] - b.m[i][j];
+    return s;
+}
+
+template <size_t R, size_t C>
+Matrix<C, R> transpose(const Matrix<R, C>& a)
+{
+    Matrix<C, R> t;
+    for (size_t i = 0; i < R; i++)
+        for (size_t j = 0; j < C; j++) t.m[j][i] = a.m[i][j];
+    return t;
+}
+
+/*! `a * b^T`, without forming the transpose */
+template <size_t R, size_t K, size_t C>
+Matrix<R, C> multiplyTransposed(const Matrix<R, K>& a, const Matrix<C, K>& b)
+{
+    Matrix<R, C> p;
+    for (size_t i = 0; i < R; i++) {
+        for (size_t j = 0; j < C; j++) {
+            float sum = 0;
+            for (size_t k = 0; k < K; k++) sum += a.m[i][k] * b.m[j][k];
+            p.m[i][j] = sum;
+        }
+    }
+    return p;
+}
+
+/*! `f * p * f^T` for a symmetric `p`, e.g. covariance propagation; the result is exactly symmetric */
+template <size_t N>
+Matrix<N, N> sandwich(const Matrix<N, N>& f, const Matrix<N, N>& p)
+{
+    const Matrix<N, N> fp = f * p;
+    Matrix<N, N> s;
+    for (size_t i = 0; i < N; i++) {
+        for (size_t j = i; j < N; j++) {
+            float sum = 0;
+            for (size_t k = 0; k < N; k++) sum += fp.m[i][k] * f.m[j][k];
+            s.m[i][j] = s.m[j][i] = sum;
+        }
+    }
+    return s;
+}
+
+}  // namespace math
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_MATRIX_HPP_ */
@@ -0,0 +1,143 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/ring.hpp
+ * @brief Lock-free single-producer / single-consumer ring buffer.
+ *
+ * @details
+ *  Fixed capacity, storage is part of the object (no heap). One task writes (e.g. the FIFO reader
+ *  task, see `FIFOReader::read(SampleRing<N>&, size_t*, int_stat_t, int64_t)`), one task reads,
+ *  each in batches, without locks. Items that do not fit are dropped and counted.
+ *
+ * @code
+ *  static mpud::SampleRing<256> ring;
+ *  // reader task
+ *  fifo.read(ring, &count);
+ *  // consumer task
+ *  mpud::fifo_sample_t samples[32];
+ *  size_t n = ring.pop(samples, 32);
+ * @endcode
+ * */
+
+#ifndef _MPU_RING_HPP_
+#define _MPU_RING_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "mpu/types.hpp"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/**
+ * @brief Single-producer / single-consumer ring of `N` items of type `T`.
+ * @note `N` must be a power of 2. Only the producer may call prepare(), commit() and push();
+ *  only the consumer may call peek(), release() and pop(). size() and getDropped() are safe anywhere.
+ */
+template <typename T, size_t N>
+class SPSCRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SPSCRing capacity must be a power of 2");
+
+ public:
+    SPSCRing() : head{0}, tail{0}, dropped{0} {}
+
+    /*! Return the number of items the ring holds. */
+    static constexpr size_t capacity() { return N; }
+
+    /*! Return the number of items ready to pop. */
+    size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    /*! Return the number of items dropped by push() because the ring was full. */
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Producer: return the contiguous free space to write into, up to the end of the storage.
+     * @param length Number of items that can be written at the returned pointer.
+     */
+    T* prepare(size_t* length)
+    {
+        const size_t h    = head.load(std::memory_order_relaxed);
+        const size_t free = N - (h - tail.load(std::memory_order_acquire));
+        const size_t end  = N - (h & (N - 1));
+        *length           = free < end ? free : end;
+        return &items[h & (N - 1)];
+    }
+
+    /*! Producer: publish `length` items written at prepare(). */
+    void commit(size_t length) { head.store(head.load(std::memory_order_relaxed) + length, std::memory_order_release); }
+
+    /**
+     * @brief Producer: copy items in, the ones that do not fit are dropped.
+     * @return Number of items pushed.
+     */
+    size_t push(const T* data, size_t length)
+    {
+        size_t pushed = 0;
+        while (pushed < length) {
+            size_t room;
+            T* dest = prepare(&room);
+            if (room == 0) break;
+            if (room > length - pushed) room = length - pushed;
+            for (size_t i = 0; i < room; i++) dest[i] = data[pushed + i];
+            commit(room);
+            pushed += room;
+        }
+        if (pushed < length) dropped.fetch_add(length - pushed, std::memory_order_relaxed);
+        return pushed;
+    }
+
+    /**
+     * @brief Consumer: return the contiguous items ready to read, up to the end of the storage.
+     * @param length Number of items readable at the returned pointer.
+     */
+    const T* peek(size_t* length)
+    {
+        const size_t t     = tail.load(std::memory_order_relaxed);
+        const size_t ready = head.load(std::memory_order_acquire) - t;
+        const size_t end   = N - (t & (N - 1));
+        *length            = ready < end ? ready : end;
+        return &items[t & (N - 1)];
+    }
+
+    /*! Consumer: give back `length` items read at peek(). */
+    void release(size_t length) { tail.store(tail.load(std::memory_order_relaxed) + length, std::memory_order_release); }
+
+    /**
+     * @brief Consumer: copy up to `length` items out.
+     * @return Number of items popped.
+     */
+    size_t pop(T* data, size_t length)
+    {
+        size_t popped = 0;
+        while (popped < length) {
+            size_t ready;
+            const T* src = peek(&ready);
+            if (ready == 0) break;
+            if (ready > length - popped) ready = length - popped;
+            for (size_t i = 0; i < ready; i++) data[popped + i] = src[i];
+            release(ready);
+            popped += ready;
+        }
+        return popped;
+    }
+
+ protected:
+    std::atomic<size_t> head;       /*!< Items written, free running, owned by the producer */
+    std::atomic<size_t> tail;       /*!< Items read, free running, owned by the consumer */
+    std::atomic<uint32_t> dropped;  /*!< Items dropped by push() */
+    T items[N];                     /*!< Storage */
+};
+
+/*! Ring of decoded FIFO samples */
+template <size_t N>
+using SampleRing = SPSCRing<fifo_sample_t, N>;
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_RING_HPP_ */
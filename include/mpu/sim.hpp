@@ -0,0 +1,165 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/sim.hpp
+ * @brief Virtual MPU device and bus, for running the driver without a chip.
+ *
+ * @details
+ *  `VirtualBus` has the same interface as `I2Cbus` and is used as `mpu_bus_t`
+ *  when `CONFIG_MPU_VIRTUAL_DEVICE` is enabled in menuconfig. It forwards every
+ *  transaction to a `VirtualMPU`, a register level model of the chip selected
+ *  in menuconfig, and keeps statistics of the traffic generated by the driver.
+ *
+ *  The model covers:
+ *  - Register file with power-on values, WHO_AM_I and OTP self-test codes;
+ *  - Sample rate timing from SMPLRT_DIV, DLPF and Fchoice (plus `scene_t::clockDrift`),
+ *    driven by `esp_timer_get_time()`;
+ *  - Accel / Gyro / Temperature data generated from a `scene_t`, with FSR, offset
+ *    registers and self-test response applied;
+ *  - FIFO with packet order, size, overwrite / stop-on-full modes and overflow status;
+ *  - Auxiliary I2C Master (Slaves 0-4, sample delay) and bypass mode;
+ *  - AK8963 / AK8975 magnetometer behind the Auxiliary I2C bus.
+ *
+ * @note
+ *  Slave 4 transfers complete right away instead of at the next sample.
+ *  Not modeled: DMP, motion / zero-motion / free-fall detection, low power
+ *  accelerometer cycling, FSYNC and Aux I2C byte swapping.
+ * */
+
+#ifndef _MPU_SIM_HPP_
+#define _MPU_SIM_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Simulation namespace */
+namespace sim
+{
+/*! Physical quantities measured by the virtual device */
+struct scene_t
+{
+    float accel[3];      /*!< Acceleration [g] */
+    float gyro[3];       /*!< Angular rate [º/s] */
+    float mag[3];        /*!< Magnetic field [uT] */
+    float accelBias[3];  /*!< Accelerometer zero-g offset [g] */
+    float gyroBias[3];   /*!< Gyroscope zero-rate offset [º/s] */
+    float temp;          /*!< Die temperature [ºC] */
+    uint16_t noise;      /*!< Peak noise added to accel and gyro samples [LSB] */
+    int32_t clockDrift;  /*!< Internal clock error against the host clock [ppm], positive runs fast */
+};
+
+/*! Traffic statistics of a virtual bus */
+struct bus_stats_t
+{
+    uint32_t transactions; /*!< Bus transactions (a read-modify-write counts as two) */
+    uint32_t reads;        /*!< Read transactions */
+    uint32_t writes;       /*!< Write transactions */
+    uint32_t bytesRead;    /*!< Payload bytes read */
+    uint32_t bytesWritten; /*!< Payload bytes written */
+    int64_t busTimeNs;     /*!< Time the bus would be busy [ns] */
+};
+
+/*! Register level model of a MPU chip (and its magnetometer) */
+class VirtualMPU
+{
+ public:
+    static constexpr size_t kFIFOSizeMax = 4096;
+
+    VirtualMPU();
+    void powerOn();
+    scene_t& scene();
+    uint8_t peek(uint8_t regAddr) const;
+    uint16_t fifoCount() const;
+    uint32_t sampleCount() const;
+    uint32_t overflowCount() const;
+    int64_t nextSampleUs();
+    esp_err_t read(uint8_t devAddr, uint8_t regAddr, size_t length, uint8_t* data);
+    esp_err_t write(uint8_t devAddr, uint8_t regAddr, size_t length, const uint8_t* data);
+
+ protected:
+    void reset();
+    void update();
+    void sample();
+    void auxI2CSample();
+    bool auxI2CTransfer(uint8_t slvAddr, uint8_t slvReg, uint8_t slvLen, uint8_t slvDO, uint8_t* rxdata);
+    void fifoPush(const uint8_t* data, size_t length);
+    uint8_t fifoPop();
+    size_t fifoCapacity() const;
+    int64_t samplePeriodNs() const;
+    uint8_t readRegister(uint8_t regAddr);
+    void writeRegister(uint8_t regAddr, uint8_t data);
+    int16_t noise();
+    bool bypassEnabled() const;
+#if defined CONFIG_MPU_AK89xx
+    void compassReset();
+    void compassMeasure(bool selftest);
+    uint8_t compassReadRegister(uint8_t regAddr);
+    void compassWriteRegister(uint8_t regAddr, uint8_t data);
+#endif
+
+    scene_t scene_;
+    uint8_t regs_[128];
+    uint8_t fifo_[kFIFOSizeMax];
+    size_t fifoHead_;
+    size_t fifoCount_;
+    int64_t nextSampleNs_;
+    uint32_t samples_;
+    uint32_t overflows_;
+    uint32_t auxSamples_;
+    uint32_t rng_;
+#if defined CONFIG_MPU_AK89xx
+    uint8_t compassRegs_[0x13];
+#endif
+};
+
+/*! Bus that connects the driver to a `VirtualMPU`, mirrors `I2Cbus` interface */
+class VirtualBus
+{
+ public:
+    explicit VirtualBus(VirtualMPU& device, uint32_t clockSpeed = 400000);
+    esp_err_t close();
+    VirtualMPU& device();
+    void setClockSpeed(uint32_t clockSpeed);
+    void setTransactionOverhead(uint32_t overheadUs);
+    const bus_stats_t& stats() const;
+    void resetStats();
+    int64_t elapsedUs() const;
+    /* I2Cbus interface */
+    esp_err_t writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data, int32_t timeout = -1);
+    esp_err_t writeBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data,
+                        int32_t timeout = -1);
+    esp_err_t writeByte(uint8_t devAddr, uint8_t regAddr, uint8_t data, int32_t timeout = -1);
+    esp_err_t writeBytes(uint8_t devAddr, uint8_t regAddr, size_t length, const uint8_t* data, int32_t timeout = -1);
+    esp_err_t readBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t* data, int32_t timeout = -1);
+    esp_err_t readBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t* data,
+                       int32_t timeout = -1);
+    esp_err_t readByte(uint8_t devAddr, uint8_t regAddr, uint8_t* data, int32_t timeout = -1);
+    esp_err_t readBytes(uint8_t devAddr, uint8_t regAddr, size_t length, uint8_t* data, int32_t timeout = -1);
+
+ protected:
+    void account(bool read, size_t length);
+
+    VirtualMPU* device_;
+    uint32_t clockSpeed_;
+    uint32_t overheadUs_;
+    bus_stats_t stats_;
+    int64_t elapsedNs_;
+};
+
+extern VirtualMPU mpu0;  /*!< Default virtual device */
+extern VirtualBus vbus0; /*!< Default virtual bus, connected to `mpu0` */
+
+}  // namespace sim
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_SIM_HPP_ */
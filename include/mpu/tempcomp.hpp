@@ -0,0 +1,137 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/tempcomp.hpp
+ * @brief Temperature-compensated gyro and accel bias.
+ *
+ * @details
+ *  `TempCompensation` fits bias-versus-temperature curves, a polynomial per axis, from recorded
+ *  points: the bias measured at some die temperature, e.g. the mean of a still window of
+ *  `GyroBiasTracker`, or `computeOffsets()` runs at different temperatures. The degree follows the
+ *  data: constant with a single temperature, linear over a few degrees, quadratic over a wider span.
+ *
+ *  The model is applied on the raw samples, before any unit conversion (float or fixed-point).
+ *  The bias is evaluated once per batch, at its mean temperature, since the die warms over seconds.
+ *  It is then subtracted from each sample as an integer, a vectorized pass over the columns that is
+ *  negligible next to the unit conversion or the orientation filters.
+ *
+ *  The fitted model (`temp_model_t`) can be stored by the application and set back on boot.
+ *
+ * @code
+ *  mpud::TempCompensation comp;
+ *  comp.addGyroPoint(mpud::math::tempCelsius(rawTemp), tracker.getBias());  // over the day
+ *  comp.fit();
+ *  fifo.read(batch, &count);
+ *  comp.compensate(batch, mpud::ACCEL_FS_4G, mpud::GYRO_FS_500DPS);
+ * @endcode
+ * */
+
+#ifndef _MPU_TEMPCOMP_HPP_
+#define _MPU_TEMPCOMP_HPP_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "mpu/batch.hpp"
+#include "mpu/math.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Bias versus temperature model, fitted from recorded points and applied to raw samples */
+class TempCompensation
+{
+ public:
+    static constexpr int kMaxDegree       = 2;     /*!< Highest polynomial degree */
+    static constexpr float kLinearSpan    = 3.f;   /*!< Temperature span for a linear fit [ºC] */
+    static constexpr float kQuadraticSpan = 15.f;  /*!< Temperature span for a quadratic fit [ºC] */
+
+    explicit TempCompensation(float refTemp = 25.f);
+    void reset();
+    void addGyroPoint(float tempC, const float_axes_t& bias);
+    void addAccelPoint(float tempC, const float_axes_t& bias);
+    esp_err_t fit();
+    int getGyroDegree();
+    int getAccelDegree();
+    const temp_model_t& getModel();
+    void setModel(const temp_model_t& model);
+    float_axes_t gyroBias(float tempC);
+    float_axes_t accelBias(float tempC);
+    void compensate(fifo_sample_t* samples, size_t count, accel_fs_t accelFS, gyro_fs_t gyroFS);
+    template <size_t N>
+    void compensate(SampleBatch<N>& batch, accel_fs_t accelFS, gyro_fs_t gyroFS);
+
+ protected:
+    static constexpr int kGyro  = 0;
+    static constexpr int kAccel = 1;
+
+    void addPoint(int sensor, float tempC, const float_axes_t& bias);
+    int fitSensor(int sensor, float coeffs[3][3]);
+    void offsets(float tempC, accel_fs_t accelFS, gyro_fs_t gyroFS, int16_t accel[3], int16_t gyro[3]);
+    static float evaluate(const float coeffs[3], float dT);
+    static int16_t meanTemp(const int16_t* temp, size_t count);
+    static int16_t subtract(int16_t value, int16_t offset);
+    static void subtract(int16_t* __restrict column, size_t count, int16_t offset);
+
+    temp_model_t model;   /*!< Fitted or loaded model */
+    int degree[2];        /*!< Degree fitted, per sensor, -1 without points */
+    uint32_t count[2];    /*!< Points, per sensor */
+    float minTemp[2];     /*!< Temperature range of the points, per sensor [ºC] */
+    float maxTemp[2];     /*!< Temperature range of the points, per sensor [ºC] */
+    double sumX[2][5];    /*!< Sums of x^k, x = dT / 10, per sensor */
+    double sumY[2][3][3]; /*!< Sums of bias * x^k, per sensor and axis */
+};
+
+/**
+ * @brief Remove the modeled biases from a batch, in place, at the mean temperature of the batch.
+ * The batch needs the temperature column (FIFO_CFG_TEMPERATURE).
+ */
+template <size_t N>
+void TempCompensation::compensate(SampleBatch<N>& batch, accel_fs_t accelFS, gyro_fs_t gyroFS)
+{
+    if (batch.count == 0) return;
+    int16_t accel[3], gyro[3];
+    offsets(math::tempCelsius(meanTemp(batch.temp, batch.count)), accelFS, gyroFS, accel, gyro);
+    for (int i = 0; i < 3; i++) {
+        subtract(batch.accel[i], batch.count, accel[i]);
+        subtract(batch.gyro[i], batch.count, gyro[i]);
+    }
+}
+
+/*! Return the mean of a temperature column. */
+inline int16_t TempCompensation::meanTemp(const int16_t* temp, size_t count)
+{
+    int32_t sum = 0;
+    for (size_t i = 0; i < count; i++) sum += temp[i];
+    return sum / (int32_t) count;
+}
+
+/*! Return `value - offset`, saturated to int16. */
+inline int16_t TempCompensation::subtract(int16_t value, int16_t offset)
+{
+    const int32_t result = value - offset;
+    return result > INT16_MAX ? INT16_MAX : result < INT16_MIN ? INT16_MIN : result;
+}
+
+/*! Subtract `offset` from each element, saturated. Blocks of 8 vectorize, as in math::scaleArray(). */
+inline void TempCompensation::subtract(int16_t* __restrict column, size_t count, int16_t offset)
+{
+    if (offset == 0) return;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        for (size_t k = 0; k < 8; k++) column[i + k] = subtract(column[i + k], offset);
+    }
+    for (; i < count; i++) column[i] = subtract(column[i], offset);
+}
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_TEMPCOMP_HPP_ */
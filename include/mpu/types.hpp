@@ -29,7 +29,12 @@ typedef enum {  //
 } mpu_i2caddr_t;
 static constexpr mpu_i2caddr_t MPU_DEFAULT_I2CADDRESS = MPU_I2CADDRESS_AD0_LOW;
 
-#ifdef CONFIG_MPU_I2C
+#if defined CONFIG_MPU_VIRTUAL_DEVICE
+typedef sim::VirtualBus mpu_bus_t;
+typedef mpu_i2caddr_t mpu_addr_handle_t;
+static constexpr mpu_bus_t& MPU_DEFAULT_BUS                = sim::vbus0;
+static constexpr mpu_addr_handle_t MPU_DEFAULT_ADDR_HANDLE = MPU_DEFAULT_I2CADDRESS;
+#elif defined CONFIG_MPU_I2C
 typedef I2C_t mpu_bus_t;                 /*!< Communication bus type, `I2Cbus` or `SPIbus`. */
 typedef mpu_i2caddr_t mpu_addr_handle_t; /*!< MPU Address/Handle type, `mpu_i2caddr_t` or `spi_device_handle_t` */
 static constexpr mpu_bus_t& MPU_DEFAULT_BUS                = i2c0;
@@ -421,6 +426,21 @@ static constexpr fifo_config_t FIFO_CFG_SLAVE3      = (1 << 8);
 static constexpr fifo_config_t FIFO_CFG_COMPASS = (FIFO_CFG_SLAVE0);  // 8 bytes
 #endif
 
+/*! FIFO packet layout, byte offset of each sensor in a packet (-1 when not present) */
+typedef struct
+{
+    fifo_config_t config;  //!< FIFO configuration this layout was made for
+    uint8_t packet_size;   //!< Packet size [bytes]
+    int8_t accel;          //!< Accelerometer X, Y, Z
+    int8_t temp;           //!< Temperature
+    int8_t gyro[3];        //!< Gyroscope X, Y, Z (each axis can be enabled alone)
+    int8_t slave[4];       //!< External sensor data read by Aux I2C Slaves 0-3
+    uint8_t slave_len[4];  //!< Length of each slave data [bytes]
+#if defined CONFIG_MPU_AK89xx
+    int8_t mag;  //!< Magnetometer X, Y, Z (little endian), inside Slave 0 data
+#endif
+} fifo_layout_t;
+
 // Enable DMP features
 /* @note DMP_FEATURE_LP_QUAT and DMP_FEATURE_6X_LP_QUAT are mutually exclusive.
  * @note DMP_FEATURE_SEND_RAW_GYRO and DMP_FEATURE_SEND_CAL_GYRO are also
@@ -461,12 +481,120 @@ struct axes_t
             type_t z;
         };
     };
+    axes_t() = default;
+    constexpr axes_t(type_t x, type_t y, type_t z) : xyz{x, y, z} {}
     type_t& operator[](int i) { return xyz[i]; }
+    constexpr const type_t& operator[](int i) const { return xyz[i]; }
 };
 // Ready-to-use axes types
 typedef axes_t<int16_t> raw_axes_t;  //!< Axes type to hold gyroscope, accelerometer, magnetometer raw data.
 typedef axes_t<float> float_axes_t;  //!< Axes type to hold converted sensor data.
 
+/*! Unit quaternion, `w + xi + yj + zk`, rotation of the sensor frame relative to the earth frame */
+typedef struct
+{
+    float w;  //!< scalar part
+    float x;  //!< i
+    float y;  //!< j
+    float z;  //!< k
+} quat_t;
+
+/*! Rotation matrix, row-major, `v_earth = m * v_sensor` */
+typedef struct
+{
+    float m[3][3];  //!< [row][column]
+} rotation_t;
+
+/*! Orientation filter algorithm of AHRS */
+typedef enum {
+    AHRS_MADGWICK = 0,  //!< gradient descent on the accel (and mag) error, gain beta
+    AHRS_MAHONY   = 1   //!< PI feedback of the accel (and mag) error onto the gyro, gains kp / ki
+} ahrs_filter_t;
+
+/*! Calibrator state */
+typedef enum {
+    CALIB_IDLE     = 0,  //!< nothing started
+    CALIB_SETTLING = 1,  //!< configured, waiting for the sensors to stabilize
+    CALIB_SAMPLING = 2,  //!< FIFO filling with samples to average
+    CALIB_READING  = 3,  //!< FIFO being read, a slice per poll
+    CALIB_DONE     = 4,  //!< result available, configuration restored
+    CALIB_FAILED   = 5   //!< bus error, configuration restored as far as possible
+} calib_state_t;
+
+/*! Calibration record, kept across boots (see Calibrator::pack()) and re-applied with MPU::applyCalibration() */
+typedef struct
+{
+    uint8_t whoami;          //!< WHO_AM_I of the chip calibrated
+    raw_axes_t accelTrim;    //!< accel factory trim, see MPU::getAccelFactoryTrim() [16G LSB]
+    raw_axes_t accelOffset;  //!< computed accel offset, added to accelTrim [16G LSB]
+    raw_axes_t gyroOffset;   //!< computed gyro offset [1000DPS LSB]
+    uint8_t magAdjust[3];    //!< compass sensitivity adjustment (ASA), zero without compass
+    int16_t temperature;     //!< raw die temperature at calibration
+} calib_record_t;
+
+/*! Bytes of a configuration snapshot: registers 0x13-0x1D, 0x23-0x27, 0x37-0x38 and 0x6A-0x6C,
+ *  plus I2C_SLV4_CTRL (Aux I2C sample delay, set by MPU::setSampleRate()) with a compass */
+#if defined CONFIG_MPU_AK89xx
+static constexpr uint8_t CONFIG_SNAPSHOT_SIZE = 22;
+#else
+static constexpr uint8_t CONFIG_SNAPSHOT_SIZE = 21;
+#endif
+
+/*! Configuration registers, saved by MPU::saveConfig() and written back by MPU::restoreConfig() */
+typedef struct
+{
+    uint8_t data[CONFIG_SNAPSHOT_SIZE];  //!< register values, ranges in address order
+} config_snapshot_t;
+
+/*! Device configuration profile, see MPU::applyConfig() */
+typedef struct
+{
+    clock_src_t clock_src;       //!< clock source
+    bool sleep;                  //!< sleep mode
+    stby_en_t standby;           //!< sensors in standby, see setStandbyMode()
+    uint16_t sample_rate;        //!< 4Hz ~ 1KHz, see setSampleRate()
+    dlpf_t dlpf;                 //!< digital low pass filter, gyro and accel
+    accel_fs_t accel_fs;         //!< accel full-scale range
+    gyro_fs_t gyro_fs;           //!< gyro full-scale range
+    fifo_config_t fifo_config;   //!< sensors written to the FIFO
+    fifo_mode_t fifo_mode;       //!< FIFO behaviour when full
+    bool fifo_enabled;           //!< FIFO module enable
+    int_config_t int_config;     //!< INT pin configuration
+    int_en_t int_enabled;        //!< interrupt sources
+#if defined CONFIG_MPU6500
+    fifo_size_t fifo_size;       //!< FIFO size [MPU6500 / MPU9250 only]
+#endif
+} mpu_config_t;
+
+/*! Profile set by MPU::initialize() when none is given */
+static constexpr mpu_config_t MPU_DEFAULT_CONFIG = {
+    CLOCK_PLL,
+    false,
+    STBY_EN_NONE,
+    100,
+    DLPF_42HZ,
+    ACCEL_FS_4G,
+    GYRO_FS_500DPS,
+    FIFO_CFG_NONE,
+    FIFO_MODE_OVERWRITE,
+    false,
+    {INT_LVL_ACTIVE_HIGH, INT_DRV_PUSHPULL, INT_MODE_PULSE50US, INT_CLEAR_STATUS_REG},
+    INT_EN_NONE,
+#if defined CONFIG_MPU6500
+    // the first 3kB of memory are needed by the DMP, the FIFO takes the last 1kB
+    FIFO_SIZE_1K,
+#endif
+};
+
+/*! Bias versus temperature model (see TempCompensation), per axis `c[0] + c[1] * dT + c[2] * dT^2`,
+ *  `dT` in ºC from refTemp. Coefficients of unused degrees are zero. */
+typedef struct
+{
+    float refTemp;      //!< reference temperature [ºC]
+    float gyro[3][3];   //!< gyro bias coefficients, [axis][degree] [º/s]
+    float accel[3][3];  //!< accel bias coefficients, [axis][degree] [g]
+} temp_model_t;
+
 /*! Sensors struct for fast reading all sensors at once */
 typedef struct
 {
@@ -479,6 +607,31 @@ typedef struct
 #endif
 } sensors_t;
 
+/*! Sample decoded from a FIFO packet, sensors not present in the packet read zero */
+typedef struct
+{
+    raw_axes_t accel;  //!< accelerometer
+    raw_axes_t gyro;   //!< gyroscope
+    int16_t temp;      //!< temperature
+#if defined CONFIG_MPU_AK89xx
+    raw_axes_t mag;  //!< magnetometer
+#endif
+    int64_t timestamp;  //!< estimated sampling time, host clock [us]
+} fifo_sample_t;
+
+/*! Structure-of-arrays view of a sample batch, one contiguous array per axis (see SampleBatch).
+ *  A null column is skipped when filling the batch. */
+typedef struct
+{
+    int16_t* accel[3];  //!< accelerometer X, Y, Z
+    int16_t* gyro[3];   //!< gyroscope X, Y, Z
+    int16_t* temp;      //!< temperature
+#if defined CONFIG_MPU_AK89xx
+    int16_t* mag[3];  //!< magnetometer X, Y, Z
+#endif
+    int64_t* timestamp;  //!< estimated sampling time, host clock [us]
+} sample_columns_t;
+
 // ============
 // MAGNETOMETER
 // ============
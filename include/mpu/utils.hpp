@@ -12,7 +12,9 @@
 #ifndef _MPU_UTILS_HPP_
 #define _MPU_UTILS_HPP_
 
+#include <stddef.h>
 #include <stdint.h>
+#include "mpu/types.hpp"
 #include "sdkconfig.h"
 
 /*! MPU Driver namespace */
@@ -21,6 +23,63 @@ namespace mpud
 /*! Utilities namespace */
 inline namespace utils
 {
+/*! Return the big endian 16-bit word at `data` (MPU registers and FIFO) */
+inline int16_t be16(const uint8_t* data)
+{
+    return (int16_t)(data[0] << 8 | data[1]);
+}
+
+/*! Return the little endian 16-bit word at `data` (compass registers) */
+inline int16_t le16(const uint8_t* data)
+{
+    return (int16_t)(data[1] << 8 | data[0]);
+}
+
+/*! Decode X, Y, Z big endian words */
+inline void be16Axes(const uint8_t* data, raw_axes_t* axes)
+{
+    axes->x = be16(data);
+    axes->y = be16(data + 2);
+    axes->z = be16(data + 4);
+}
+
+/*! Decode X, Y, Z little endian words */
+inline void le16Axes(const uint8_t* data, raw_axes_t* axes)
+{
+    axes->x = le16(data);
+    axes->y = le16(data + 2);
+    axes->z = le16(data + 4);
+}
+
+/**
+ * @brief Decode a column of big endian words, e.g. the same field of consecutive FIFO packets.
+ *
+ * Branch-free loop over fixed strides, meant to be called once per field and batch
+ * instead of once per field and packet.
+ *
+ * @param src First word.
+ * @param srcStride Bytes from one word to the next (packet size).
+ * @param count Number of words.
+ * @param dst First output.
+ * @param dstStride Elements from one output to the next (1 for a plain array).
+ */
+inline void be16Decode(const uint8_t* src, size_t srcStride, size_t count, int16_t* dst, size_t dstStride)
+{
+    for (size_t n = 0; n < count; n++) dst[n * dstStride] = be16(src + n * srcStride);
+}
+
+/*! Same as be16Decode(), little endian words. */
+inline void le16Decode(const uint8_t* src, size_t srcStride, size_t count, int16_t* dst, size_t dstStride)
+{
+    for (size_t n = 0; n < count; n++) dst[n * dstStride] = le16(src + n * srcStride);
+}
+
+/*! Fill a column with `value`, for fields not present in a packet. */
+inline void fillColumn(int16_t value, size_t count, int16_t* dst, size_t dstStride)
+{
+    for (size_t n = 0; n < count; n++) dst[n * dstStride] = value;
+}
+
 }  // namespace utils
 
 }  // namespace mpud
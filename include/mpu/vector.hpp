@@ -0,0 +1,336 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu/vector.hpp
+ * @brief Vector and quaternion math over `axes_t` and `quat_t`.
+ *
+ * @details
+ *  Header-only, float, no heap. Arithmetic operators, dot and cross products are constexpr.
+ *  Quaternions are unit quaternions for the rotation from the sensor frame to the earth
+ *  frame (as `AHRS` produces); Euler angles are [rad], aerospace sequence (yaw, pitch, roll),
+ *  in `axes_t` as (roll, pitch, yaw).
+ *
+ *  Fast approximations, error bounds checked on the host bench for all inputs in range:
+ *  - fastInvSqrt(): relative error < 5e-6 (two Newton steps);
+ *  - fastAtan2(): absolute error < 1e-5 rad (6e-4 º), any quadrant.
+ *
+ * @code
+ *  using namespace mpud::math;
+ *  mpud::float_axes_t up      = gravity(ahrs.getQuaternion());  // earth z axis in sensor frame
+ *  mpud::float_axes_t linear  = accelG - up;                     // gravity removed [g]
+ *  mpud::float_axes_t inEarth = rotate(ahrs.getQuaternion(), linear);
+ * @endcode
+ * */
+
+#ifndef _MPU_VECTOR_HPP_
+#define _MPU_VECTOR_HPP_
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "mpu/math.hpp"
+#include "mpu/types.hpp"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Math namespace */
+inline namespace math
+{
+constexpr float kRadToDeg = 180 / M_PI;
+
+/**
+ * @brief Approximate `1 / sqrt(x)`, x > 0.
+ * Bit-level initial guess and two Newton steps, relative error < 5e-6. No division nor sqrt,
+ * which are multi-cycle sequences on Xtensa and soft-float on FPU-less chips.
+ */
+inline float fastInvSqrt(float x)
+{
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86 - (i >> 1);
+    float y;
+    memcpy(&y, &i, sizeof(y));
+    const float half = 0.5f * x;
+    y *= 1.5f - half * y * y;
+    y *= 1.5f - half * y * y;
+    return y;
+}
+
+/*! Approximate `atan(z)` for |z| <= 1, minimax polynomial, absolute error < 1e-5 rad */
+constexpr float fastAtanUnit(float z, float z2)
+{
+    return z * (0.99997726f +
+                z2 * (-0.33262347f + z2 * (0.19354346f + z2 * (-0.11643287f + z2 * (0.05265332f - z2 * 0.01172120f)))));
+}
+
+/*! Approximate `atan2(y, x)`, absolute error < 1e-5 rad, 0 for (0, 0). */
+inline float fastAtan2(float y, float x)
+{
+    const float ax = fabsf(x), ay = fabsf(y);
+    if (ax == 0.f && ay == 0.f) return 0.f;
+    float angle;
+    if (ay <= ax) {
+        const float z = ay / ax;
+        angle         = fastAtanUnit(z, z * z);
+    } else {
+        const float z = ax / ay;
+        angle         = static_cast<float>(M_PI / 2) - fastAtanUnit(z, z * z);
+    }
+    if (x < 0.f) angle = static_cast<float>(M_PI) - angle;
+    return y < 0.f ? -angle : angle;
+}
+
+/* Vectors */
+
+template <typename T>
+constexpr axes_t<T> operator+(const axes_t<T>& a, const axes_t<T>& b)
+{
+    return axes_t<T>(a[0] + b[0], a[1] + b[1], a[2] + b[2]);
+}
+
+template <typename T>
+constexpr axes_t<T> operator-(const axes_t<T>& a, const axes_t<T>& b)
+{
+    return axes_t<T>(a[0] - b[0], a[1] - b[1], a[2] - b[2]);
+}
+
+template <typename T>
+constexpr axes_t<T> operator-(const axes_t<T>& a)
+{
+    return axes_t<T>(-a[0], -a[1], -a[2]);
+}
+
+template <typename T>
+constexpr axes_t<T> operator*(const axes_t<T>& a, T s)
+{
+    return axes_t<T>(a[0] * s, a[1] * s, a[2] * s);
+}
+
+template <typename T>
+constexpr axes_t<T> operator*(T s, const axes_t<T>& a)
+{
+    return a * s;
+}
+
+template <typename T>
+constexpr axes_t<T> operator/(const axes_t<T>& a, T s)
+{
+    return axes_t<T>(a[0] / s, a[1] / s, a[2] / s);
+}
+
+template <typename T>
+axes_t<T>& operator+=(axes_t<T>& a, const axes_t<T>& b)
+{
+    return a = a + b;
+}
+
+template <typename T>
+axes_t<T>& operator-=(axes_t<T>& a, const axes_t<T>& b)
+{
+    return a = a - b;
+}
+
+template <typename T>
+axes_t<T>& operator*=(axes_t<T>& a, T s)
+{
+    return a = a * s;
+}
+
+template <typename T>
+constexpr T dot(const axes_t<T>& a, const axes_t<T>& b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+template <typename T>
+constexpr axes_t<T> cross(const axes_t<T>& a, const axes_t<T>& b)
+{
+    return axes_t<T>(a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]);
+}
+
+inline float norm(const float_axes_t& a)
+{
+    return sqrtf(dot(a, a));
+}
+
+/*! Return `a` scaled to unit length, zero stays zero. */
+inline float_axes_t normalize(const float_axes_t& a)
+{
+    const float n2 = dot(a, a);
+    return n2 > 0.f ? a * fastInvSqrt(n2) : a;
+}
+
+/*! Convert raw axes to float, e.g. before vector math on uncalibrated units. */
+constexpr float_axes_t toFloat(const raw_axes_t& a)
+{
+    return float_axes_t(a[0], a[1], a[2]);
+}
+
+/* Quaternions */
+
+constexpr quat_t kQuatIdentity = {1, 0, 0, 0};
+
+/*! Hamilton product, rotation `b` then `a` */
+constexpr quat_t operator*(const quat_t& a, const quat_t& b)
+{
+    return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,  //
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,  //
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,  //
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+/*! Inverse rotation of a unit quaternion */
+constexpr quat_t conjugate(const quat_t& q)
+{
+    return {q.w, -q.x, -q.y, -q.z};
+}
+
+constexpr float dot(const quat_t& a, const quat_t& b)
+{
+    return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+/**
+ * @brief Return `q` scaled to unit norm, identity for zero.
+ * fastInvSqrt() plus a third Newton step: the norm error of two steps is always low by up to
+ * 5e-6, which adds up in angle measures (`acos` of a dot product) to 0.2º.
+ */
+inline quat_t normalize(const quat_t& q)
+{
+    const float n2 = dot(q, q);
+    if (!(n2 > 0.f)) return kQuatIdentity;
+    float r = fastInvSqrt(n2);
+    r *= 1.5f - 0.5f * n2 * r * r;
+    return {q.w * r, q.x * r, q.y * r, q.z * r};
+}
+
+/*! Rotate `v` by `q`, sensor frame to earth frame; `rotate(conjugate(q), v)` for the inverse. */
+inline float_axes_t rotate(const quat_t& q, const float_axes_t& v)
+{
+    // v + 2w (u x v) + 2 u x (u x v), u = vector part
+    const float_axes_t u(q.x, q.y, q.z);
+    const float_axes_t t = cross(u, v) * 2.f;
+    return v + t * q.w + cross(u, t);
+}
+
+/*! Earth up axis (gravity reaction, what the accelerometer reads at rest) in the sensor frame [g] */
+constexpr float_axes_t gravity(const quat_t& q)
+{
+    return float_axes_t(2 * (q.x * q.z - q.w * q.y), 2 * (q.w * q.x + q.y * q.z),
+                        q.w * q.w - q.x * q.x - q.y * q.y + q.z * q.z);
+}
+
+/*! Rotation of `angle` [rad] about the unit `axis` */
+inline quat_t fromAxisAngle(const float_axes_t& axis, float angle)
+{
+    const float s = sinf(angle / 2);
+    return {cosf(angle / 2), axis.x * s, axis.y * s, axis.z * s};
+}
+
+/**
+ * @brief Quaternion of Euler angles (roll, pitch, yaw) [rad], aerospace sequence.
+ */
+inline quat_t fromEuler(const float_axes_t& euler)
+{
+    const float cr = cosf(euler.x / 2), sr = sinf(euler.x / 2);
+    const float cp = cosf(euler.y / 2), sp = sinf(euler.y / 2);
+    const float cy = cosf(euler.z / 2), sy = sinf(euler.z / 2);
+    return {cr * cp * cy + sr * sp * sy,  //
+            sr * cp * cy - cr * sp * sy,  //
+            cr * sp * cy + sr * cp * sy,  //
+            cr * cp * sy - sr * sp * cy};
+}
+
+/**
+ * @brief Orientation of a sensor at rest from its accelerometer reading (roll, pitch), and from
+ * the tilt-compensated magnetic field (yaw), if given; yaw is zero otherwise.
+ * @param accel Accelerometer, any unit, not zero.
+ * @param mag Magnetic field in the accel/gyro frame, any unit, or null.
+ */
+inline quat_t fromGravity(const float_axes_t& accel, const float_axes_t* mag = nullptr)
+{
+    const float roll  = atan2f(accel.y, accel.z);
+    const float pitch = atan2f(-accel.x, sqrtf(accel.y * accel.y + accel.z * accel.z));
+    float yaw         = 0;
+    if (mag != nullptr) {
+        const float sr = sinf(roll), cr = cosf(roll), sp = sinf(pitch), cp = cosf(pitch);
+        const float bx = mag->x * cp + mag->y * sp * sr + mag->z * sp * cr;
+        const float by = mag->y * cr - mag->z * sr;
+        yaw            = atan2f(-by, bx);
+    }
+    return fromEuler(float_axes_t(roll, pitch, yaw));
+}
+
+/**
+ * @brief Euler angles (roll, pitch, yaw) [rad] of a unit quaternion, aerospace sequence.
+ * Range: roll [-pi,pi], pitch [-pi/2,pi/2], yaw [-pi,pi]. Uses fastAtan2(), error < 1e-4 rad.
+ */
+inline float_axes_t toEuler(const quat_t& q)
+{
+    float sinp = 2 * (q.w * q.y - q.x * q.z);
+    if (sinp > 1.f) sinp = 1.f;
+    if (sinp < -1.f) sinp = -1.f;
+    return float_axes_t(fastAtan2(q.w * q.x + q.y * q.z, 0.5f - q.x * q.x - q.y * q.y),
+                        fastAtan2(sinp, sqrtf(1 - sinp * sinp)),
+                        fastAtan2(q.x * q.y + q.w * q.z, 0.5f - q.y * q.y - q.z * q.z));
+}
+
+/*! Rotation matrix of a unit quaternion */
+inline rotation_t toMatrix(const quat_t& q)
+{
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    rotation_t r;
+    r.m[0][0] = 1 - 2 * (yy + zz);
+    r.m[0][1] = 2 * (xy - wz);
+    r.m[0][2] = 2 * (xz + wy);
+    r.m[1][0] = 2 * (xy + wz);
+    r.m[1][1] = 1 - 2 * (xx + zz);
+    r.m[1][2] = 2 * (yz - wx);
+    r.m[2][0] = 2 * (xz - wy);
+    r.m[2][1] = 2 * (yz + wx);
+    r.m[2][2] = 1 - 2 * (xx + yy);
+    return r;
+}
+
+/*! Unit quaternion of a rotation matrix, from its largest diagonal term (stable for any rotation) */
+inline quat_t fromMatrix(const rotation_t& r)
+{
+    const float (&m)[3][3] = r.m;
+    const float trace      = m[0][0] + m[1][1] + m[2][2];
+    quat_t q;
+    if (trace > 0.f) {
+        const float s = 0.5f * fastInvSqrt(trace + 1);
+        q             = {0.25f / s, (m[2][1] - m[1][2]) * s, (m[0][2] - m[2][0]) * s, (m[1][0] - m[0][1]) * s};
+    } else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+        const float s = 0.5f * fastInvSqrt(1 + m[0][0] - m[1][1] - m[2][2]);
+        q             = {(m[2][1] - m[1][2]) * s, 0.25f / s, (m[0][1] + m[1][0]) * s, (m[0][2] + m[2][0]) * s};
+    } else if (m[1][1] > m[2][2]) {
+        const float s = 0.5f * fastInvSqrt(1 + m[1][1] - m[0][0] - m[2][2]);
+        q             = {(m[0][2] - m[2][0]) * s, (m[0][1] + m[1][0]) * s, 0.25f / s, (m[1][2] + m[2][1]) * s};
+    } else {
+        const float s = 0.5f * fastInvSqrt(1 + m[2][2] - m[0][0] - m[1][1]);
+        q             = {(m[1][0] - m[0][1]) * s, (m[0][2] + m[2][0]) * s, (m[1][2] + m[2][1]) * s, 0.25f / s};
+    }
+    return normalize(q);
+}
+
+/*! `m * v` */
+inline float_axes_t operator*(const rotation_t& r, const float_axes_t& v)
+{
+    return float_axes_t(r.m[0][0] * v.x + r.m[0][1] * v.y + r.m[0][2] * v.z,
+                        r.m[1][0] * v.x + r.m[1][1] * v.y + r.m[1][2] * v.z,
+                        r.m[2][0] * v.x + r.m[2][1] * v.y + r.m[2][2] * v.z);
+}
+
+}  // namespace math
+
+}  // namespace mpud
+
+#endif /* end of include guard: _MPU_VECTOR_HPP_ */
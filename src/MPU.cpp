@@ -16,9 +16,11 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
 #include "freertos/task.h"
+#include "mpu/calibration.hpp"
 #include "mpu/math.hpp"
 #include "mpu/registers.hpp"
 #include "mpu/types.hpp"
+#include "mpu/utils.hpp"
 #include "sdkconfig.h"
 
 static const char* TAG = CONFIG_MPU_CHIP_MODEL;
@@ -29,9 +31,9 @@ static const char* TAG = CONFIG_MPU_CHIP_MODEL;
 namespace mpud
 {
 /**
- * @brief Initialize MPU device and set basic configurations.
+ * @brief Initialize MPU device and set a configuration profile.
  * @details
- *  Init configuration:
+ *  Default profile (MPU_DEFAULT_CONFIG):
  *  - Accel FSR: 4G
  *  - Gyro FSR: 500DPS
  *  - Sample rate: 100Hz
@@ -43,48 +45,36 @@ namespace mpud
  *  - Aux I2C Master: enabled, clock: 400KHz
  *  - Compass: enabled on Aux I2C's Slave 0 and Slave 1
  *
+ * @param config Profile to start with, written by applyConfig() in a few bursts, so that the
+ *  application does not override default values one register at a time afterwards.
+ *
  * @note
  *  - A soft reset is performed first, which takes 100-200ms.
  *  - When using SPI, the primary I2C Slave module is disabled right away.
  * */
-esp_err_t MPU::initialize()
+esp_err_t MPU::initialize(const mpu_config_t& config)
 {
     // reset device (wait a little to clear all registers)
     if (MPU_ERR_CHECK(reset())) return err;
-    // wake-up the device (power on-reset state is asleep for some models)
-    if (MPU_ERR_CHECK(setSleep(false))) return err;
+    // wake-up the device (power on-reset state is asleep for some models) with the clock source,
+    // the other PWR_MGMT1 bits are zero after reset
+    if (MPU_ERR_CHECK(writeByte(regs::PWR_MGMT1, config.clock_src))) return err;
+    // accel offset registers hold the factory trim (OTP) after reset, keep it for calibration records
+    accelFactoryTrim = getAccelOffset();
+    if (MPU_ERR_CHECK(lastError())) return err;
+    factoryTrimValid = true;
         // disable MPU's I2C slave module when using SPI
 #ifdef CONFIG_MPU_SPI
     if (MPU_ERR_CHECK(writeBit(regs::USER_CTRL, regs::USERCTRL_I2C_IF_DIS_BIT, 1))) return err;
 #endif
-    // set clock source to gyro PLL which is better than internal clock
-    if (MPU_ERR_CHECK(setClockSource(CLOCK_PLL))) return err;
-
-#ifdef CONFIG_MPU6500
-    // MPU6500 / MPU9250 share 4kB of memory between the DMP and the FIFO. Since the
-    // first 3kB are needed by the DMP, we'll use the last 1kB for the FIFO.
-    if (MPU_ERR_CHECK(writeBits(regs::ACCEL_CONFIG2, regs::ACONFIG2_FIFO_SIZE_BIT, regs::ACONFIG2_FIFO_SIZE_LENGTH,
-                                FIFO_SIZE_1K))) {
-        return err;
-    }
-#endif
-
-    // set Full Scale range
-    if (MPU_ERR_CHECK(setGyroFullScale(GYRO_FS_500DPS))) return err;
-    if (MPU_ERR_CHECK(setAccelFullScale(ACCEL_FS_4G))) return err;
-    // set Digital Low Pass Filter to get smoother data
-    if (MPU_ERR_CHECK(setDigitalLowPassFilter(DLPF_42HZ))) return err;
+    // FIFO size, full-scale ranges, DLPF, sample rate, ...; compass rate is set after compassInit()
+    if (MPU_ERR_CHECK(writeConfig(config, nullptr))) return err;
 
         // setup magnetometer
 #ifdef CONFIG_MPU_AK89xx
-    if (MPU_ERR_CHECK(compassInit())) return err;
-#ifdef CONFIG_MPU_AK8963
-    if (MPU_ERR_CHECK(compassSetSensitivity(MAG_SENSITIVITY_0_15_uT))) return err;
-#endif
+    if (MPU_ERR_CHECK(compassSetup())) return err;
 #endif
 
-    // set sample rate to 100Hz
-    if (MPU_ERR_CHECK(setSampleRate(100))) return err;
     MPU_LOGI("Initialization complete");
     return err;
 }
@@ -98,6 +88,7 @@ esp_err_t MPU::initialize()
 esp_err_t MPU::reset()
 {
     if (MPU_ERR_CHECK(writeBit(regs::PWR_MGMT1, regs::PWR1_DEVICE_RESET_BIT, 1))) return err;
+    invalidateRegisterCache();
     vTaskDelay(100 / portTICK_PERIOD_MS);
 #ifdef CONFIG_MPU_SPI
     if (MPU_ERR_CHECK(resetSignalPath())) {
@@ -194,17 +185,16 @@ esp_err_t MPU::setSampleRate(uint16_t rate)
     }
 
 #if CONFIG_MPU_LOG_LEVEL >= ESP_LOG_WARN
+    // read CONFIG and GYRO_CONFIG at once
+    if (MPU_ERR_CHECK(readBytes(regs::CONFIG, 2, buffer))) return err;
         // Check selected Fchoice [MPU6500 and MPU9250 only]
 #ifdef CONFIG_MPU6500
-    fchoice_t fchoice = getFchoice();
-    if (MPU_ERR_CHECK(lastError())) return err;
-    if (fchoice != FCHOICE_3) {
+    if ((buffer[1] & ((1 << regs::GCONFIG_FCHOICE_B_LENGTH) - 1)) != 0) {
         MPU_LOGWMSG(msgs::INVALID_STATE, ", sample rate divider is not effective when Fchoice != 3");
     }
 #endif
     // Check dlpf configuration
-    dlpf_t dlpf = getDigitalLowPassFilter();
-    if (MPU_ERR_CHECK(lastError())) return err;
+    const uint8_t dlpf = buffer[0] & ((1 << regs::CONFIG_DLPF_CFG_LENGTH) - 1);
     if (dlpf == 0 || dlpf == 7)
         MPU_LOGWMSG(msgs::INVALID_STATE, ", sample rate divider is not effective when DLPF is (0 or 7)");
 #endif
@@ -224,6 +214,20 @@ esp_err_t MPU::setSampleRate(uint16_t rate)
 
         // check and set compass sample rate
 #ifdef CONFIG_MPU_AK89xx
+    if (MPU_ERR_CHECK(setCompassSampleRate(finalRate))) return err;
+#endif
+
+    return err;
+}
+
+#ifdef CONFIG_MPU_AK89xx
+/**
+ * @brief Adjust the Aux I2C Master `sample_delay` and `wait_for_es` to the sample rate,
+ * when the compass is read in single measurement mode (see setSampleRate()).
+ * @param rate Actual sample rate [Hz].
+ */
+esp_err_t MPU::setCompassSampleRate(uint16_t rate)
+{
     const auxi2c_slv_config_t magSlaveChgModeConf = getAuxI2CSlaveConfig(MAG_SLAVE_CHG_MODE);
     if (MPU_ERR_CHECK(lastError())) return err;
     const bool magSlaveChgModeEnabled = getAuxI2CSlaveEnabled(MAG_SLAVE_CHG_MODE);
@@ -237,37 +241,35 @@ esp_err_t MPU::setSampleRate(uint16_t rate)
         }
         else {
             auxi2cConf.wait_for_es    = 0;
-            auxi2cConf.sample_delay   = (uint8_t)(ceil(static_cast<double>(finalRate) / COMPASS_SAMPLE_RATE_MAX) - 1);
-            const uint8_t compassRate = (finalRate / (auxi2cConf.sample_delay + 1));
+            auxi2cConf.sample_delay   = (uint8_t)(ceil(static_cast<double>(rate) / COMPASS_SAMPLE_RATE_MAX) - 1);
+            const uint8_t compassRate = (rate / (auxi2cConf.sample_delay + 1));
             MPU_LOGW("Compass sample rate constrained to %d, magnetometer's maximum is %d Hz", compassRate,
                      COMPASS_SAMPLE_RATE_MAX);
         }
         if (MPU_ERR_CHECK(setAuxI2CConfig(auxi2cConf))) return err;
     }
-#endif
-
     return err;
 }
+#endif
 
 /**
  * @brief Retrieve sample rate divider and calculate the actual rate.
  */
 uint16_t MPU::getSampleRate()
 {
+    // read SMPLRT_DIV, CONFIG and GYRO_CONFIG at once
+    MPU_ERR_CHECK(readBytes(regs::SMPLRT_DIV, 3, buffer));
 #ifdef CONFIG_MPU6500
-    fchoice_t fchoice = getFchoice();
-    MPU_ERR_CHECK(lastError());
-    if (fchoice != FCHOICE_3) return SAMPLE_RATE_MAX;
+    // FCHOICE != 3 (FCHOICE_B != 0)
+    if ((buffer[2] & ((1 << regs::GCONFIG_FCHOICE_B_LENGTH) - 1)) != 0) return SAMPLE_RATE_MAX;
 #endif
 
     constexpr uint16_t sampleRateMax_nolpf = 8000;
-    dlpf_t dlpf                            = getDigitalLowPassFilter();
-    MPU_ERR_CHECK(lastError());
+    const uint8_t dlpf                     = buffer[1] & ((1 << regs::CONFIG_DLPF_CFG_LENGTH) - 1);
     if (dlpf == 0 || dlpf == 7) return sampleRateMax_nolpf;
 
     constexpr uint16_t internalSampleRate = 1000;
-    MPU_ERR_CHECK(readByte(regs::SMPLRT_DIV, buffer));
-    uint16_t rate = internalSampleRate / (1 + buffer[0]);
+    uint16_t rate                         = internalSampleRate / (1 + buffer[0]);
     return rate;
 }
 
@@ -688,16 +690,27 @@ mot_stat_t MPU::getMotionDetectStatus()
 }
 #endif  // MPU6050's stuff
 
+/*! Register fields of a stby_en_t mask, shared by setStandbyMode() and applyConfig() */
+static constexpr struct
+{
+    uint8_t regAddr;
+    uint8_t bitStart;
+    uint8_t length;
+    uint8_t shift;  // of the mask
+} kStandbyFields[] = {
+    {regs::PWR_MGMT1, regs::PWR1_GYRO_STANDBY_BIT, 2, 6},  // gyro standby, temperature disable
+    {regs::PWR_MGMT2, regs::PWR2_STBY_XA_BIT, 6, 0},       // accel and gyro axes
+};
+
 /**
  * @brief Configure sensors' standby mode.
  * */
 esp_err_t MPU::setStandbyMode(stby_en_t mask)
 {
-    const uint8_t kPwr1StbyBits = mask >> 6;
-    if (MPU_ERR_CHECK(writeBits(regs::PWR_MGMT1, regs::PWR1_GYRO_STANDBY_BIT, 2, kPwr1StbyBits))) {
-        return err;
+    for (const auto& field : kStandbyFields) {
+        if (MPU_ERR_CHECK(writeBits(field.regAddr, field.bitStart, field.length, mask >> field.shift))) return err;
     }
-    return MPU_ERR_CHECK(writeBits(regs::PWR_MGMT2, regs::PWR2_STBY_XA_BIT, 6, mask));
+    return err;
 }
 
 /**
@@ -802,9 +815,7 @@ raw_axes_t MPU::getGyroOffset()
 {
     MPU_ERR_CHECK(readBytes(regs::XG_OFFSET_H, 6, buffer));
     raw_axes_t bias;
-    bias.x = (buffer[0] << 8) | buffer[1];
-    bias.y = (buffer[2] << 8) | buffer[3];
-    bias.z = (buffer[4] << 8) | buffer[5];
+    be16Axes(buffer, &bias);
     return bias;
 }
 
@@ -823,17 +834,15 @@ esp_err_t MPU::setAccelOffset(raw_axes_t bias)
 
 #if defined CONFIG_MPU6050
     if (MPU_ERR_CHECK(readBytes(regs::XA_OFFSET_H, 6, buffer))) return err;
-    facBias.x = (buffer[0] << 8) | buffer[1];
-    facBias.y = (buffer[2] << 8) | buffer[3];
-    facBias.z = (buffer[4] << 8) | buffer[5];
+    be16Axes(buffer, &facBias);
 
 #elif defined CONFIG_MPU6500
     if (MPU_ERR_CHECK(readBytes(regs::XA_OFFSET_H, 8, buffer))) return err;
     // note: buffer[2] and buffer[5], stay the same,
     //  they are read just to keep the burst reading
-    facBias.x = (buffer[0] << 8) | buffer[1];
-    facBias.y = (buffer[3] << 8) | buffer[4];
-    facBias.z = (buffer[6] << 8) | buffer[7];
+    facBias.x = be16(buffer);
+    facBias.y = be16(buffer + 3);
+    facBias.z = be16(buffer + 6);
 #endif
 
     // note: preserve bit 0 of factory value (for temperature compensation)
@@ -876,24 +885,41 @@ raw_axes_t MPU::getAccelOffset()
 
 #if defined CONFIG_MPU6050
     MPU_ERR_CHECK(readBytes(regs::XA_OFFSET_H, 6, buffer));
-    bias.x = (buffer[0] << 8) | buffer[1];
-    bias.y = (buffer[2] << 8) | buffer[3];
-    bias.z = (buffer[4] << 8) | buffer[5];
+    be16Axes(buffer, &bias);
 
 #elif defined CONFIG_MPU6500
     MPU_ERR_CHECK(readBytes(regs::XA_OFFSET_H, 8, buffer));
-    bias.x                        = (buffer[0] << 8) | buffer[1];
-    bias.y                        = (buffer[3] << 8) | buffer[4];
-    bias.z                        = (buffer[6] << 8) | buffer[7];
+    bias.x = be16(buffer);
+    bias.y = be16(buffer + 3);
+    bias.z = be16(buffer + 6);
 #endif
 
     return bias;
 }
 
+/**
+ * @brief Return the accel factory trim, as the offset registers held it right after the reset of
+ * initialize(), whatever offsets were set since.
+ *
+ * Note: Trim output are LSB in +-16G format.
+ * @return `ESP_ERR_INVALID_STATE` if initialize() did not run on this object (warmStart() that kept
+ *  the configuration).
+ * */
+esp_err_t MPU::getAccelFactoryTrim(raw_axes_t* trim)
+{
+    if (!factoryTrimValid) {
+        MPU_LOGEMSG(msgs::INVALID_STATE, " factory trim not read, initialize() first");
+        return err = ESP_ERR_INVALID_STATE;
+    }
+    *trim = accelFactoryTrim;
+    return err = ESP_OK;
+}
+
 /**
  * @brief Compute Accelerometer and Gyroscope offsets.
  *
- * This takes about ~400ms to compute offsets.
+ * This takes about 160 ms to compute offsets (Calibrator::kSettleUs + Calibrator::kSampleUs, and
+ * the FIFO reads), blocking; see Calibrator for a non-blocking version.
  * When calculating the offsets the MPU must remain as horizontal as possible (0 degrees), facing
  * up. It is better to call computeOffsets() before any configuration is done (better right after
  * initialize()).
@@ -903,26 +929,88 @@ raw_axes_t MPU::getAccelOffset()
  * */
 esp_err_t MPU::computeOffsets(raw_axes_t* accel, raw_axes_t* gyro)
 {
-    constexpr accel_fs_t kAccelFS = ACCEL_FS_2G;     // most sensitive
-    constexpr gyro_fs_t kGyroFS   = GYRO_FS_250DPS;  // most sensitive
-    if (MPU_ERR_CHECK(getBiases(kAccelFS, kGyroFS, accel, gyro, false))) return err;
-    // convert offsets to 16G and 1000DPS format and invert values
-    for (int i = 0; i < 3; i++) {
-        (*accel)[i] = -((*accel)[i] >> (types::ACCEL_FS_16G - kAccelFS));
-        (*gyro)[i]  = -((*gyro)[i] >> (types::GYRO_FS_1000DPS - kGyroFS));
+    Calibrator calibrator(*this);
+    if (MPU_ERR_CHECK(err = calibrator.startOffsets())) return err;
+    if (MPU_ERR_CHECK(err = calibrator.run())) return err;
+    return err = calibrator.getOffsets(accel, gyro);
+}
+
+/**
+ * @brief Check that a calibration record (see Calibrator::getRecord()) is valid for this chip now.
+ * Call after initialize() and before applyCalibration(), 2 bus reads. After a warmStart() that kept
+ * the configuration the factory trim is unknown: only a record already applied is recognized, from
+ * the offset registers (1 more read).
+ * @param maxTempDelta Largest difference between the current temperature and the one at calibration [ºC].
+ * @return
+ *  - `ESP_ERR_NOT_FOUND` if the record is from another chip: other model, or accel factory trim differs,
+ *  - `ESP_ERR_INVALID_STATE` if the record is stale: temperature moved beyond `maxTempDelta`.
+ * */
+esp_err_t MPU::checkCalibration(const calib_record_t& record, float maxTempDelta)
+{
+    const uint8_t wai = whoAmI();
+    if (MPU_ERR_CHECK(lastError())) return err;
+    bool sameChip = wai == record.whoami;
+    if (factoryTrimValid) {
+        for (int i = 0; i < 3; i++) sameChip &= accelFactoryTrim[i] == record.accelTrim[i];
+    }
+    else {
+        const raw_axes_t offset = getAccelOffset();
+        if (MPU_ERR_CHECK(lastError())) return err;
+        for (int i = 0; i < 3; i++) {
+            sameChip &= offset[i] == (int16_t)(record.accelTrim[i] + (record.accelOffset[i] & ~1));
+        }
+    }
+    if (!sameChip) {
+        MPU_LOGW("Calibration record from another chip");
+        return err = ESP_ERR_NOT_FOUND;
+    }
+    int16_t temp = 0;
+    if (MPU_ERR_CHECK(temperature(&temp))) return err;
+    const float delta = math::tempCelsius(temp) - math::tempCelsius(record.temperature);
+    if (fabsf(delta) > maxTempDelta) {
+        MPU_LOGW("Calibration record stale, temperature moved %+.1f ºC", delta);
+        return err = ESP_ERR_INVALID_STATE;
     }
     return err;
 }
 
+/**
+ * @brief Write the offsets of a calibration record to the offset registers.
+ *
+ * Same as setAccelOffset() and setGyroOffset() with the record offsets, but from the factory trim in
+ * the record: one burst write for each sensor (MPU6500 reads the accel block first, to keep the
+ * reserved registers in between). Applying twice is harmless.
+ * */
+esp_err_t MPU::applyCalibration(const calib_record_t& record)
+{
+    raw_axes_t accel;
+    for (int i = 0; i < 3; i++) accel[i] = record.accelTrim[i] + (record.accelOffset[i] & ~1);
+#if defined CONFIG_MPU6050
+    for (int i = 0; i < 3; i++) {
+        buffer[2 * i]     = (uint8_t)(accel[i] >> 8);
+        buffer[2 * i + 1] = (uint8_t)(accel[i]);
+    }
+    if (MPU_ERR_CHECK(writeBytes(regs::XA_OFFSET_H, 6, buffer))) return err;
+
+#elif defined CONFIG_MPU6500
+    if (MPU_ERR_CHECK(readBytes(regs::XA_OFFSET_H, 8, buffer))) return err;
+    for (int i = 0; i < 3; i++) {
+        buffer[3 * i]     = (uint8_t)(accel[i] >> 8);
+        buffer[3 * i + 1] = (uint8_t)(accel[i]);
+    }
+    if (MPU_ERR_CHECK(writeBytes(regs::XA_OFFSET_H, 8, buffer))) return err;
+#endif
+
+    return MPU_ERR_CHECK(setGyroOffset(record.gyroOffset));
+}
+
 /**
  * @brief Read accelerometer raw data.
  * */
 esp_err_t MPU::acceleration(raw_axes_t* accel)
 {
     if (MPU_ERR_CHECK(readBytes(regs::ACCEL_XOUT_H, 6, buffer))) return err;
-    accel->x = buffer[0] << 8 | buffer[1];
-    accel->y = buffer[2] << 8 | buffer[3];
-    accel->z = buffer[4] << 8 | buffer[5];
+    be16Axes(buffer, accel);
     return err;
 }
 
@@ -932,9 +1020,9 @@ esp_err_t MPU::acceleration(raw_axes_t* accel)
 esp_err_t MPU::acceleration(int16_t* x, int16_t* y, int16_t* z)
 {
     if (MPU_ERR_CHECK(readBytes(regs::ACCEL_XOUT_H, 6, buffer))) return err;
-    *x = buffer[0] << 8 | buffer[1];
-    *y = buffer[2] << 8 | buffer[3];
-    *z = buffer[4] << 8 | buffer[5];
+    *x = be16(buffer);
+    *y = be16(buffer + 2);
+    *z = be16(buffer + 4);
     return err;
 }
 
@@ -944,9 +1032,7 @@ esp_err_t MPU::acceleration(int16_t* x, int16_t* y, int16_t* z)
 esp_err_t MPU::rotation(raw_axes_t* gyro)
 {
     if (MPU_ERR_CHECK(readBytes(regs::GYRO_XOUT_H, 6, buffer))) return err;
-    gyro->x = buffer[0] << 8 | buffer[1];
-    gyro->y = buffer[2] << 8 | buffer[3];
-    gyro->z = buffer[4] << 8 | buffer[5];
+    be16Axes(buffer, gyro);
     return err;
 }
 
@@ -956,9 +1042,9 @@ esp_err_t MPU::rotation(raw_axes_t* gyro)
 esp_err_t MPU::rotation(int16_t* x, int16_t* y, int16_t* z)
 {
     if (MPU_ERR_CHECK(readBytes(regs::GYRO_XOUT_H, 6, buffer))) return err;
-    *x = buffer[0] << 8 | buffer[1];
-    *y = buffer[2] << 8 | buffer[3];
-    *z = buffer[4] << 8 | buffer[5];
+    *x = be16(buffer);
+    *y = be16(buffer + 2);
+    *z = be16(buffer + 4);
     return err;
 }
 
@@ -968,7 +1054,7 @@ esp_err_t MPU::rotation(int16_t* x, int16_t* y, int16_t* z)
 esp_err_t MPU::temperature(int16_t* temp)
 {
     if (MPU_ERR_CHECK(readBytes(regs::TEMP_OUT_H, 2, buffer))) return err;
-    *temp = buffer[0] << 8 | buffer[1];
+    *temp = be16(buffer);
     return err;
 }
 
@@ -978,12 +1064,8 @@ esp_err_t MPU::temperature(int16_t* temp)
 esp_err_t MPU::motion(raw_axes_t* accel, raw_axes_t* gyro)
 {
     if (MPU_ERR_CHECK(readBytes(regs::ACCEL_XOUT_H, 14, buffer))) return err;
-    accel->x = buffer[0] << 8 | buffer[1];
-    accel->y = buffer[2] << 8 | buffer[3];
-    accel->z = buffer[4] << 8 | buffer[5];
-    gyro->x  = buffer[8] << 8 | buffer[9];
-    gyro->y  = buffer[10] << 8 | buffer[11];
-    gyro->z  = buffer[12] << 8 | buffer[13];
+    be16Axes(buffer, accel);
+    be16Axes(buffer + 8, gyro);
     return err;
 }
 
@@ -994,9 +1076,7 @@ esp_err_t MPU::motion(raw_axes_t* accel, raw_axes_t* gyro)
 esp_err_t MPU::heading(raw_axes_t* mag)
 {
     if (MPU_ERR_CHECK(readBytes(regs::EXT_SENS_DATA_01, 6, buffer))) return err;
-    mag->x = buffer[1] << 8 | buffer[0];
-    mag->y = buffer[3] << 8 | buffer[2];
-    mag->z = buffer[5] << 8 | buffer[4];
+    le16Axes(buffer, mag);
     return err;
 }
 
@@ -1006,9 +1086,9 @@ esp_err_t MPU::heading(raw_axes_t* mag)
 esp_err_t MPU::heading(int16_t* x, int16_t* y, int16_t* z)
 {
     if (MPU_ERR_CHECK(readBytes(regs::EXT_SENS_DATA_01, 6, buffer))) return err;
-    *x = buffer[1] << 8 | buffer[0];
-    *y = buffer[3] << 8 | buffer[2];
-    *z = buffer[5] << 8 | buffer[4];
+    *x = le16(buffer);
+    *y = le16(buffer + 2);
+    *z = le16(buffer + 4);
     return err;
 }
 
@@ -1019,15 +1099,9 @@ esp_err_t MPU::motion(raw_axes_t* accel, raw_axes_t* gyro, raw_axes_t* mag)
 {
     uint8_t buffer[22];
     if (MPU_ERR_CHECK(readBytes(regs::ACCEL_XOUT_H, 22, buffer))) return err;
-    accel->x = buffer[0] << 8 | buffer[1];
-    accel->y = buffer[2] << 8 | buffer[3];
-    accel->z = buffer[4] << 8 | buffer[5];
-    gyro->x  = buffer[8] << 8 | buffer[9];
-    gyro->y  = buffer[10] << 8 | buffer[11];
-    gyro->z  = buffer[12] << 8 | buffer[13];
-    mag->x   = buffer[16] << 8 | buffer[15];
-    mag->y   = buffer[18] << 8 | buffer[17];
-    mag->z   = buffer[20] << 8 | buffer[19];
+    be16Axes(buffer, accel);
+    be16Axes(buffer + 8, gyro);
+    le16Axes(buffer + 15, mag);
     return err;
 }
 #endif  // AK89xx
@@ -1038,13 +1112,9 @@ esp_err_t MPU::motion(raw_axes_t* accel, raw_axes_t* gyro, raw_axes_t* mag)
 esp_err_t MPU::sensors(raw_axes_t* accel, raw_axes_t* gyro, int16_t* temp)
 {
     if (MPU_ERR_CHECK(readBytes(regs::ACCEL_XOUT_H, 14, buffer))) return err;
-    accel->x = buffer[0] << 8 | buffer[1];
-    accel->y = buffer[2] << 8 | buffer[3];
-    accel->z = buffer[4] << 8 | buffer[5];
-    *temp    = buffer[6] << 8 | buffer[7];
-    gyro->x  = buffer[8] << 8 | buffer[9];
-    gyro->y  = buffer[10] << 8 | buffer[11];
-    gyro->z  = buffer[12] << 8 | buffer[13];
+    be16Axes(buffer, accel);
+    *temp = be16(buffer + 6);
+    be16Axes(buffer + 8, gyro);
     return err;
 }
 
@@ -1063,17 +1133,50 @@ esp_err_t MPU::sensors(sensors_t* sensors, size_t extsens_len)
     const size_t length           = kIntSensLenMax + extsens_len;
 #endif
     if (MPU_ERR_CHECK(readBytes(regs::ACCEL_XOUT_H, length, buffer))) return err;
-    sensors->accel.x = buffer[0] << 8 | buffer[1];
-    sensors->accel.y = buffer[2] << 8 | buffer[3];
-    sensors->accel.z = buffer[4] << 8 | buffer[5];
-    sensors->temp    = buffer[6] << 8 | buffer[7];
-    sensors->gyro.x  = buffer[8] << 8 | buffer[9];
-    sensors->gyro.y  = buffer[10] << 8 | buffer[11];
-    sensors->gyro.z  = buffer[12] << 8 | buffer[13];
+    be16Axes(buffer, &sensors->accel);
+    sensors->temp = be16(buffer + 6);
+    be16Axes(buffer + 8, &sensors->gyro);
 #if CONFIG_MPU_AK89xx
-    sensors->mag.x = buffer[16] << 8 | buffer[15];
-    sensors->mag.y = buffer[18] << 8 | buffer[17];
-    sensors->mag.z = buffer[20] << 8 | buffer[19];
+    le16Axes(buffer + 15, &sensors->mag);
+#endif
+    memcpy(sensors->extsens, buffer + (length - extsens_len), extsens_len);
+    return err;
+}
+
+/**
+ * @brief Read interrupt status and data from all sensors, including external sensors in Aux I2C.
+ *
+ * INT_STATUS sits right before ACCEL_XOUT_H, so status and sensor data come in a single burst,
+ * instead of getInterruptStatus() followed by sensors().
+ * Reading INT_STATUS clears its bits, same as getInterruptStatus().
+ *
+ * @param sensors Sensor data, see sensors().
+ * @param status Interrupt status.
+ * @param extsens_len Number of bytes to read from external sensors data registers, besides the compass.
+ * */
+esp_err_t MPU::sensorsWithStatus(sensors_t* sensors, int_stat_t* status, size_t extsens_len)
+{
+    constexpr size_t kStatusLen     = 1;   // interrupt status length
+    constexpr size_t kIntSensLenMax = 14;  // internal sensors data length max
+    constexpr size_t kExtSensLenMax = 24;  // external sensors data length max
+    uint8_t buffer[kStatusLen + kIntSensLenMax + kExtSensLenMax];
+#if defined CONFIG_MPU_AK89xx
+    constexpr size_t kMagLen = 8;  // magnetometer data length
+#else
+    constexpr size_t kMagLen      = 0;
+#endif
+    if (kMagLen + extsens_len > kExtSensLenMax) {
+        MPU_LOGEMSG(msgs::INVALID_LENGTH, " extsens_len: %zu, maximum is %zu", extsens_len, kExtSensLenMax - kMagLen);
+        return err = ESP_ERR_INVALID_SIZE;
+    }
+    const size_t length = kStatusLen + kIntSensLenMax + kMagLen + extsens_len;
+    if (MPU_ERR_CHECK(readBytes(regs::INT_STATUS, length, buffer))) return err;
+    *status          = buffer[0];
+    be16Axes(buffer + 1, &sensors->accel);
+    sensors->temp = be16(buffer + 7);
+    be16Axes(buffer + 9, &sensors->gyro);
+#if CONFIG_MPU_AK89xx
+    le16Axes(buffer + 16, &sensors->mag);
 #endif
     memcpy(sensors->extsens, buffer + (length - extsens_len), extsens_len);
     return err;
@@ -1226,6 +1329,61 @@ bool MPU::getFIFOEnabled()
     return buffer[0];
 }
 
+/**
+ * @brief Return the packet layout of a FIFO configuration, sensors in the order of their registers.
+ * @param config FIFO configuration, as set with setFIFOConfig().
+ * @param slaveLength Bytes read by each Aux I2C Slave 0-3 (0 for disabled or write slaves).
+ * @note The compass offset is left at -1, it depends on what Slave 0 reads (see FIFOReader::begin()).
+ * */
+fifo_layout_t MPU::fifoLayout(fifo_config_t config, const uint8_t slaveLength[4])
+{
+    fifo_layout_t layout = {};
+    layout.config        = config;
+    int size             = 0;
+    layout.accel         = (config & FIFO_CFG_ACCEL) ? size : -1;
+    if (config & FIFO_CFG_ACCEL) size += 6;
+    layout.temp = (config & FIFO_CFG_TEMPERATURE) ? size : -1;
+    if (config & FIFO_CFG_TEMPERATURE) size += 2;
+    for (int i = 0; i < 3; i++) {
+        const bool enabled = config & (1 << (regs::FIFO_XGYRO_EN_BIT - i));
+        layout.gyro[i]     = enabled ? size : -1;
+        if (enabled) size += 2;
+    }
+    constexpr fifo_config_t kSlaveFIFOCfg[4] = {FIFO_CFG_SLAVE0, FIFO_CFG_SLAVE1, FIFO_CFG_SLAVE2, FIFO_CFG_SLAVE3};
+    for (int i = 0; i < 4; i++) {
+        const bool enabled  = (config & kSlaveFIFOCfg[i]) && slaveLength[i] > 0;
+        layout.slave[i]     = enabled ? size : -1;
+        layout.slave_len[i] = enabled ? slaveLength[i] : 0;
+        if (enabled) size += slaveLength[i];
+    }
+#if defined CONFIG_MPU_AK89xx
+    layout.mag = -1;
+#endif
+    layout.packet_size = size;
+    return layout;
+}
+
+#if defined CONFIG_MPU6500
+/**
+ * @brief Change FIFO size [MPU6500 / MPU9250 only].
+ * @note The FIFO shares 4kB of memory with the DMP, initialize() sets it to 1kB.
+ * */
+esp_err_t MPU::setFIFOSize(fifo_size_t size)
+{
+    return MPU_ERR_CHECK(
+        writeBits(regs::ACCEL_CONFIG2, regs::ACONFIG2_FIFO_SIZE_BIT, regs::ACONFIG2_FIFO_SIZE_LENGTH, size));
+}
+
+/**
+ * @brief Return FIFO size [MPU6500 / MPU9250 only].
+ */
+fifo_size_t MPU::getFIFOSize()
+{
+    MPU_ERR_CHECK(readBits(regs::ACCEL_CONFIG2, regs::ACONFIG2_FIFO_SIZE_BIT, regs::ACONFIG2_FIFO_SIZE_LENGTH, buffer));
+    return (fifo_size_t) buffer[0];
+}
+#endif
+
 /**
  * @brief Reset FIFO module.
  *
@@ -1234,6 +1392,7 @@ bool MPU::getFIFOEnabled()
  * */
 esp_err_t MPU::resetFIFO()
 {
+    fifoSpeculated = false;
     return MPU_ERR_CHECK(writeBit(regs::USER_CTRL, regs::USERCTRL_FIFO_RESET_BIT, 1));
 }
 
@@ -1256,6 +1415,83 @@ esp_err_t MPU::readFIFO(size_t length, uint8_t* data)
     return MPU_ERR_CHECK(readBytes(regs::FIFO_R_W, length, data));
 }
 
+/**
+ * @brief Read FIFO count and FIFO data in a single burst.
+ *
+ * FIFO_COUNT_H, FIFO_COUNT_L and FIFO_R_W are contiguous, so the count and the first
+ * `length` bytes of the FIFO come in one transaction, instead of getFIFOCount() followed by readFIFO(). \n
+ * The read is speculative: only `min(count, length)` bytes of `data` are valid.
+ *
+ * @param length Number of FIFO bytes to read, usually the packet size.
+ * @param data Buffer for FIFO data, must have room for `length + 2` bytes (the last two are scratch).
+ * @param count FIFO count before the read, in bytes.
+ *
+ * @attention When `count` is less than `length`, a packet written between the count bytes and the
+ *  FIFO_R_W bytes of the same burst is partly read past the count and lost, and the head of the
+ *  FIFO is then the tail of that packet. This is likely when polling near the sample period.
+ *  readFIFOPackets() and FIFOReader::read() skip the tail on their next read; other callers must
+ *  check that the next count is a whole number of packets.
+ * */
+esp_err_t MPU::readFIFOWithCount(size_t length, uint8_t* data, uint16_t* count)
+{
+    if (MPU_ERR_CHECK(readBytes(regs::FIFO_COUNT_H, length + 2, data))) return err;
+    *count = data[0] << 8 | data[1];
+    memmove(data, data + 2, length);
+    return err;
+}
+
+/**
+ * @brief Read the complete packets available in the FIFO, up to `maxPackets`.
+ *
+ * Count and first packet come in one burst (see readFIFOWithCount()), the remaining packets,
+ * if any, in a second one. When a single packet is ready on each call, as when
+ * reading on data-ready interrupt, this takes one bus transaction.
+ *
+ * @param packetSize Size of a FIFO packet in bytes, given by the FIFO configuration.
+ * @param maxPackets Maximum number of packets to read.
+ * @param data Buffer for packets, must have room for `maxPackets * packetSize + 2` bytes.
+ * @param packets Number of packets read.
+ * @return
+ *  - `ESP_ERR_INVALID_SIZE`: FIFO count is not a multiple of `packetSize` (overflow or misalignment),
+ *    reset the FIFO with resetFIFO().
+ *  - or other standard I2C / SPI driver error codes.
+ *
+ * @note After a read that went past the count (see readFIFOWithCount()), a count that is not a
+ *  multiple of `packetSize` is the tail of the packet that read took: it is skipped, that sample is
+ *  lost, and the packets after it are returned.
+ * */
+esp_err_t MPU::readFIFOPackets(size_t packetSize, size_t maxPackets, uint8_t* data, size_t* packets)
+{
+    *packets = 0;
+    if (packetSize == 0 || maxPackets == 0) {
+        MPU_LOGEMSG(msgs::INVALID_ARG, " packetSize: %zu, maxPackets: %zu", packetSize, maxPackets);
+        return err = ESP_ERR_INVALID_ARG;
+    }
+    uint16_t count = 0;
+    if (MPU_ERR_CHECK(readFIFOWithCount(packetSize, data, &count))) return err;
+    const size_t skip = count % packetSize;
+    if (skip && !fifoSpeculated) {
+        MPU_LOGWMSG(msgs::INVALID_LENGTH, ", FIFO count %d is not a multiple of packet size %zu", count, packetSize);
+        return err = ESP_ERR_INVALID_SIZE;
+    }
+    fifoSpeculated = count < packetSize;
+    size_t available = (count - skip) / packetSize;
+    if (available > maxPackets) available = maxPackets;
+    if (available == 0) return err;
+    // tail of the packet taken by the previous read, drop it and keep the start of the next one
+    size_t received = packetSize;
+    if (skip) {
+        MPU_LOGD("FIFO packet partly read with the count, %d bytes skipped", (int) skip);
+        received -= skip;
+        memmove(data, data + skip, received);
+    }
+    if (available * packetSize > received) {
+        if (MPU_ERR_CHECK(readFIFO(available * packetSize - received, data + received))) return err;
+    }
+    *packets = available;
+    return err;
+}
+
 /**
  * @brief Write data to FIFO buffer.
  * */
@@ -1484,7 +1720,7 @@ bool MPU::getAuxI2CBypass()
 esp_err_t MPU::readAuxI2CRxData(size_t length, uint8_t* data, size_t skip)
 {
     if (length + skip > 24) {
-        MPU_LOGEMSG(msgs::INVALID_LENGTH, " %d, mpu has only 24 external sensor data registers!", length);
+        MPU_LOGEMSG(msgs::INVALID_LENGTH, " %zu, mpu has only 24 external sensor data registers!", length);
         return err = ESP_ERR_INVALID_SIZE;
     }
 // check if I2C Master is enabled, just for warning and debug
@@ -1684,6 +1920,7 @@ bool MPU::getFsyncEnabled()
  * @brief Print out register values for debugging purposes.
  * @param start first register number.
  * @param end last register number.
+ * @note Values are always read from the chip, the register cache is bypassed.
  */
 esp_err_t MPU::registerDump(uint8_t start, uint8_t end)
 {
@@ -1692,7 +1929,7 @@ esp_err_t MPU::registerDump(uint8_t start, uint8_t end)
     printf(LOG_COLOR_W ">> " CONFIG_MPU_CHIP_MODEL " register dump:" LOG_RESET_COLOR "\n");
     uint8_t data;
     for (int i = start; i <= end; i++) {
-        if (MPU_ERR_CHECK(readByte(i, &data))) {
+        if (MPU_ERR_CHECK(err = bus->readByte(addr, i, &data))) {
             MPU_LOGEMSG("", "Reading Error.");
             return err;
         }
@@ -1701,6 +1938,399 @@ esp_err_t MPU::registerDump(uint8_t start, uint8_t end)
     return err;
 }
 
+/**
+ * @brief Return true if the register holds configuration that only changes when written by the host.
+ * Sensor data, status, FIFO, OTP and reset registers are never cached.
+ */
+static bool isCacheable(uint8_t regAddr)
+{
+    using namespace regs;
+    if (regAddr >= XG_OFFSET_H && regAddr <= I2C_SLV4_CTRL) return true;
+    if (regAddr == INT_PIN_CONFIG || regAddr == INT_ENABLE) return true;
+    if (regAddr >= I2C_SLV0_DO && regAddr <= I2C_MST_DELAY_CRTL) return true;
+    if (regAddr >= USER_CTRL && regAddr <= PWR_MGMT2) return true;
+#if defined CONFIG_MPU6050
+    if (regAddr == MOTION_DETECT_CTRL) return true;
+    if (regAddr >= XA_OFFSET_H && regAddr <= ZA_OFFSET_L) return true;
+#elif defined CONFIG_MPU6500
+    if (regAddr == ACCEL_INTEL_CTRL) return true;
+    if (regAddr >= XA_OFFSET_H && regAddr <= ZA_OFFSET_L) return true;
+#endif
+    return false;
+}
+
+/**
+ * @brief Return the bits of a cacheable register that clear by themselves after being set.
+ */
+static uint8_t selfClearingBits(uint8_t regAddr)
+{
+    using namespace regs;
+    switch (regAddr) {
+        case USER_CTRL:
+            return (1 << USERCTRL_DMP_RESET_BIT) | (1 << USERCTRL_FIFO_RESET_BIT) |
+                   (1 << USERCTRL_I2C_MST_RESET_BIT) | (1 << USERCTRL_SIG_COND_RESET_BIT);
+        case PWR_MGMT1:
+            return (1 << PWR1_DEVICE_RESET_BIT);
+        case I2C_SLV4_CTRL:
+            return (1 << I2C_SLV4_EN_BIT);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Return true if all registers in the range are cacheable and have a valid cached value.
+ */
+bool MPU::cacheHit(uint8_t regAddr, size_t length)
+{
+    if (regAddr + length > sizeof(regCache)) return false;
+    for (size_t i = regAddr; i < regAddr + length; i++) {
+        if (!(regCacheValid[i >> 5] & (1U << (i & 0x1F)))) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Update cached values with data just read from / written to the chip.
+ * @note A burst stops auto-incrementing at FIFO_R_W, following bytes are not register values.
+ */
+void MPU::cacheStore(uint8_t regAddr, size_t length, const uint8_t* data)
+{
+    for (size_t i = 0; i < length && regAddr + i < sizeof(regCache); i++) {
+        const uint8_t reg = regAddr + i;
+        if (reg == regs::FIFO_R_W) break;
+        if (!isCacheable(reg)) continue;
+        regCache[reg] = data[i] & ~selfClearingBits(reg);
+        regCacheValid[reg >> 5] |= (1U << (reg & 0x1F));
+    }
+}
+
+/**
+ * @brief Mark a range of registers as not cached.
+ */
+void MPU::cacheInvalidate(uint8_t regAddr, size_t length)
+{
+    for (size_t i = regAddr; i < regAddr + length && i < sizeof(regCache); i++) {
+        regCacheValid[i >> 5] &= ~(1U << (i & 0x1F));
+    }
+}
+
+/**
+ * @brief Read a range of bits, from the register cache if possible.
+ */
+esp_err_t MPU::cachedReadBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t* data)
+{
+    uint8_t value;
+    if (MPU_ERR_CHECK(cachedReadBytes(regAddr, 1, &value))) return err;
+    const uint8_t shift = bitStart - length + 1;
+    *data               = (value >> shift) & ((1 << length) - 1);
+    return err;
+}
+
+/**
+ * @brief Read a sequence of registers, from the register cache if all of them are cached.
+ */
+esp_err_t MPU::cachedReadBytes(uint8_t regAddr, size_t length, uint8_t* data)
+{
+    if (cacheHit(regAddr, length)) {
+        memcpy(data, regCache + regAddr, length);
+        return err = ESP_OK;
+    }
+    if (MPU_ERR_CHECK(err = bus->readBytes(addr, regAddr, length, data))) return err;
+    cacheStore(regAddr, length, data);
+    return err;
+}
+
+/**
+ * @brief Write a range of bits, with a single write if the register is cached.
+ */
+esp_err_t MPU::cachedWriteBits(uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data)
+{
+    if (!isCacheable(regAddr)) {
+        return err = bus->writeBits(addr, regAddr, bitStart, length, data);
+    }
+    uint8_t value;
+    if (MPU_ERR_CHECK(cachedReadBytes(regAddr, 1, &value))) return err;
+    const uint8_t shift = bitStart - length + 1;
+    const uint8_t mask  = ((1 << length) - 1) << shift;
+    value               = (value & ~mask) | ((data << shift) & mask);
+    return cachedWriteBytes(regAddr, 1, &value);
+}
+
+/**
+ * @brief Write a sequence of registers and update the register cache (write-through).
+ * @note A device reset (PWR_MGMT1) invalidates the whole cache.
+ */
+esp_err_t MPU::cachedWriteBytes(uint8_t regAddr, size_t length, const uint8_t* data)
+{
+    if (MPU_ERR_CHECK(err = bus->writeBytes(addr, regAddr, length, data))) {
+        cacheInvalidate(regAddr, length);
+        return err;
+    }
+    cacheStore(regAddr, length, data);
+    if (regAddr <= regs::PWR_MGMT1 && regAddr + length > regs::PWR_MGMT1 &&
+        (data[regs::PWR_MGMT1 - regAddr] & (1 << regs::PWR1_DEVICE_RESET_BIT))) {
+        invalidateRegisterCache();
+    }
+    return err;
+}
+
+/*! Register ranges of a configuration snapshot, in config_snapshot_t::data order */
+static constexpr struct
+{
+    uint8_t addr;
+    uint8_t length;
+} kSnapshotRanges[] = {
+    {regs::XG_OFFSET_H, 11},    // gyro offsets, sample rate, DLPF, full-scale ranges, self-test, ACCEL_CONFIG2
+    {regs::FIFO_EN, 5},         // FIFO sensors, Aux I2C master, Aux I2C slave 0
+#if defined CONFIG_MPU_AK89xx
+    {regs::I2C_SLV4_CTRL, 1},   // Aux I2C sample delay
+#endif
+    {regs::INT_PIN_CONFIG, 2},  // INT pin, interrupt sources
+    {regs::USER_CTRL, 3},       // FIFO and Aux I2C enable, clock source, sleep, standby
+};
+
+/**
+ * @brief Save the configuration registers into a snapshot, with one burst read per register range.
+ *
+ * The snapshot holds sample rate, DLPF / FCHOICE, full-scale ranges, self-test bits, gyro offsets,
+ * FIFO, interrupt, Aux I2C master and slave 0 configuration, and power management (clock source,
+ * sleep, standby). With the register cache enabled it is served without bus traffic.
+ * Save before changing the configuration for a while (calibration, self-test, low power mode)
+ * and put it back with restoreConfig().
+ */
+esp_err_t MPU::saveConfig(config_snapshot_t* snapshot)
+{
+    uint8_t* data = snapshot->data;
+    for (const auto& range : kSnapshotRanges) {
+        if (MPU_ERR_CHECK(readBytes(range.addr, range.length, data))) return err;
+        for (int i = 0; i < range.length; i++) data[i] &= ~selfClearingBits(range.addr + i);
+        data += range.length;
+    }
+    return err;
+}
+
+/**
+ * @brief Write back a snapshot taken by saveConfig(), with one burst write per register range.
+ * @note Ranges are written in address order: FIFO and interrupt sources are configured before
+ *  USER_CTRL enables them. The FIFO is not reset.
+ */
+esp_err_t MPU::restoreConfig(const config_snapshot_t& snapshot)
+{
+    const uint8_t* data = snapshot.data;
+    for (const auto& range : kSnapshotRanges) {
+        if (MPU_ERR_CHECK(writeBytes(range.addr, range.length, data))) return err;
+        data += range.length;
+    }
+    return err;
+}
+
+/**
+ * @brief Return the position of a register in config_snapshot_t::data, -1 if not in a snapshot.
+ */
+int MPU::snapshotIndex(uint8_t regAddr)
+{
+    int index = 0;
+    for (const auto& range : kSnapshotRanges) {
+        if (regAddr >= range.addr && regAddr < range.addr + range.length) return index + regAddr - range.addr;
+        index += range.length;
+    }
+    return -1;
+}
+
+/**
+ * @brief Lay a configuration profile over a snapshot: the registers it covers take the profile
+ * values, other bits are kept. Sample rate is constrained to 4Hz ~ 1KHz, as setSampleRate() does.
+ */
+static void layConfig(const mpu_config_t& config, config_snapshot_t* snapshot)
+{
+    auto setBits = [snapshot](uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t value) {
+        uint8_t& reg        = snapshot->data[MPU::snapshotIndex(regAddr)];
+        const uint8_t shift = bitStart - length + 1;
+        const uint8_t mask  = ((1 << length) - 1) << shift;
+        reg                 = (reg & ~mask) | ((value << shift) & mask);
+    };
+    // sample rate
+    uint16_t rate = config.sample_rate;
+    if (rate < 4 || rate > 1000) {
+        rate = rate < 4 ? 4 : 1000;
+        MPU_LOGWMSG(msgs::INVALID_SAMPLE_RATE, " %d, constrained to %d", config.sample_rate, rate);
+    }
+    constexpr uint16_t internalSampleRate = 1000;
+    setBits(regs::SMPLRT_DIV, 7, 8, internalSampleRate / rate - 1);
+    // filters, ranges, FIFO mode and size
+    setBits(regs::CONFIG, regs::CONFIG_DLPF_CFG_BIT, regs::CONFIG_DLPF_CFG_LENGTH, config.dlpf);
+    setBits(regs::CONFIG, regs::CONFIG_FIFO_MODE_BIT, 1, config.fifo_mode);
+    setBits(regs::GYRO_CONFIG, regs::GCONFIG_FS_SEL_BIT, regs::GCONFIG_FS_SEL_LENGTH, config.gyro_fs);
+    setBits(regs::ACCEL_CONFIG, regs::ACONFIG_FS_SEL_BIT, regs::ACONFIG_FS_SEL_LENGTH, config.accel_fs);
+#ifdef CONFIG_MPU6500
+    setBits(regs::ACCEL_CONFIG2, regs::ACONFIG2_A_DLPF_CFG_BIT, regs::ACONFIG2_A_DLPF_CFG_LENGTH, config.dlpf);
+    setBits(regs::ACCEL_CONFIG2, regs::ACONFIG2_FIFO_SIZE_BIT, regs::ACONFIG2_FIFO_SIZE_LENGTH, config.fifo_size);
+#endif
+    // FIFO sensors and interrupts
+    setBits(regs::FIFO_EN, 7, 8, (uint8_t) config.fifo_config);
+    setBits(regs::I2C_MST_CTRL, regs::I2CMST_CTRL_SLV_3_FIFO_EN_BIT, 1, config.fifo_config >> 8);
+    setBits(regs::INT_PIN_CONFIG, regs::INT_CFG_LEVEL_BIT, 1, config.int_config.level);
+    setBits(regs::INT_PIN_CONFIG, regs::INT_CFG_OPEN_BIT, 1, config.int_config.drive);
+    setBits(regs::INT_PIN_CONFIG, regs::INT_CFG_LATCH_EN_BIT, 1, config.int_config.mode);
+    setBits(regs::INT_PIN_CONFIG, regs::INT_CFG_ANYRD_2CLEAR_BIT, 1, config.int_config.clear);
+    setBits(regs::INT_ENABLE, 7, 8, config.int_enabled);
+    // FIFO enable, power management
+    setBits(regs::USER_CTRL, regs::USERCTRL_FIFO_EN_BIT, 1, config.fifo_enabled);
+    setBits(regs::PWR_MGMT1, regs::PWR1_SLEEP_BIT, 1, config.sleep);
+    setBits(regs::PWR_MGMT1, regs::PWR1_CLKSEL_BIT, regs::PWR1_CLKSEL_LENGTH, config.clock_src);
+    for (const auto& field : kStandbyFields) {
+        setBits(field.regAddr, field.bitStart, field.length, config.standby >> field.shift);
+    }
+}
+
+/**
+ * @brief Bring the device to a configuration profile, writing only the registers that differ.
+ *
+ * The current configuration is read with saveConfig() (or taken from the register cache), the
+ * profile is laid over it, and each register range with changes is written in a single burst,
+ * from its first to its last changed register. Bits the profile does not cover are kept.
+ * Switching between two profiles (e.g. logging / low power) costs a few transactions.
+ *
+ * @note
+ *  - Compass and Aux I2C Master are not part of the profile, see initialize().
+ *  - Sample rate is constrained to 4Hz ~ 1KHz, as setSampleRate() does.
+ * */
+esp_err_t MPU::applyConfig(const mpu_config_t& config)
+{
+    bool rateChanged;
+    if (MPU_ERR_CHECK(writeConfig(config, &rateChanged))) return err;
+#ifdef CONFIG_MPU_AK89xx
+    if (rateChanged && MPU_ERR_CHECK(setCompassSampleRate(getSampleRate()))) return err;
+#endif
+    return err;
+}
+
+/**
+ * @brief Write the registers of a profile that differ from the device, see applyConfig().
+ * @param rateChanged Set to whether SMPLRT_DIV was written, for the caller to follow with the
+ *  compass sample rate; may be null.
+ * */
+esp_err_t MPU::writeConfig(const mpu_config_t& config, bool* rateChanged)
+{
+    config_snapshot_t current, target;
+    if (MPU_ERR_CHECK(saveConfig(&current))) return err;
+    target = current;
+    layConfig(config, &target);
+    // write the changes, one burst per range
+    int index = 0;
+    for (const auto& range : kSnapshotRanges) {
+        int first = -1, last = -1;
+        for (int i = 0; i < range.length; i++) {
+            if (target.data[index + i] == current.data[index + i]) continue;
+            if (first < 0) first = i;
+            last = i;
+        }
+        if (first >= 0 &&
+            MPU_ERR_CHECK(writeBytes(range.addr + first, last - first + 1, target.data + index + first))) {
+            return err;
+        }
+        index += range.length;
+    }
+    if (rateChanged) {
+        const int divIndex = snapshotIndex(regs::SMPLRT_DIV);
+        *rateChanged       = target.data[divIndex] != current.data[divIndex];
+    }
+    return err;
+}
+
+/**
+ * @brief Start from the configuration the device kept, when it matches, instead of initialize().
+ *
+ * After a host-only restart (soft reboot, OTA update, deep sleep) the IMU keeps power and its
+ * registers. The configuration is read back and compared with `config`:
+ *  - same: device reset is skipped and offsets applied before the restart are kept;
+ *  - different (power cycle, other profile): full initialize(config).
+ *
+ * The read back is one burst per register range: the snapshot ranges (see saveConfig()), widened
+ * to all Aux I2C Slaves, and with the FIFO enabled INT_STATUS and the FIFO count; 4 to 6 bus
+ * transactions in all. When kept, the FIFO content is kept for the application to read (samples
+ * taken during the restart) if it did not overflow and holds whole packets, otherwise the FIFO is
+ * reset. The compass is checked as compassSetupKept() does and set up again with compassSetup()
+ * if needed.
+ *
+ * @param config Profile expected / to set.
+ * @param warm Set to true when the device configuration was kept, false when initialized.
+ * @note
+ *  - The register cache is invalidated first, the readback fills it.
+ *  - With the FIFO enabled, INT_STATUS is read, which clears the interrupt status.
+ * */
+esp_err_t MPU::warmStart(const mpu_config_t& config, bool* warm)
+{
+    if (warm) *warm = false;
+    invalidateRegisterCache();
+    // register values by address, each range covers a range of kSnapshotRanges or more
+    const uint8_t fifoLength = config.fifo_enabled ? 2 : 0;
+    const struct
+    {
+        uint8_t addr;
+        uint8_t length;
+    } kSignatureRanges[] = {
+        {regs::XG_OFFSET_H, 11},                                   // as the snapshot
+        {regs::FIFO_EN, regs::I2C_SLV4_CTRL - regs::FIFO_EN + 1},  // FIFO sensors, Aux I2C master, Slaves 0-4
+        {regs::INT_PIN_CONFIG, (uint8_t)(2 + fifoLength)},         // INT pin, interrupt sources, INT_STATUS
+#if defined CONFIG_MPU_AK89xx
+        {regs::I2C_SLV0_DO, 2},                                    // compass mode written by Slave 1
+#endif
+        {regs::USER_CTRL, 3},                                      // as the snapshot
+        {regs::FIFO_COUNT_H, fifoLength},                          // FIFO count
+    };
+    uint8_t image[regs::FIFO_R_W] = {0};
+    for (const auto& range : kSignatureRanges) {
+        if (range.length == 0) continue;
+        if (MPU_ERR_CHECK(readBytes(range.addr, range.length, image + range.addr))) return err;
+    }
+    config_snapshot_t current, target;
+    uint8_t* data = current.data;
+    for (const auto& range : kSnapshotRanges) {
+        for (int i = 0; i < range.length; i++) data[i] = image[range.addr + i] & ~selfClearingBits(range.addr + i);
+        data += range.length;
+    }
+    target = current;
+    layConfig(config, &target);
+    bool match = memcmp(current.data, target.data, sizeof(current.data)) == 0;
+#ifdef CONFIG_MPU_SPI
+    // MPU's I2C slave module disabled
+    match &= (image[regs::USER_CTRL] >> regs::USERCTRL_I2C_IF_DIS_BIT) & 0x1;
+#endif
+    if (!match) {
+        MPU_LOGI("Configuration not kept, full initialization");
+        return initialize(config);
+    }
+#ifdef CONFIG_MPU_AK89xx
+    if (!compassSetupKept(image)) {
+        MPU_LOGI("Compass setup not kept, set up again");
+        if (MPU_ERR_CHECK(compassSetup())) return err;
+    }
+#endif
+    if (config.fifo_enabled) {
+        // packet size of the profile, Aux I2C Slaves read length as configured
+        uint8_t slaveLength[4] = {0};
+        for (int i = 0; i < 4; i++) {
+            const uint8_t slaveAddr = image[regs::I2C_SLV0_ADDR + 3 * i];
+            const uint8_t slaveCtrl = image[regs::I2C_SLV0_CTRL + 3 * i];
+            const bool read         = (slaveAddr >> regs::I2C_SLV_RNW_BIT) & 0x1;
+            const bool enabled      = (slaveCtrl >> regs::I2C_SLV_EN_BIT) & 0x1;
+            if (enabled && read) slaveLength[i] = slaveCtrl & ((1 << regs::I2C_SLV_LEN_LENGTH) - 1);
+        }
+        const uint8_t packetSize = fifoLayout(config.fifo_config, slaveLength).packet_size;
+        const bool overflow      = (image[regs::INT_STATUS] >> regs::INT_STATUS_FIFO_OFLOW_BIT) & 0x1;
+        const uint16_t count     = image[regs::FIFO_COUNT_H] << 8 | image[regs::FIFO_COUNT_L];
+        if (overflow || packetSize == 0 || count % packetSize) {
+            MPU_LOGI("FIFO overflowed or misaligned (count %d), reset", count);
+            if (MPU_ERR_CHECK(resetFIFO())) return err;
+        }
+    }
+    if (warm) *warm = true;
+    MPU_LOGI("Warm start, configuration kept");
+    return err;
+}
+
 #if defined CONFIG_MPU_AK89xx
 /**
  * @brief Read a single byte from magnetometer.
@@ -1807,6 +2437,49 @@ esp_err_t MPU::compassInit()
     return err;
 }
 
+/**
+ * @brief Set up the compass as initialize() does: compassInit(), 16-bit output on AK8963, and
+ * Aux I2C Master timing for the current sample rate.
+ * */
+esp_err_t MPU::compassSetup()
+{
+    if (MPU_ERR_CHECK(compassInit())) return err;
+#ifdef CONFIG_MPU_AK8963
+    if (MPU_ERR_CHECK(compassSetSensitivity(MAG_SENSITIVITY_0_15_uT))) return err;
+#endif
+    // compass sample rate follows the sample rate
+    return MPU_ERR_CHECK(setCompassSampleRate(getSampleRate()));
+}
+
+/**
+ * @brief Tell whether the compass is still in the state compassSetup() leaves it, from the Aux I2C
+ * registers read by warmStart() (`image`, register values by address), without bus traffic.
+ *
+ * Slave 0 must read the data from ST1, Slave 1 must write the single measurement mode to CNTL1
+ * (with 16-bit output on AK8963). compassSetMode() and compassSetSensitivity() keep the Slave 1
+ * data register in step with CNTL1, and Slave 1 writes it to CNTL1 at each sample while the Aux
+ * I2C master runs, so it stands for the CNTL1 mode and output bit: no compass read over Aux I2C.
+ * */
+bool MPU::compassSetupKept(const uint8_t* image)
+{
+    using namespace regs;
+#if defined CONFIG_MPU_AK8963
+    constexpr uint8_t kControl1Value =
+        MAG_MODE_SINGLE_MEASURE | (MAG_SENSITIVITY_0_15_uT << mag::CONTROL1_BIT_OUTPUT_BIT);
+#else
+    constexpr uint8_t kControl1Value = MAG_MODE_SINGLE_MEASURE;
+#endif
+    constexpr uint8_t kRead    = 1 << I2C_SLV_RNW_BIT;
+    constexpr uint8_t kEnabled = 1 << I2C_SLV_EN_BIT;
+    const uint8_t* readData    = image + I2C_SLV0_ADDR + 3 * MAG_SLAVE_READ_DATA;
+    const uint8_t* chgMode     = image + I2C_SLV0_ADDR + 3 * MAG_SLAVE_CHG_MODE;
+    const bool readDataKept    = readData[0] == (kRead | COMPASS_I2CADDRESS) && readData[1] == mag::STATUS1 &&
+                              (readData[2] & kEnabled);
+    const bool chgModeKept = chgMode[0] == COMPASS_I2CADDRESS && chgMode[1] == mag::CONTROL1 &&
+                             (chgMode[2] & kEnabled) && image[I2C_SLV0_DO + MAG_SLAVE_CHG_MODE] == kControl1Value;
+    return readDataKept && chgModeKept;
+}
+
 /**
  * @brief Test connection with Magnetometer by checking WHO_I_AM register.
  * */
@@ -1993,9 +2666,9 @@ bool MPU::compassSelfTest(raw_axes_t* result)
     // convert data
     raw_axes_t data;
     if (result == nullptr) result = &data;
-    result->x = math::magAdjust(buffer[1] << 8 | buffer[0], adjValue[0]);
-    result->y = math::magAdjust(buffer[3] << 8 | buffer[2], adjValue[1]);
-    result->z = math::magAdjust(buffer[5] << 8 | buffer[4], adjValue[2]);
+    result->x = math::units::magAdjust(buffer[1] << 8 | buffer[0], adjValue[0]);
+    result->y = math::units::magAdjust(buffer[3] << 8 | buffer[2], adjValue[1]);
+    result->z = math::units::magAdjust(buffer[5] << 8 | buffer[4], adjValue[2]);
     MPU_LOGD("raw self-test values: %+d %+d %+d", buffer[1] << 8 | buffer[0], buffer[3] << 8 | buffer[2],
              buffer[5] << 8 | buffer[4]);
 // check self-test data
@@ -2085,33 +2758,16 @@ esp_err_t MPU::compassReset()
 /**
  * @brief Trigger gyro and accel hardware self-test.
  * @attention when calling this function, the MPU must remain as horizontal as possible (0 degrees), facing up.
+ * Blocks for about ~200ms; see Calibrator for a non-blocking version.
  * @param result Should be ZERO if gyro and accel passed.
  * @todo Elaborate doc.
  * */
 esp_err_t MPU::selfTest(selftest_t* result)
 {
-#ifdef CONFIG_MPU6050
-    constexpr accel_fs_t kAccelFS = ACCEL_FS_16G;
-    constexpr gyro_fs_t kGyroFS   = GYRO_FS_250DPS;
-#elif CONFIG_MPU6500
-    constexpr accel_fs_t kAccelFS = ACCEL_FS_2G;
-    constexpr gyro_fs_t kGyroFS   = GYRO_FS_250DPS;
-#endif
-    raw_axes_t gyroRegBias, accelRegBias;
-    raw_axes_t gyroSTBias, accelSTBias;
-    // get regular biases
-    if (MPU_ERR_CHECK(getBiases(kAccelFS, kGyroFS, &accelRegBias, &gyroRegBias, false))) return err;
-    // get self-test biases
-    if (MPU_ERR_CHECK(getBiases(kAccelFS, kGyroFS, &accelSTBias, &gyroSTBias, true))) return err;
-    // perform self-tests
-    uint8_t accelST, gyroST;
-    if (MPU_ERR_CHECK(accelSelfTest(accelRegBias, accelSTBias, &accelST))) return err;
-    if (MPU_ERR_CHECK(gyroSelfTest(gyroRegBias, gyroSTBias, &gyroST))) return err;
-    // check results
-    *result = 0;
-    if (accelST != 0) *result |= SELF_TEST_ACCEL_FAIL;
-    if (gyroST != 0) *result |= SELF_TEST_GYRO_FAIL;
-    return err;
+    Calibrator calibrator(*this);
+    if (MPU_ERR_CHECK(err = calibrator.startSelfTest())) return err;
+    if (MPU_ERR_CHECK(err = calibrator.run())) return err;
+    return err = calibrator.getSelfTest(result);
 }
 
 #if defined CONFIG_MPU6500
@@ -2333,100 +2989,4 @@ esp_err_t MPU::gyroSelfTest(raw_axes_t& regularBias, raw_axes_t& selfTestBias, u
     return err;
 }
 
-/**
- * @brief Compute the Biases in regular mode and self-test mode.
- * @attention When calculating the biases the MPU must remain as horizontal as possible (0 degrees), facing up.
- * This algorithm takes about ~400ms to compute offsets.
- * */
-esp_err_t MPU::getBiases(accel_fs_t accelFS, gyro_fs_t gyroFS, raw_axes_t* accelBias, raw_axes_t* gyroBias,
-                         bool selftest)
-{
-    // configurations to compute biases
-    constexpr uint16_t kSampleRate      = 1000;
-    constexpr dlpf_t kDLPF              = DLPF_188HZ;
-    constexpr fifo_config_t kFIFOConfig = FIFO_CFG_ACCEL | FIFO_CFG_GYRO;
-    constexpr size_t kPacketSize        = 12;
-    // backup previous configuration
-    const uint16_t prevSampleRate      = getSampleRate();
-    const dlpf_t prevDLPF              = getDigitalLowPassFilter();
-    const accel_fs_t prevAccelFS       = getAccelFullScale();
-    const gyro_fs_t prevGyroFS         = getGyroFullScale();
-    const fifo_config_t prevFIFOConfig = getFIFOConfig();
-    const bool prevFIFOState           = getFIFOEnabled();
-    // setup
-    if (MPU_ERR_CHECK(setSampleRate(kSampleRate))) return err;
-    if (MPU_ERR_CHECK(setDigitalLowPassFilter(kDLPF))) return err;
-    if (MPU_ERR_CHECK(setAccelFullScale(accelFS))) return err;
-    if (MPU_ERR_CHECK(setGyroFullScale(gyroFS))) return err;
-    if (MPU_ERR_CHECK(setFIFOConfig(kFIFOConfig))) return err;
-    if (MPU_ERR_CHECK(setFIFOEnabled(true))) return err;
-    if (selftest) {
-        if (MPU_ERR_CHECK(writeBits(regs::ACCEL_CONFIG, regs::ACONFIG_XA_ST_BIT, 3, 0x7))) {
-            return err;
-        }
-        if (MPU_ERR_CHECK(writeBits(regs::GYRO_CONFIG, regs::GCONFIG_XG_ST_BIT, 3, 0x7))) {
-            return err;
-        }
-    }
-    // wait for 200ms for sensors to stabilize
-    vTaskDelay(200 / portTICK_PERIOD_MS);
-    // fill FIFO for 100ms
-    if (MPU_ERR_CHECK(resetFIFO())) return err;
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    if (MPU_ERR_CHECK(setFIFOConfig(FIFO_CFG_NONE))) return err;
-    // get FIFO count
-    const uint16_t fifoCount = getFIFOCount();
-    if (MPU_ERR_CHECK(lastError())) return err;
-    const int packetCount = fifoCount / kPacketSize;
-    // read overrun bytes, if any
-    const int overrunCount      = fifoCount - (packetCount * kPacketSize);
-    uint8_t buffer[kPacketSize] = {0};
-    if (overrunCount > 0) {
-        if (MPU_ERR_CHECK(readFIFO(overrunCount, buffer))) return err;
-    }
-    // fetch data and add up
-    axes_t<int> accelAvg, gyroAvg;
-    for (int i = 0; i < packetCount; i++) {
-        if (MPU_ERR_CHECK(readFIFO(kPacketSize, buffer))) return err;
-        // retrieve data
-        raw_axes_t accelCur, gyroCur;
-        accelCur.x = (buffer[0] << 8) | buffer[1];
-        accelCur.y = (buffer[2] << 8) | buffer[3];
-        accelCur.z = (buffer[4] << 8) | buffer[5];
-        gyroCur.x  = (buffer[6] << 8) | buffer[7];
-        gyroCur.y  = (buffer[8] << 8) | buffer[9];
-        gyroCur.z  = (buffer[10] << 8) | buffer[11];
-        // add up
-        accelAvg.x += accelCur.x;
-        accelAvg.y += accelCur.y;
-        accelAvg.z += accelCur.z;
-        gyroAvg.x += gyroCur.x;
-        gyroAvg.y += gyroCur.y;
-        gyroAvg.z += gyroCur.z;
-    }
-    // calculate average
-    accelAvg.x /= packetCount;
-    accelAvg.y /= packetCount;
-    accelAvg.z /= packetCount;
-    gyroAvg.x /= packetCount;
-    gyroAvg.y /= packetCount;
-    gyroAvg.z /= packetCount;
-    // remove gravity from Accel Z axis
-    const uint16_t gravityLSB = INT16_MAX >> (accelFS + 1);
-    accelAvg.z -= gravityLSB;
-    // save biases
-    for (int i = 0; i < 3; i++) {
-        (*accelBias)[i] = (int16_t) accelAvg[i];
-        (*gyroBias)[i]  = (int16_t) gyroAvg[i];
-    }
-    // set back previous configs
-    if (MPU_ERR_CHECK(setSampleRate(prevSampleRate))) return err;
-    if (MPU_ERR_CHECK(setDigitalLowPassFilter(prevDLPF))) return err;
-    if (MPU_ERR_CHECK(setAccelFullScale(prevAccelFS))) return err;
-    if (MPU_ERR_CHECK(setGyroFullScale(prevGyroFS))) return err;
-    if (MPU_ERR_CHECK(setFIFOConfig(prevFIFOConfig))) return err;
-    if (MPU_ERR_CHECK(setFIFOEnabled(prevFIFOState))) return err;
-    return err;
-}
-
 }  // namespace mpud
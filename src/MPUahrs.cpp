@@ -0,0 +1,382 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUahrs.cpp
+ * Implement AHRS class.
+ *
+ * Filters after S. Madgwick, "An efficient orientation filter for inertial and inertial/magnetic
+ * sensor arrays" (2010) and R. Mahony et al., "Nonlinear Complementary Filters on the Special
+ * Orthogonal Group" (2008).
+ */
+
+#include "mpu/ahrs.hpp"
+#include <math.h>
+#include "mpu/math.hpp"
+#include "mpu/types.hpp"
+#include "mpu/vector.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/**
+ * @brief Construct a filter at rest, the first sample aligns it.
+ */
+AHRS::AHRS(ahrs_filter_t filter)
+    : filter{filter},
+      q{1, 0, 0, 0},
+      beta{kDefaultBeta},
+      kp{kDefaultKp},
+      ki{kDefaultKi},
+      integral(),
+      lastTimestamp{0},
+      aligned{false}
+{
+}
+
+/**
+ * @brief Forget the orientation, the next sample aligns the filter again.
+ */
+void AHRS::reset()
+{
+    q             = {1, 0, 0, 0};
+    integral      = float_axes_t();
+    lastTimestamp = 0;
+    aligned       = false;
+}
+
+/**
+ * @brief Start from a known orientation, e.g. restored from a previous run.
+ */
+void AHRS::reset(const quat_t& orientation)
+{
+    reset();
+    q       = orientation;
+    aligned = true;
+}
+
+AHRS& AHRS::setFilter(ahrs_filter_t filter)
+{
+    this->filter = filter;
+    return *this;
+}
+
+/**
+ * @brief Set the Madgwick gain.
+ * Higher converges faster and follows the accelerometer (and its vibration) more; about the
+ * gyro noise [rad/s] is a good start, 0.1 by default.
+ */
+AHRS& AHRS::setBeta(float beta)
+{
+    this->beta = beta;
+    return *this;
+}
+
+/**
+ * @brief Set the Mahony gains.
+ * @param kp Proportional gain, 1 by default.
+ * @param ki Integral gain, 0 by default (off). With `ki > 0` the filter estimates the gyro bias.
+ */
+AHRS& AHRS::setGains(float kp, float ki)
+{
+    this->kp = kp;
+    this->ki = ki;
+    return *this;
+}
+
+ahrs_filter_t AHRS::getFilter()
+{
+    return filter;
+}
+
+/*! Return the orientation, sensor frame relative to earth frame. */
+const quat_t& AHRS::getQuaternion()
+{
+    return q;
+}
+
+/**
+ * @brief Return the orientation as Euler angles [º], aerospace sequence (yaw, pitch, roll).
+ * Range: roll [-180,180], pitch [-90,90], yaw [-180,180].
+ */
+float_axes_t AHRS::getEuler()
+{
+    return toEuler(q) * kRadToDeg;
+}
+
+/**
+ * @brief Return the gyro bias [rad/s] estimated by the Mahony integral feedback, zero otherwise.
+ */
+float_axes_t AHRS::getGyroBias()
+{
+    float_axes_t bias;
+    for (int i = 0; i < 3; i++) bias[i] = -integral[i];
+    return bias;
+}
+
+/**
+ * @brief Filter one 6-axis sample.
+ * @param gyro Angular rate [rad/s].
+ * @param accel Acceleration, any unit (normalized).
+ * @param dt Time since the previous sample [s].
+ */
+void AHRS::update(const float_axes_t& gyro, const float_axes_t& accel, float dt)
+{
+    if (!aligned) align(accel, nullptr);
+    if (filter == AHRS_MAHONY)
+        mahony(gyro.x, gyro.y, gyro.z, accel.x, accel.y, accel.z, dt);
+    else
+        madgwick(gyro.x, gyro.y, gyro.z, accel.x, accel.y, accel.z, dt);
+}
+
+/**
+ * @brief Filter one 9-axis sample.
+ * @param mag Magnetic field in the accel/gyro frame, any unit (normalized). A zero field
+ *  (no compass data) falls back to the 6-axis update.
+ */
+void AHRS::update(const float_axes_t& gyro, const float_axes_t& accel, const float_axes_t& mag, float dt)
+{
+    if (mag.x == 0.f && mag.y == 0.f && mag.z == 0.f) return update(gyro, accel, dt);
+    if (!aligned) align(accel, &mag);
+    if (filter == AHRS_MAHONY)
+        mahony(gyro.x, gyro.y, gyro.z, accel.x, accel.y, accel.z, mag.x, mag.y, mag.z, dt);
+    else
+        madgwick(gyro.x, gyro.y, gyro.z, accel.x, accel.y, accel.z, mag.x, mag.y, mag.z, dt);
+}
+
+/**
+ * @brief Filter a batch of FIFO samples, stepping by the sample timestamps.
+ * @param scale Conversion factors of the full-scale configuration the samples were taken with.
+ * @param useMag Use the magnetometer (9-axis), if the FIFO holds compass data.
+ */
+void AHRS::update(const fifo_sample_t* samples, size_t count, const math::scale_t& scale, bool useMag)
+{
+    for (size_t i = 0; i < count; i++) {
+        const fifo_sample_t& sample = samples[i];
+        const float dt              = step(sample.timestamp);
+        float_axes_t gyro, accel;
+        gyro.x  = sample.gyro.x * scale.gyro_rps;
+        gyro.y  = sample.gyro.y * scale.gyro_rps;
+        gyro.z  = sample.gyro.z * scale.gyro_rps;
+        accel.x = sample.accel.x * scale.accel;
+        accel.y = sample.accel.y * scale.accel;
+        accel.z = sample.accel.z * scale.accel;
+#if defined CONFIG_MPU_AK89xx
+        if (useMag) {
+            update(gyro, accel, math::magToGyroFrame(sample.mag.x, sample.mag.y, sample.mag.z), dt);
+            continue;
+        }
+#endif
+        update(gyro, accel, dt);
+    }
+}
+
+/**
+ * @brief Return the time [s] from the previous batch sample, up to kMaxStep; 0 for the first one.
+ */
+float AHRS::step(int64_t timestamp)
+{
+    const int64_t previous = lastTimestamp;
+    lastTimestamp          = timestamp;
+    if (previous == 0 || timestamp <= previous) return 0;
+    const float dt = (timestamp - previous) * 1e-6f;
+    return dt < kMaxStep ? dt : kMaxStep;
+}
+
+/**
+ * @brief Set the orientation from gravity (roll, pitch) and the tilt-compensated field (yaw).
+ */
+void AHRS::align(const float_axes_t& accel, const float_axes_t* mag)
+{
+    if (accel.x == 0.f && accel.y == 0.f && accel.z == 0.f) return;
+    q       = fromGravity(accel, mag);
+    aligned = true;
+}
+
+/*! Madgwick 6-axis: gyro rate plus a gradient descent step towards gravity */
+void AHRS::madgwick(float gx, float gy, float gz, float ax, float ay, float az, float dt)
+{
+    float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+    // rate of change of quaternion from gyroscope
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+    if (!(ax == 0.f && ay == 0.f && az == 0.f)) {
+        float recipNorm = fastInvSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+        const float _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+        const float _4q0 = 4 * q0, _4q1 = 4 * q1, _4q2 = 4 * q2;
+        const float _8q1 = 8 * q1, _8q2 = 8 * q2;
+        const float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+        // gradient of the objective function
+        float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        float s1 = _4q1 * q3q3 - _2q3 * ax + 4 * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        float s2 = 4 * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        float s3 = 4 * q1q1 * q3 - _2q1 * ax + 4 * q2q2 * q3 - _2q2 * ay;
+        const float norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (norm > 0.f) {
+            recipNorm = beta * fastInvSqrt(norm);
+            qDot0 -= s0 * recipNorm;
+            qDot1 -= s1 * recipNorm;
+            qDot2 -= s2 * recipNorm;
+            qDot3 -= s3 * recipNorm;
+        }
+    }
+    q0 += qDot0 * dt;
+    q1 += qDot1 * dt;
+    q2 += qDot2 * dt;
+    q3 += qDot3 * dt;
+    q = normalize(quat_t{q0, q1, q2, q3});
+}
+
+/*! Madgwick 9-axis: gradient descent towards gravity and the earth magnetic field */
+void AHRS::madgwick(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz,
+                    float dt)
+{
+    float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+    if (!(ax == 0.f && ay == 0.f && az == 0.f)) {
+        float recipNorm = fastInvSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+        recipNorm = fastInvSqrt(mx * mx + my * my + mz * mz);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+        const float _2q0mx = 2 * q0 * mx, _2q0my = 2 * q0 * my, _2q0mz = 2 * q0 * mz, _2q1mx = 2 * q1 * mx;
+        const float _2q0 = 2 * q0, _2q1 = 2 * q1, _2q2 = 2 * q2, _2q3 = 2 * q3;
+        const float _2q0q2 = 2 * q0 * q2, _2q2q3 = 2 * q2 * q3;
+        const float q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+        const float q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+        const float q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+        // reference direction of the earth magnetic field
+        const float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 -
+                         mx * q2q2 - mx * q3q3;
+        const float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 +
+                         _2q2 * mz * q3 - my * q3q3;
+        const float _2bx = sqrtf(hx * hx + hy * hy);
+        const float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 -
+                           mz * q2q2 + mz * q3q3;
+        const float _4bx = 2 * _2bx, _4bz = 2 * _2bz;
+        // objective function terms: gravity (fx, fy, fz) and field (bx, by, bz) errors
+        const float fx = 2 * q1q3 - _2q0q2 - ax;
+        const float fy = 2 * q0q1 + _2q2q3 - ay;
+        const float fz = 1 - 2 * q1q1 - 2 * q2q2 - az;
+        const float bx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        const float by = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        const float bz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+        float s0 = -_2q2 * fx + _2q1 * fy - _2bz * q2 * bx + (-_2bx * q3 + _2bz * q1) * by + _2bx * q2 * bz;
+        float s1 = _2q3 * fx + _2q0 * fy - 4 * q1 * fz + _2bz * q3 * bx + (_2bx * q2 + _2bz * q0) * by +
+                   (_2bx * q3 - _4bz * q1) * bz;
+        float s2 = -_2q0 * fx + _2q3 * fy - 4 * q2 * fz + (-_4bx * q2 - _2bz * q0) * bx +
+                   (_2bx * q1 + _2bz * q3) * by + (_2bx * q0 - _4bz * q2) * bz;
+        float s3 = _2q1 * fx + _2q2 * fy + (-_4bx * q3 + _2bz * q1) * bx + (-_2bx * q0 + _2bz * q2) * by +
+                   _2bx * q1 * bz;
+        const float norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if (norm > 0.f) {
+            recipNorm = beta * fastInvSqrt(norm);
+            qDot0 -= s0 * recipNorm;
+            qDot1 -= s1 * recipNorm;
+            qDot2 -= s2 * recipNorm;
+            qDot3 -= s3 * recipNorm;
+        }
+    }
+    q0 += qDot0 * dt;
+    q1 += qDot1 * dt;
+    q2 += qDot2 * dt;
+    q3 += qDot3 * dt;
+    q = normalize(quat_t{q0, q1, q2, q3});
+}
+
+/*! Mahony 6-axis: gyro rate corrected by PI feedback of the cross product with gravity */
+void AHRS::mahony(float gx, float gy, float gz, float ax, float ay, float az, float dt)
+{
+    if (!(ax == 0.f && ay == 0.f && az == 0.f)) {
+        const float recipNorm = fastInvSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+        // error between estimated and measured direction of gravity, half
+        const float_axes_t halfe = cross(float_axes_t(ax, ay, az), gravity(q)) * 0.5f;
+        const float halfex = halfe.x, halfey = halfe.y, halfez = halfe.z;
+        if (ki > 0.f) {
+            integral.x += 2 * ki * halfex * dt;
+            integral.y += 2 * ki * halfey * dt;
+            integral.z += 2 * ki * halfez * dt;
+        }
+        gx += 2 * kp * halfex;
+        gy += 2 * kp * halfey;
+        gz += 2 * kp * halfez;
+    }
+    integrate(gx + integral.x, gy + integral.y, gz + integral.z, dt);
+}
+
+/*! Mahony 9-axis: PI feedback of the gravity and magnetic field errors */
+void AHRS::mahony(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz,
+                  float dt)
+{
+    if (!(ax == 0.f && ay == 0.f && az == 0.f)) {
+        float recipNorm = fastInvSqrt(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+        recipNorm = fastInvSqrt(mx * mx + my * my + mz * mz);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+        const float q0q0 = q.w * q.w, q0q1 = q.w * q.x, q0q2 = q.w * q.y, q0q3 = q.w * q.z;
+        const float q1q1 = q.x * q.x, q1q2 = q.x * q.y, q1q3 = q.x * q.z;
+        const float q2q2 = q.y * q.y, q2q3 = q.y * q.z, q3q3 = q.z * q.z;
+        // reference direction of the earth magnetic field
+        const float hx = 2 * (mx * (0.5f - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+        const float hy = 2 * (mx * (q1q2 + q0q3) + my * (0.5f - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+        const float bx = sqrtf(hx * hx + hy * hy);
+        const float bz = 2 * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (0.5f - q1q1 - q2q2));
+        // estimated direction of gravity and magnetic field, half
+        const float halfvx = q1q3 - q0q2;
+        const float halfvy = q0q1 + q2q3;
+        const float halfvz = q0q0 - 0.5f + q3q3;
+        const float halfwx = bx * (0.5f - q2q2 - q3q3) + bz * (q1q3 - q0q2);
+        const float halfwy = bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3);
+        const float halfwz = bx * (q0q2 + q1q3) + bz * (0.5f - q1q1 - q2q2);
+        // error, sum of cross products between estimated and measured directions, half
+        const float halfex = (ay * halfvz - az * halfvy) + (my * halfwz - mz * halfwy);
+        const float halfey = (az * halfvx - ax * halfvz) + (mz * halfwx - mx * halfwz);
+        const float halfez = (ax * halfvy - ay * halfvx) + (mx * halfwy - my * halfwx);
+        if (ki > 0.f) {
+            integral.x += 2 * ki * halfex * dt;
+            integral.y += 2 * ki * halfey * dt;
+            integral.z += 2 * ki * halfez * dt;
+        }
+        gx += 2 * kp * halfex;
+        gy += 2 * kp * halfey;
+        gz += 2 * kp * halfez;
+    }
+    integrate(gx + integral.x, gy + integral.y, gz + integral.z, dt);
+}
+
+/*! Integrate the rate of change of quaternion and normalize */
+void AHRS::integrate(float gx, float gy, float gz, float dt)
+{
+    gx *= 0.5f * dt;
+    gy *= 0.5f * dt;
+    gz *= 0.5f * dt;
+    const float q0 = q.w + (-q.x * gx - q.y * gy - q.z * gz);
+    const float q1 = q.x + (q.w * gx + q.y * gz - q.z * gy);
+    const float q2 = q.y + (q.w * gy - q.x * gz + q.z * gx);
+    const float q3 = q.z + (q.w * gz + q.x * gy - q.y * gx);
+    q = normalize(quat_t{q0, q1, q2, q3});
+}
+
+}  // namespace mpud
@@ -0,0 +1,235 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUbias.cpp
+ * Implement GyroBiasTracker class.
+ */
+
+#include "mpu/bias.hpp"
+#include <math.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "mpu/math.hpp"
+#include "mpu/types.hpp"
+#include "mpu/vector.hpp"
+#include "sdkconfig.h"
+
+static const char* TAG = CONFIG_MPU_CHIP_MODEL;
+
+#include "mpu/log.hpp"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/**
+ * @brief Construct a tracker for samples in the given full-scale ranges, with no bias learned.
+ */
+GyroBiasTracker::GyroBiasTracker(accel_fs_t accelFS, gyro_fs_t gyroFS)
+    : accelFS{accelFS}, gyroFS{gyroFS}, window{kDefaultWindow}, minGain{kDefaultMinGain}
+{
+    setThresholds(kDefaultGyroStd, kDefaultAccelStd);
+    reset();
+}
+
+/**
+ * @brief Forget the bias and the current window.
+ */
+void GyroBiasTracker::reset()
+{
+    bias         = float_axes_t();
+    stillWindows = 0;
+    still        = false;
+    prevValid    = false;
+    zeroMotion   = true;
+    skipUntil    = INT64_MIN;
+    clearWindow();
+}
+
+/**
+ * @brief Change the full-scale ranges of the samples, the bias is rescaled. Call when the MPU is reconfigured.
+ */
+GyroBiasTracker& GyroBiasTracker::setFullScale(accel_fs_t accelFS, gyro_fs_t gyroFS)
+{
+    const float gyroStd  = sqrtf(gyroVarMax) / math::gyroSensitivity(this->gyroFS);
+    const float accelStd = accelStdMax / math::accelSensitivity(this->accelFS);
+    bias                 = bias * (math::gyroSensitivity(gyroFS) / math::gyroSensitivity(this->gyroFS));
+    this->accelFS        = accelFS;
+    this->gyroFS         = gyroFS;
+    setThresholds(gyroStd, accelStd);
+    prevValid = false;
+    clearWindow();
+    return *this;
+}
+
+/**
+ * @brief Set the window length [samples], up to kMaxWindow. At least a second or so of data makes
+ * the stillness test reliable; shorter windows follow faster.
+ */
+GyroBiasTracker& GyroBiasTracker::setWindow(size_t samples)
+{
+    window    = samples < 2 ? 2 : samples > kMaxWindow ? kMaxWindow : samples;
+    prevValid = false;
+    clearWindow();
+    return *this;
+}
+
+/**
+ * @brief Set the stillness thresholds.
+ * @param gyroStd Largest standard deviation of each gyro axis [º/s], a bit above the sensor noise.
+ * @param accelStd Largest standard deviation of each accel axis [g], also the largest change of the
+ *  mean acceleration between windows.
+ */
+GyroBiasTracker& GyroBiasTracker::setThresholds(float gyroStd, float accelStd)
+{
+    const float gyroLSB  = gyroStd * math::gyroSensitivity(gyroFS);
+    const float accelLSB = accelStd * math::accelSensitivity(accelFS);
+    gyroVarMax           = gyroLSB * gyroLSB;
+    accelVarMax          = accelLSB * accelLSB;
+    accelStdMax          = accelLSB;
+    return *this;
+}
+
+/**
+ * @brief Set the weight of a new still window in the estimate once converged, (0, 1].
+ * Lower is smoother, higher follows temperature drift faster.
+ */
+GyroBiasTracker& GyroBiasTracker::setMinGain(float gain)
+{
+    minGain = gain;
+    return *this;
+}
+
+/**
+ * @brief Feed the hardware zero-motion status (`MOT_STAT_ZEROMOTION` of MPU::getMotionDetectStatus()).
+ * A window during which motion was reported is not still.
+ */
+void GyroBiasTracker::setZeroMotion(bool zeroMotion)
+{
+    this->zeroMotion = zeroMotion;
+    if (!zeroMotion) motionSeen = true;
+}
+
+/**
+ * @brief Add a batch of FIFO samples.
+ * @return Number of still windows completed (bias updates).
+ */
+size_t GyroBiasTracker::update(const fifo_sample_t* samples, size_t count)
+{
+    size_t updates = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].timestamp <= skipUntil) continue;
+        add(samples[i].gyro.xyz, samples[i].accel.xyz);
+        if (filled == window && closeWindow()) updates++;
+    }
+    return updates;
+}
+
+/*! Return true if the last completed window was still. */
+bool GyroBiasTracker::isStill()
+{
+    return still;
+}
+
+/*! Return the number of still windows since reset, zero means no bias learned yet. */
+uint32_t GyroBiasTracker::getStillWindows()
+{
+    return stillWindows;
+}
+
+/*! Return the estimated bias [º/s]. */
+float_axes_t GyroBiasTracker::getBias()
+{
+    return bias * (1 / math::gyroSensitivity(gyroFS));
+}
+
+/*! Return the estimated bias [LSB], in the gyro full-scale range of the samples. */
+float_axes_t GyroBiasTracker::getBiasRaw()
+{
+    return bias;
+}
+
+/**
+ * @brief Move the estimated bias into the gyro offset registers (one read, one write).
+ * The estimate keeps what the registers could not absorb (less than 1 LSB in 1000DPS). Samples
+ * measured up to now are skipped, they still carry the old bias.
+ */
+esp_err_t GyroBiasTracker::pushToHardware(MPU& mpu)
+{
+    if (stillWindows == 0) return ESP_OK;
+    // offset registers are LSB in 1000DPS, and add to the sensor output
+    const float toRegister = ldexpf(1, gyroFS - GYRO_FS_1000DPS);
+    raw_axes_t offset      = mpu.getGyroOffset();
+    if (MPU_ERR_CHECK(mpu.lastError())) return mpu.lastError();
+    raw_axes_t delta;
+    for (int i = 0; i < 3; i++) {
+        delta[i] = (int16_t) lroundf(-bias[i] * toRegister);
+        offset[i] += delta[i];
+    }
+    if (MPU_ERR_CHECK(mpu.setGyroOffset(offset))) return mpu.lastError();
+    for (int i = 0; i < 3; i++) bias[i] += delta[i] / toRegister;
+    skipUntil = esp_timer_get_time();
+    prevValid = false;
+    clearWindow();
+    return ESP_OK;
+}
+
+/*! Add one sample to the window. */
+void GyroBiasTracker::add(const int16_t* gyro, const int16_t* accel)
+{
+    for (int i = 0; i < 3; i++) {
+        gyroSum[i] += gyro[i];
+        gyroSumSq[i] += (int32_t) gyro[i] * gyro[i];
+        accelSum[i] += accel[i];
+        accelSumSq[i] += (int32_t) accel[i] * accel[i];
+    }
+    filled++;
+}
+
+/**
+ * @brief Test the full window for stillness and update the bias.
+ * @return true if the window was still.
+ */
+bool GyroBiasTracker::closeWindow()
+{
+    const int64_t n  = filled;
+    const float n2   = (float) n * n;
+    float_axes_t accelMean;
+    bool quiet = !motionSeen && zeroMotion;
+    for (int i = 0; i < 3; i++) {
+        // exact integer n^2 * variance
+        const float gyroVar  = (n * gyroSumSq[i] - (int64_t) gyroSum[i] * gyroSum[i]) / n2;
+        const float accelVar = (n * accelSumSq[i] - (int64_t) accelSum[i] * accelSum[i]) / n2;
+        accelMean[i]         = (float) accelSum[i] / n;
+        quiet &= gyroVar <= gyroVarMax && accelVar <= accelVarMax;
+        if (prevValid) quiet &= fabsf(accelMean[i] - prevAccel[i]) <= accelStdMax;
+    }
+    still     = quiet && prevValid;
+    prevAccel = accelMean;
+    prevValid = true;
+    if (still) {
+        stillWindows++;
+        const float gain = 1.f / stillWindows > minGain ? 1.f / stillWindows : minGain;
+        for (int i = 0; i < 3; i++) bias[i] += gain * ((float) gyroSum[i] / n - bias[i]);
+    }
+    clearWindow();
+    return still;
+}
+
+void GyroBiasTracker::clearWindow()
+{
+    filled     = 0;
+    motionSeen = !zeroMotion;
+    for (int i = 0; i < 3; i++) {
+        gyroSum[i]    = 0;
+        gyroSumSq[i]  = 0;
+        accelSum[i]   = 0;
+        accelSumSq[i] = 0;
+    }
+}
+
+}  // namespace mpud
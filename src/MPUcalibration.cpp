@@ -0,0 +1,518 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUcalibration.cpp
+ * Implement Calibrator class.
+ */
+
+#include "mpu/calibration.hpp"
+#include <math.h>
+#include <string.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/portmacro.h"
+#include "freertos/task.h"
+#include "mpu/registers.hpp"
+#include "mpu/types.hpp"
+#include "mpu/utils.hpp"
+#include "sdkconfig.h"
+
+static const char* TAG = CONFIG_MPU_CHIP_MODEL;
+
+#include "mpu/log.hpp"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+// configuration of the captures
+static constexpr uint16_t kSampleRate      = 1000;
+static constexpr dlpf_t kDLPF              = DLPF_188HZ;
+static constexpr fifo_config_t kFIFOConfig = FIFO_CFG_ACCEL | FIFO_CFG_GYRO;
+static constexpr size_t kPacketSize        = 12;
+// outlier rejection: packets beyond kOutlierSigma standard deviations (plus kOutlierFloor LSB, for
+// quantized axes) from the running mean are left out, once kOutlierWarmup packets are averaged
+static constexpr float kOutlierSigma = 5.f;
+static constexpr float kOutlierFloor = 8.f;
+static constexpr int kOutlierWarmup  = 16;
+
+/**
+ * @brief Construct an idle calibrator for the given MPU.
+ */
+Calibrator::Calibrator(MPU& mpu)
+    : mpu{&mpu},
+      state{CALIB_IDLE},
+      selfTest{false},
+      capture{0},
+      deadline{0},
+      nextDrain{0},
+      drainUs{0},
+      fifoCapacity{1024},
+      accelFS{ACCEL_FS_2G},
+      gyroFS{GYRO_FS_250DPS},
+      pendingPackets{0},
+      samples{0},
+      rejected{0},
+      mean{},
+      m2{},
+      saved{},
+      accelBias{},
+      gyroBias{},
+      whoami{0},
+      temperature{0},
+      result{SELF_TEST_PASS},
+      err{ESP_OK}
+{
+}
+
+/**
+ * @brief Start computing Accelerometer and Gyroscope offsets, see MPU::computeOffsets().
+ * @return `ESP_ERR_INVALID_STATE` if a calibration is running already.
+ */
+esp_err_t Calibrator::startOffsets()
+{
+    return start(false, ACCEL_FS_2G, GYRO_FS_250DPS);  // most sensitive
+}
+
+/**
+ * @brief Start the gyro and accel hardware self-test, see MPU::selfTest().
+ * @return `ESP_ERR_INVALID_STATE` if a calibration is running already.
+ */
+esp_err_t Calibrator::startSelfTest()
+{
+#if defined CONFIG_MPU6050
+    return start(true, ACCEL_FS_16G, GYRO_FS_250DPS);
+#elif defined CONFIG_MPU6500
+    return start(true, ACCEL_FS_2G, GYRO_FS_250DPS);
+#endif
+}
+
+/**
+ * @brief Do the work that is due, without waiting.
+ * Bus time per call is bounded: the FIFO is read kPacketsPerPoll packets at a time.
+ * @param waitUs Time until the next step is due [us], 0 when the next step is due now or the
+ *  calibration is over. Polling earlier does nothing.
+ * @return Bus error of the step that failed, the state is then `CALIB_FAILED`.
+ */
+esp_err_t Calibrator::poll(int64_t* waitUs)
+{
+    if (waitUs) *waitUs = 0;
+    if (!busy()) return ESP_OK;
+    const int64_t now = esp_timer_get_time();
+    if (state == CALIB_SETTLING) {
+        if (now < deadline) {
+            if (waitUs) *waitUs = deadline - now;
+            return ESP_OK;
+        }
+        // sensors stable, fill FIFO
+        if (MPU_ERR_CHECK(mpu->setFIFOConfig(kFIFOConfig))) return fail(mpu->lastError());
+        if (MPU_ERR_CHECK(mpu->resetFIFO())) return fail(mpu->lastError());
+        const int64_t sampleUs = selfTest ? kSelfTestSampleUs : kSampleUs;
+        deadline               = esp_timer_get_time() + sampleUs;
+        nextDrain              = esp_timer_get_time() + drainUs;
+        pendingPackets         = 0;
+        samples                = 0;
+        rejected               = 0;
+        memset(mean, 0, sizeof(mean));
+        memset(m2, 0, sizeof(m2));
+        state = CALIB_SAMPLING;
+        if (waitUs) *waitUs = drainUs < sampleUs ? drainUs : sampleUs;
+        return ESP_OK;
+    }
+    if (state == CALIB_SAMPLING && pendingPackets == 0) {
+        if (now >= deadline) {
+            if (MPU_ERR_CHECK(err = endCapture())) return fail(err);
+            // self-test settles while the regular capture is drained
+            if (selfTest && capture == 0 && MPU_ERR_CHECK(err = beginCapture(1))) return fail(err);
+        }
+        else if (now >= nextDrain) {
+            if (MPU_ERR_CHECK(err = countCapture())) return fail(err);
+            nextDrain = now + drainUs;
+        }
+        else {
+            const int64_t next = nextDrain < deadline ? nextDrain : deadline;
+            if (waitUs) *waitUs = next - now;
+            return ESP_OK;
+        }
+    }
+    // a slice of the FIFO per poll
+    if (MPU_ERR_CHECK(err = readCapture())) return fail(err);
+    if (pendingPackets > 0 || state == CALIB_SAMPLING) return ESP_OK;
+    // CALIB_READING, capture complete
+    if (MPU_ERR_CHECK(err = closeCapture())) return fail(err);
+    if (selfTest && capture == 0) {
+        capture = 1;
+        state   = CALIB_SETTLING;
+        const int64_t left = deadline - esp_timer_get_time();
+        if (waitUs) *waitUs = left > 0 ? left : 0;
+        return ESP_OK;
+    }
+    return finish();
+}
+
+/**
+ * @brief Poll until the calibration is over, sleeping in between (blocking).
+ */
+esp_err_t Calibrator::run()
+{
+    constexpr int64_t kTickUs = portTICK_PERIOD_MS * 1000;
+    while (busy()) {
+        int64_t waitUs;
+        if (MPU_ERR_CHECK(poll(&waitUs))) return err;
+        if (waitUs > 0) vTaskDelay((waitUs + kTickUs - 1) / kTickUs);
+    }
+    return err;
+}
+
+/**
+ * @brief Stop a running calibration and restore the configuration. The state goes back to `CALIB_IDLE`.
+ */
+esp_err_t Calibrator::abort()
+{
+    if (!busy()) return ESP_OK;
+    state = CALIB_IDLE;
+    return restore();
+}
+
+/*! Return the current step. */
+calib_state_t Calibrator::getState()
+{
+    return state;
+}
+
+/*! Return true while a calibration is running. */
+bool Calibrator::busy()
+{
+    return state == CALIB_SETTLING || state == CALIB_SAMPLING || state == CALIB_READING;
+}
+
+/**
+ * @brief Return the offsets of a finished startOffsets(), for MPU::setAccelOffset() and MPU::setGyroOffset().
+ *
+ * Note: Gyro offset output are LSB in 1000DPS format.
+ * Note: Accel offset output are LSB in 16G format.
+ * @return `ESP_ERR_INVALID_STATE` if no offset computation is done.
+ */
+esp_err_t Calibrator::getOffsets(raw_axes_t* accel, raw_axes_t* gyro)
+{
+    if (state != CALIB_DONE || selfTest) {
+        MPU_LOGEMSG(msgs::INVALID_STATE, "");
+        return ESP_ERR_INVALID_STATE;
+    }
+    // convert offsets to 16G and 1000DPS format and invert values
+    for (int i = 0; i < 3; i++) {
+        (*accel)[i] = -(accelBias[0][i] >> (types::ACCEL_FS_16G - accelFS));
+        (*gyro)[i]  = -(gyroBias[0][i] >> (types::GYRO_FS_1000DPS - gyroFS));
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Return the result of a finished startSelfTest().
+ * @param result Should be ZERO if gyro and accel passed, see `selftest_t`.
+ * @return `ESP_ERR_INVALID_STATE` if no self-test is done.
+ */
+esp_err_t Calibrator::getSelfTest(selftest_t* result)
+{
+    if (state != CALIB_DONE || !selfTest) {
+        MPU_LOGEMSG(msgs::INVALID_STATE, "");
+        return ESP_ERR_INVALID_STATE;
+    }
+    *result = this->result;
+    return ESP_OK;
+}
+
+/**
+ * @brief Return the result of a finished startOffsets() as a record to re-apply on later boots.
+ * @note With a compass, reads its sensitivity adjustment (compass must be initialized).
+ * @return `ESP_ERR_INVALID_STATE` if no offset computation is done, or the factory trim is unknown
+ *  (see MPU::getAccelFactoryTrim()).
+ */
+esp_err_t Calibrator::getRecord(calib_record_t* record)
+{
+    if (MPU_ERR_CHECK(getOffsets(&record->accelOffset, &record->gyroOffset))) return ESP_ERR_INVALID_STATE;
+    if (MPU_ERR_CHECK(mpu->getAccelFactoryTrim(&record->accelTrim))) return ESP_ERR_INVALID_STATE;
+    record->whoami      = whoami;
+    record->temperature = temperature;
+    memset(record->magAdjust, 0, sizeof(record->magAdjust));
+#if defined CONFIG_MPU_AK89xx
+    uint8_t* adj = record->magAdjust;
+    if (MPU_ERR_CHECK(mpu->compassGetAdjustment(adj, adj + 1, adj + 2))) return mpu->lastError();
+#endif
+    return ESP_OK;
+}
+
+/*! Return the number of packets averaged in the last capture. */
+int Calibrator::getSampleCount()
+{
+    return samples;
+}
+
+/*! Return the number of packets rejected as outliers in the last capture. */
+int Calibrator::getRejectedCount()
+{
+    return rejected;
+}
+
+// CRC-16/CCITT-FALSE
+static uint16_t crc16(const uint8_t* data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i] << 8;
+        for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static inline uint8_t* put16(uint8_t* data, int16_t value)
+{
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)(value);
+    return data + 2;
+}
+
+static constexpr uint8_t kRecordMagic[2] = {'M', 'C'};
+
+/**
+ * @brief Serialize a record: magic, version, payload length, payload (big endian), CRC-16.
+ * The layout does not depend on the compiler or the chip model.
+ */
+void Calibrator::pack(const calib_record_t& record, uint8_t data[kRecordSize])
+{
+    uint8_t* p = data;
+    *p++       = kRecordMagic[0];
+    *p++       = kRecordMagic[1];
+    *p++       = kRecordVersion;
+    *p++       = kRecordSize - 6;
+    *p++       = record.whoami;
+    for (int i = 0; i < 3; i++) p = put16(p, record.accelTrim[i]);
+    for (int i = 0; i < 3; i++) p = put16(p, record.accelOffset[i]);
+    for (int i = 0; i < 3; i++) p = put16(p, record.gyroOffset[i]);
+    for (int i = 0; i < 3; i++) *p++ = record.magAdjust[i];
+    p = put16(p, record.temperature);
+    put16(p, crc16(data, kRecordSize - 2));
+}
+
+/**
+ * @brief Deserialize a record written by pack().
+ * @return
+ *  - `ESP_ERR_INVALID_SIZE` if `length` is short or the blob is not a record,
+ *  - `ESP_ERR_INVALID_VERSION` if written by an incompatible version,
+ *  - `ESP_ERR_INVALID_CRC` if the blob is corrupt.
+ */
+esp_err_t Calibrator::unpack(const uint8_t* data, size_t length, calib_record_t* record)
+{
+    if (length < kRecordSize || data[0] != kRecordMagic[0] || data[1] != kRecordMagic[1]) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (data[2] != kRecordVersion || data[3] != kRecordSize - 6) return ESP_ERR_INVALID_VERSION;
+    if ((uint16_t) be16(data + kRecordSize - 2) != crc16(data, kRecordSize - 2)) return ESP_ERR_INVALID_CRC;
+    const uint8_t* p = data + 4;
+    record->whoami   = *p++;
+    be16Axes(p, &record->accelTrim);
+    be16Axes(p + 6, &record->accelOffset);
+    be16Axes(p + 12, &record->gyroOffset);
+    p += 18;
+    for (int i = 0; i < 3; i++) record->magAdjust[i] = *p++;
+    record->temperature = be16(p);
+    return ESP_OK;
+}
+
+/**
+ * @brief Save the configuration and set up the first capture.
+ */
+esp_err_t Calibrator::start(bool selfTest, accel_fs_t accelFS, gyro_fs_t gyroFS)
+{
+    if (busy()) {
+        MPU_LOGEMSG(msgs::INVALID_STATE, " calibration running");
+        return ESP_ERR_INVALID_STATE;
+    }
+    this->selfTest = selfTest;
+    this->accelFS  = accelFS;
+    this->gyroFS   = gyroFS;
+    capture        = 0;
+    result         = SELF_TEST_PASS;
+    err            = ESP_OK;
+    // backup previous configuration
+    if (MPU_ERR_CHECK(mpu->saveConfig(&saved))) {
+        state = CALIB_FAILED;
+        return err = mpu->lastError();
+    }
+#if defined CONFIG_MPU6500
+    constexpr uint8_t fifoSizeShift = regs::ACONFIG2_FIFO_SIZE_BIT - regs::ACONFIG2_FIFO_SIZE_LENGTH + 1;
+    const uint8_t accelConfig2      = saved.data[MPU::snapshotIndex(regs::ACCEL_CONFIG2)];
+    fifoCapacity = 512 << ((accelConfig2 >> fifoSizeShift) & ((1 << regs::ACONFIG2_FIFO_SIZE_LENGTH) - 1));
+#else
+    fifoCapacity = 1024;
+#endif
+    drainUs = (fifoCapacity / kPacketSize / 2) * (1000000 / kSampleRate);
+    if (!selfTest) whoami = mpu->whoAmI();
+    if (MPU_ERR_CHECK(mpu->lastError())) {
+        state = CALIB_FAILED;
+        return err = mpu->lastError();
+    }
+    state = CALIB_SETTLING;
+    if (MPU_ERR_CHECK(err = beginCapture(0))) return fail(err);
+    return err;
+}
+
+/**
+ * @brief Configure capture `next` and start its settle time.
+ * The first capture sets up the whole configuration, the self-test capture only enables self-test on
+ * top, from the end of the regular capture, so it settles while the regular capture is read.
+ * The FIFO is filled only once settled.
+ */
+esp_err_t Calibrator::beginCapture(int next)
+{
+    if (next == 0) {
+        if (MPU_ERR_CHECK(mpu->setSampleRate(kSampleRate))) return mpu->lastError();
+        if (MPU_ERR_CHECK(mpu->setDigitalLowPassFilter(kDLPF))) return mpu->lastError();
+        if (MPU_ERR_CHECK(mpu->setAccelFullScale(accelFS))) return mpu->lastError();
+        if (MPU_ERR_CHECK(mpu->setGyroFullScale(gyroFS))) return mpu->lastError();
+        if (MPU_ERR_CHECK(mpu->setFIFOConfig(FIFO_CFG_NONE))) return mpu->lastError();
+        if (MPU_ERR_CHECK(mpu->setFIFOEnabled(true))) return mpu->lastError();
+        deadline = esp_timer_get_time() + kSettleUs;
+        return ESP_OK;
+    }
+    if (MPU_ERR_CHECK(mpu->writeBits(regs::ACCEL_CONFIG, regs::ACONFIG_XA_ST_BIT, 3, 0x7))) {
+        return mpu->lastError();
+    }
+    if (MPU_ERR_CHECK(mpu->writeBits(regs::GYRO_CONFIG, regs::GCONFIG_XG_ST_BIT, 3, 0x7))) {
+        return mpu->lastError();
+    }
+    deadline = esp_timer_get_time() + kSelfTestSettleUs;
+    return ESP_OK;
+}
+
+/**
+ * @brief Stop writing to the FIFO and count the packets left to read.
+ */
+esp_err_t Calibrator::endCapture()
+{
+    if (MPU_ERR_CHECK(mpu->setFIFOConfig(FIFO_CFG_NONE))) return mpu->lastError();
+    if (!selfTest) {
+        if (MPU_ERR_CHECK(mpu->temperature(&temperature))) return mpu->lastError();
+    }
+    if (MPU_ERR_CHECK(err = countCapture())) return err;
+    state = CALIB_READING;
+    return ESP_OK;
+}
+
+/**
+ * @brief Count the whole packets in the FIFO. A full FIFO has overwritten bytes of its oldest packet
+ * and is out of alignment: it is reset, the packets in it are lost.
+ */
+esp_err_t Calibrator::countCapture()
+{
+    const uint16_t fifoCount = mpu->getFIFOCount();
+    if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+    if (fifoCount >= fifoCapacity) {
+        MPU_LOGW("FIFO overflow during calibration, poll() called late");
+        if (MPU_ERR_CHECK(mpu->resetFIFO())) return mpu->lastError();
+        pendingPackets = 0;
+        return ESP_OK;
+    }
+    pendingPackets = fifoCount / kPacketSize;
+    return ESP_OK;
+}
+
+/**
+ * @brief Read the next kPacketsPerPoll packets counted, in one burst, and add them to the running
+ * mean of the capture, leaving out outliers.
+ */
+esp_err_t Calibrator::readCapture()
+{
+    if (pendingPackets == 0) return ESP_OK;
+    uint8_t buffer[kPacketsPerPoll * kPacketSize];
+    const int packets = pendingPackets < kPacketsPerPoll ? pendingPackets : kPacketsPerPoll;
+    if (MPU_ERR_CHECK(mpu->readFIFO(packets * kPacketSize, buffer))) return mpu->lastError();
+    pendingPackets -= packets;
+    for (int i = 0; i < packets; i++) {
+        float value[6];
+        for (int j = 0; j < 6; j++) value[j] = be16(buffer + i * kPacketSize + 2 * j);
+        bool outlier = false;
+        if (samples >= kOutlierWarmup) {
+            for (int j = 0; j < 6 && !outlier; j++) {
+                const float limit = kOutlierSigma * sqrtf(m2[j] / (samples - 1)) + kOutlierFloor;
+                outlier           = fabsf(value[j] - mean[j]) > limit;
+            }
+        }
+        if (outlier) {
+            rejected++;
+            continue;
+        }
+        // Welford
+        samples++;
+        for (int j = 0; j < 6; j++) {
+            const float delta = value[j] - mean[j];
+            mean[j] += delta / samples;
+            m2[j] += delta * (value[j] - mean[j]);
+        }
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Store the average of the capture as its biases and get ready for the next capture.
+ */
+esp_err_t Calibrator::closeCapture()
+{
+    if (samples == 0) {
+        MPU_LOGEMSG(msgs::EMPTY, "FIFO empty");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    // remove gravity from Accel Z axis
+    const uint16_t gravityLSB = INT16_MAX >> (accelFS + 1);
+    for (int j = 0; j < 3; j++) {
+        accelBias[capture][j] = (int16_t) lroundf(mean[j] - (j == 2 ? gravityLSB : 0));
+        gyroBias[capture][j]  = (int16_t) lroundf(mean[3 + j]);
+    }
+    MPU_LOGD("capture %d: %d packets averaged, %d rejected", capture, samples, rejected);
+    return ESP_OK;
+}
+
+/**
+ * @brief Restore the configuration (disabling self-test) and evaluate the self-test.
+ */
+esp_err_t Calibrator::finish()
+{
+    if (MPU_ERR_CHECK(err = restore())) return fail(err);
+    if (selfTest) {
+        uint8_t accelST, gyroST;
+        if (MPU_ERR_CHECK(mpu->accelSelfTest(accelBias[0], accelBias[1], &accelST))) return fail(mpu->lastError());
+        if (MPU_ERR_CHECK(mpu->gyroSelfTest(gyroBias[0], gyroBias[1], &gyroST))) return fail(mpu->lastError());
+        result = SELF_TEST_PASS;
+        if (accelST != 0) result |= SELF_TEST_ACCEL_FAIL;
+        if (gyroST != 0) result |= SELF_TEST_GYRO_FAIL;
+    }
+    state = CALIB_DONE;
+    return err = ESP_OK;
+}
+
+/**
+ * @brief End in `CALIB_FAILED`, restoring as much of the configuration as the bus allows.
+ * @return The error that made the calibration fail.
+ */
+esp_err_t Calibrator::fail(esp_err_t error)
+{
+    state = CALIB_FAILED;
+    restore();
+    return err = error;
+}
+
+/**
+ * @brief Set back the configuration saved on start, self-test bits cleared with it.
+ */
+esp_err_t Calibrator::restore()
+{
+    if (MPU_ERR_CHECK(mpu->restoreConfig(saved))) return mpu->lastError();
+    return ESP_OK;
+}
+
+}  // namespace mpud
@@ -0,0 +1,286 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUekf.cpp
+ * Implement AttitudeEKF class.
+ *
+ * Error-state formulation after J. Sola, "Quaternion kinematics for the error-state Kalman
+ * filter" (2017): local (body frame) rotation error, gyro bias error.
+ */
+
+#include "mpu/ekf.hpp"
+#include <math.h>
+#include "mpu/math.hpp"
+#include "mpu/matrix.hpp"
+#include "mpu/types.hpp"
+#include "mpu/vector.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+static constexpr float kInitialAttitudeStd = 0.1f;   // [rad]
+static constexpr float kInitialBiasStd     = 0.05f;  // [rad/s]
+
+/**
+ * @brief Construct a filter at rest, the first sample aligns it.
+ */
+AttitudeEKF::AttitudeEKF()
+    : gyroNoise{kDefaultGyroNoise},
+      biasNoise{kDefaultBiasNoise},
+      accelNoise{kDefaultAccelNoise},
+      magNoise{kDefaultMagNoise}
+{
+    reset();
+}
+
+/**
+ * @brief Forget orientation and bias, the next sample aligns the filter again.
+ */
+void AttitudeEKF::reset()
+{
+    q      = kQuatIdentity;
+    bias   = float_axes_t();
+    magRef = float_axes_t();
+    P      = covariance_t::zero();
+    for (int i = 0; i < 3; i++) {
+        P[i][i]         = kInitialAttitudeStd * kInitialAttitudeStd;
+        P[3 + i][3 + i] = kInitialBiasStd * kInitialBiasStd;
+    }
+    lastTimestamp = 0;
+    aligned       = false;
+    magAligned    = false;
+}
+
+/**
+ * @brief Start from a known orientation and gyro bias, e.g. restored from a previous run.
+ */
+void AttitudeEKF::reset(const quat_t& orientation, const float_axes_t& gyroBias)
+{
+    reset();
+    q       = orientation;
+    bias    = gyroBias;
+    aligned = true;
+}
+
+/**
+ * @brief Set the noise model.
+ * @param gyroNoise Gyro white noise [rad/s/sqrt(Hz)]. Higher follows the accelerometer more.
+ * @param biasNoise Gyro bias random walk [rad/s^2/sqrt(Hz)]. Higher tracks bias changes faster.
+ * @param accelNoise Accelerometer noise [g], vibration included. Grows with the distance of the
+ *  measured magnitude from 1 g.
+ * @param magNoise Magnetometer noise, relative to the field magnitude.
+ */
+AttitudeEKF& AttitudeEKF::setNoise(float gyroNoise, float biasNoise, float accelNoise, float magNoise)
+{
+    this->gyroNoise  = gyroNoise;
+    this->biasNoise  = biasNoise;
+    this->accelNoise = accelNoise;
+    this->magNoise   = magNoise;
+    return *this;
+}
+
+/*! Return the orientation, sensor frame relative to earth frame. */
+const quat_t& AttitudeEKF::getQuaternion()
+{
+    return q;
+}
+
+/**
+ * @brief Return the orientation as Euler angles [º], aerospace sequence (yaw, pitch, roll).
+ * Range: roll [-180,180], pitch [-90,90], yaw [-180,180].
+ */
+float_axes_t AttitudeEKF::getEuler()
+{
+    return toEuler(q) * kRadToDeg;
+}
+
+/*! Return the estimated gyro bias [rad/s], already removed from the gyro in the filter. */
+float_axes_t AttitudeEKF::getGyroBias()
+{
+    return bias;
+}
+
+/*! Return the standard deviation of the rotation error about each sensor axis [rad]. */
+float_axes_t AttitudeEKF::getAttitudeStd()
+{
+    return float_axes_t(sqrtf(P[0][0]), sqrtf(P[1][1]), sqrtf(P[2][2]));
+}
+
+/*! Return the standard deviation of the gyro bias estimate [rad/s]. */
+float_axes_t AttitudeEKF::getGyroBiasStd()
+{
+    return float_axes_t(sqrtf(P[3][3]), sqrtf(P[4][4]), sqrtf(P[5][5]));
+}
+
+/**
+ * @brief Filter one 6-axis sample.
+ * @param gyro Angular rate [rad/s].
+ * @param accel Acceleration [g].
+ * @param dt Time since the previous sample [s].
+ */
+void AttitudeEKF::update(const float_axes_t& gyro, const float_axes_t& accel, float dt)
+{
+    if (!aligned) {
+        if (dot(accel, accel) == 0.f) return;
+        q       = fromGravity(accel);
+        aligned = true;
+    }
+    float error[kStates] = {0};
+    predict(gyro, dt);
+    correctAccel(accel, error);
+    inject(error);
+}
+
+/**
+ * @brief Filter one 9-axis sample.
+ * @param mag Magnetic field in the accel/gyro frame, any unit. A zero field (no compass data)
+ *  falls back to the 6-axis update.
+ */
+void AttitudeEKF::update(const float_axes_t& gyro, const float_axes_t& accel, const float_axes_t& mag, float dt)
+{
+    if (dot(mag, mag) == 0.f) return update(gyro, accel, dt);
+    if (!aligned) {
+        if (dot(accel, accel) == 0.f) return;
+        q       = fromGravity(accel, &mag);
+        aligned = true;
+    }
+    float error[kStates] = {0};
+    predict(gyro, dt);
+    correctAccel(accel, error);
+    correctMag(mag, error);
+    inject(error);
+}
+
+/**
+ * @brief Filter a batch of FIFO samples, stepping by the sample timestamps.
+ * @param scale Conversion factors of the full-scale configuration the samples were taken with.
+ * @param useMag Use the magnetometer (9-axis), if the FIFO holds compass data.
+ */
+void AttitudeEKF::update(const fifo_sample_t* samples, size_t count, const math::scale_t& scale, bool useMag)
+{
+    for (size_t i = 0; i < count; i++) {
+        const fifo_sample_t& sample = samples[i];
+        const float dt              = step(sample.timestamp);
+        const float_axes_t gyro(sample.gyro.x * scale.gyro_rps, sample.gyro.y * scale.gyro_rps,
+                                sample.gyro.z * scale.gyro_rps);
+        const float_axes_t accel(sample.accel.x * scale.accel, sample.accel.y * scale.accel,
+                                 sample.accel.z * scale.accel);
+#if defined CONFIG_MPU_AK89xx
+        if (useMag) {
+            update(gyro, accel, math::magToGyroFrame(sample.mag.x, sample.mag.y, sample.mag.z), dt);
+            continue;
+        }
+#endif
+        update(gyro, accel, dt);
+    }
+}
+
+/**
+ * @brief Return the time [s] from the previous batch sample, up to kMaxStep; 0 for the first one.
+ */
+float AttitudeEKF::step(int64_t timestamp)
+{
+    const int64_t previous = lastTimestamp;
+    lastTimestamp          = timestamp;
+    if (previous == 0 || timestamp <= previous) return 0;
+    const float dt = (timestamp - previous) * 1e-6f;
+    return dt < kMaxStep ? dt : kMaxStep;
+}
+
+/**
+ * @brief Integrate the bias-corrected gyro and propagate the covariance.
+ * Error dynamics: rotation' = -[w x] rotation - bias error, bias error' = random walk.
+ */
+void AttitudeEKF::predict(const float_axes_t& gyro, float dt)
+{
+    if (dt <= 0.f) return;
+    const float_axes_t theta = (gyro - bias) * dt;
+    q                        = normalize(q * quat_t{1, theta.x / 2, theta.y / 2, theta.z / 2});
+    // F = [I - [theta x], -I dt; 0, I]
+    covariance_t F = covariance_t::identity();
+    F[0][1]        = theta.z;
+    F[0][2]        = -theta.y;
+    F[1][0]        = -theta.z;
+    F[1][2]        = theta.x;
+    F[2][0]        = theta.y;
+    F[2][1]        = -theta.x;
+    for (int i = 0; i < 3; i++) F[i][3 + i] = -dt;
+    P = sandwich(F, P);
+    for (int i = 0; i < 3; i++) {
+        P[i][i] += gyroNoise * gyroNoise * dt;
+        P[3 + i][3 + i] += biasNoise * biasNoise * dt;
+    }
+}
+
+/**
+ * @brief Scalar measurement update, for a measurement that depends on the rotation error only.
+ * @param h Measurement row for the rotation error (the bias part is zero).
+ * @param residual Measured minus predicted value, at the nominal state.
+ * @param error Error state, accumulated over sequential updates.
+ */
+void AttitudeEKF::fuse(const float_axes_t& h, float residual, float variance, float error[kStates])
+{
+    float ph[kStates];  // P * H^T
+    for (int i = 0; i < kStates; i++) ph[i] = P[i][0] * h.x + P[i][1] * h.y + P[i][2] * h.z;
+    const float s = h.x * ph[0] + h.y * ph[1] + h.z * ph[2] + variance;
+    if (!(s > 0.f)) return;
+    const float innovation = residual - (h.x * error[0] + h.y * error[1] + h.z * error[2]);
+    const float invS       = 1 / s;
+    for (int i = 0; i < kStates; i++) error[i] += ph[i] * invS * innovation;
+    for (int i = 0; i < kStates; i++) {
+        for (int j = i; j < kStates; j++) P[j][i] = P[i][j] -= ph[i] * ph[j] * invS;
+    }
+}
+
+/**
+ * @brief Update with the direction of gravity.
+ * Predicted `g = R^T z`, for a rotation error `e`: `g + g x e`, so `H = [g x]`.
+ */
+void AttitudeEKF::correctAccel(const float_axes_t& accel, float error[kStates])
+{
+    const float n2 = dot(accel, accel);
+    if (!(n2 > 0.f)) return;
+    const float invNorm   = fastInvSqrt(n2);
+    const float deviation = n2 * invNorm - 1;  // [g]
+    if (fabsf(deviation) > kAccelGate) return;
+    const float_axes_t a   = accel * invNorm;
+    const float_axes_t g   = gravity(q);
+    const float variance   = accelNoise * accelNoise + deviation * deviation;
+    fuse(float_axes_t(0, -g.z, g.y), a.x - g.x, variance, error);
+    fuse(float_axes_t(g.z, 0, -g.x), a.y - g.y, variance, error);
+    fuse(float_axes_t(-g.y, g.x, 0), a.z - g.z, variance, error);
+}
+
+/**
+ * @brief Update with the direction of the magnetic field, about the vertical only.
+ * Same as correctAccel() with the reference field, each row projected on the earth vertical
+ * (in sensor frame) so the field never tilts the estimate.
+ */
+void AttitudeEKF::correctMag(const float_axes_t& mag, float error[kStates])
+{
+    const float_axes_t m = normalize(mag);
+    if (!magAligned) {
+        magRef     = rotate(q, m);
+        magAligned = true;
+        return;
+    }
+    const float_axes_t b  = rotate(conjugate(q), magRef);
+    const float_axes_t up = gravity(q);
+    const float variance  = magNoise * magNoise;
+    const float_axes_t rows[3] = {float_axes_t(0, -b.z, b.y), float_axes_t(b.z, 0, -b.x), float_axes_t(-b.y, b.x, 0)};
+    for (int i = 0; i < 3; i++) fuse(up * dot(rows[i], up), m[i] - b[i], variance, error);
+}
+
+/*! Fold the error state into the orientation and bias. */
+void AttitudeEKF::inject(const float error[kStates])
+{
+    q = normalize(q * quat_t{1, error[0] / 2, error[1] / 2, error[2] / 2});
+    bias += float_axes_t(error[3], error[4], error[5]);
+}
+
+}  // namespace mpud
@@ -0,0 +1,622 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUfifo.cpp
+ * Implement FIFOReader class.
+ */
+
+#include "mpu/fifo.hpp"
+#include <string.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/portmacro.h"
+#include "freertos/task.h"
+#include "mpu/registers.hpp"
+#include "mpu/types.hpp"
+#include "mpu/utils.hpp"
+#include "sdkconfig.h"
+
+static const char* TAG = CONFIG_MPU_CHIP_MODEL;
+
+#include "mpu/log.hpp"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/**
+ * @brief Construct a reader for the FIFO of the given MPU.
+ * @note Call begin() once the FIFO is configured.
+ */
+FIFOReader::FIFOReader(MPU& mpu)
+    : mpu{&mpu},
+      layout{},
+      maxBurst{kBufferSize},
+      pending{0},
+      capacity{1024},
+      mode{FIFO_MODE_OVERWRITE},
+      nominalPeriod{0},
+      period{0},
+      fit{},
+      sampleIndex{0},
+      gapIndex{-1},
+      gapLength{0},
+      lastReadUs{0},
+      leftBytes{0},
+      lost{0},
+      overflows{0},
+      speculated{false},
+      watermark{0},
+      buffer{0}
+{
+}
+
+/**
+ * @brief Read FIFO, sample rate and Aux I2C configuration from the MPU and compute the packet layout.
+ * @note Call again after changing FIFO, sample rate or Aux I2C Slaves configuration. Pending bytes are dropped.
+ */
+esp_err_t FIFOReader::begin()
+{
+    const fifo_config_t config = mpu->getFIFOConfig();
+    if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+    mode = mpu->getFIFOMode();
+    if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+    const uint16_t rate = mpu->getSampleRate();
+    if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+    nominalPeriod = 1000000.f / rate;
+    period        = nominalPeriod;
+#if defined CONFIG_MPU6500
+    const fifo_size_t size = mpu->getFIFOSize();
+    if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+    capacity = 512 << size;
+#else
+    capacity = 1024;
+#endif
+    uint8_t slaveLength[4] = {0};
+    for (int i = 0; i < 4; i++) {
+        const auxi2c_slv_t slave = (auxi2c_slv_t) i;
+        const bool enabled       = mpu->getAuxI2CSlaveEnabled(slave);
+        if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+        if (!enabled) continue;
+        const auxi2c_slv_config_t slaveConfig = mpu->getAuxI2CSlaveConfig(slave);
+        if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+        if (slaveConfig.rw == AUXI2C_READ) slaveLength[i] = slaveConfig.rxlength;
+    }
+    const esp_err_t err = begin(config, slaveLength);
+    if (MPU_ERR_CHECK(err)) return err;
+#if defined CONFIG_MPU_AK89xx
+    // compass data comes from Slave 0 reading [ST1, HXL..HZH, ST2], see compassSetMode()
+    if (layout.slave[MAG_SLAVE_READ_DATA] >= 0 && layout.slave_len[MAG_SLAVE_READ_DATA] >= 7) {
+        const auxi2c_slv_config_t magConfig = mpu->getAuxI2CSlaveConfig(MAG_SLAVE_READ_DATA);
+        if (MPU_ERR_CHECK(mpu->lastError())) return mpu->lastError();
+        if (magConfig.addr == COMPASS_I2CADDRESS && magConfig.reg_addr == regs::mag::STATUS1) {
+            layout.mag = layout.slave[MAG_SLAVE_READ_DATA] + 1;
+        }
+    }
+#endif
+    return ESP_OK;
+}
+
+/**
+ * @brief Compute the packet layout from a FIFO configuration and the length of Slaves data.
+ * @param config FIFO configuration, as set with MPU::setFIFOConfig().
+ * @param slaveLength Bytes read by each Aux I2C Slave 0-3 (0 for disabled or write slaves).
+ * @note Pending bytes are dropped. FIFO mode, size and sample rate are the ones read by begin()
+ *  (overwrite, 1kB and unknown before), with an unknown sample rate lost samples are not estimated.
+ * @return `ESP_ERR_INVALID_SIZE` if external sensors data exceed 24 bytes.
+ */
+esp_err_t FIFOReader::begin(fifo_config_t config, const uint8_t slaveLength[4])
+{
+    constexpr size_t kExtSensLenMax = 24;  // external sensors data length max
+    layout         = MPU::fifoLayout(config, slaveLength);
+    size_t extsens = 0;
+    for (int i = 0; i < 4; i++) extsens += slaveLength[i];
+    overflows = 0;
+    watermark = 0;
+    clear();
+    if (extsens > kExtSensLenMax) {
+        MPU_LOGEMSG(msgs::INVALID_LENGTH, " slaves read %zu bytes, maximum is %zu", extsens, kExtSensLenMax);
+        layout.packet_size = 0;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Drop bytes of a partially read packet and restart loss accounting, call it right after MPU::resetFIFO().
+ * @note The clock fit restarts, the estimated sample period is kept.
+ */
+void FIFOReader::clear()
+{
+    pending     = 0;
+    leftBytes   = 0;
+    lost        = 0;
+    lastReadUs  = esp_timer_get_time();
+    sampleIndex = 0;
+    gapIndex    = -1;
+    gapLength   = 0;
+    speculated  = false;
+    fit         = clock_fit_t{};
+}
+
+/**
+ * @brief Limit the length of a single FIFO read, for buses with a maximum transfer size.
+ * @note Packets split across reads are reassembled.
+ */
+FIFOReader& FIFOReader::setMaxBurstLength(size_t length)
+{
+    maxBurst = (length == 0 || length > kBufferSize) ? kBufferSize : length;
+    return *this;
+}
+
+/*! Return the packet layout computed by begin(). */
+const fifo_layout_t& FIFOReader::getLayout()
+{
+    return layout;
+}
+
+/*! Return the FIFO packet size in bytes, 0 if begin() was not called. */
+size_t FIFOReader::getPacketSize()
+{
+    return layout.packet_size;
+}
+
+/*! Return the number of bytes of an incomplete packet already read from the FIFO. */
+size_t FIFOReader::getPending()
+{
+    return pending;
+}
+
+/**
+ * @brief Return the number of samples lost (FIFO overflow) just before the batch returned by the last read().
+ */
+uint32_t FIFOReader::getLostSamples()
+{
+    return lost;
+}
+
+/*! Return the number of FIFO overflows detected since begin(). */
+uint32_t FIFOReader::getOverflowCount()
+{
+    return overflows;
+}
+
+/*! Return the estimated sample period [us], measured against the host clock. */
+float FIFOReader::getSamplePeriod()
+{
+    return period;
+}
+
+/**
+ * @brief Return the estimated MPU clock error against the host clock [ppm], positive when the MPU runs fast.
+ */
+float FIFOReader::getClockDrift()
+{
+    if (nominalPeriod == 0 || period == 0) return 0;
+    return (nominalPeriod / period - 1.f) * 1e6f;
+}
+
+/**
+ * @brief Set the number of samples readBatch() waits for.
+ * @param samples Batch size, up to getMaxWatermark(). 0 makes readBatch() read without waiting.
+ * @note Call after begin(), which resets it.
+ * @return `ESP_ERR_INVALID_SIZE` if the FIFO cannot hold the batch with enough headroom.
+ */
+esp_err_t FIFOReader::setWatermark(size_t samples)
+{
+    if (samples > getMaxWatermark()) {
+        MPU_LOGEMSG(msgs::INVALID_LENGTH, " watermark: %zu, maximum is %zu", samples, getMaxWatermark());
+        return ESP_ERR_INVALID_SIZE;
+    }
+    watermark = samples;
+    return ESP_OK;
+}
+
+/*! Return the number of samples readBatch() waits for. */
+size_t FIFOReader::getWatermark()
+{
+    return watermark;
+}
+
+/**
+ * @brief Return the largest watermark, 3/4 of the FIFO.
+ * @details The remaining quarter absorbs wake-up delays (tick granularity, task latency).
+ */
+size_t FIFOReader::getMaxWatermark()
+{
+    if (layout.packet_size == 0) return 0;
+    return capacity * 3 / 4 / layout.packet_size;
+}
+
+/**
+ * @brief Drain complete packets from the FIFO and decode them.
+ *
+ * The first read fetches FIFO count and the rest of the next packet together
+ * (see MPU::readFIFOWithCount()), then the remaining bytes are read in bursts of up to
+ * `kBufferSize` bytes (or setMaxBurstLength()), decoding as they arrive.
+ * Packets beyond `maxSamples` are left in the FIFO.
+ *
+ * An overflow is detected from `status`, a full FIFO or a count that does not end on a packet
+ * boundary. In overwrite mode the oldest bytes are gone, so the partial packet at the head of
+ * the FIFO is dropped and reading resumes at the next packet boundary. The samples lost are
+ * available from getLostSamples(). A count off the packet boundary right after a read that went
+ * past the count is not an overflow: that read took the head of a packet (see
+ * MPU::readFIFOWithCount()), its tail is skipped and one sample is lost.
+ *
+ * Samples are timestamped from the clock fit, see timestamp(). The newest sample in the FIFO was
+ * taken within one period before the read, unless `sampleTimeUs` tells when exactly.
+ *
+ * @param samples Output array.
+ * @param maxSamples Capacity of `samples`.
+ * @param count Number of samples decoded.
+ * @param status Interrupt status already read by the caller, if any. INT_STATUS clears on read,
+ *  so the `INT_STAT_FIFO_OVERFLOW` flag must be passed here when the caller reads it.
+ * @param sampleTimeUs Time of the newest sample in the FIFO, e.g. taken in the data-ready interrupt
+ *  handler, 0 if unknown.
+ * @return
+ *  - `ESP_ERR_INVALID_STATE`: no packet layout, call begin() first or enable sensors in the FIFO.
+ *  - or other standard I2C / SPI driver error codes.
+ */
+esp_err_t FIFOReader::read(fifo_sample_t* samples, size_t maxSamples, size_t* count, int_stat_t status,
+                           int64_t sampleTimeUs)
+{
+    return readTo(samples, nullptr, maxSamples, count, status, sampleTimeUs);
+}
+
+/**
+ * @brief Same as read(), into structure-of-arrays columns.
+ * @param columns Output columns, null columns are skipped.
+ * @param maxSamples Capacity of each column.
+ * @see SampleBatch
+ */
+esp_err_t FIFOReader::read(const sample_columns_t& columns, size_t maxSamples, size_t* count, int_stat_t status,
+                           int64_t sampleTimeUs)
+{
+    return readTo(nullptr, &columns, maxSamples, count, status, sampleTimeUs);
+}
+
+/*! Implementation of read(), into `samples` or, if null, into `columns`. */
+esp_err_t FIFOReader::readTo(fifo_sample_t* samples, const sample_columns_t* columns, size_t maxSamples,
+                             size_t* count, int_stat_t status, int64_t sampleTimeUs)
+{
+    *count = 0;
+    lost   = 0;
+    if (layout.packet_size == 0) {
+        MPU_LOGEMSG(msgs::INVALID_STATE, ", no FIFO packet layout, call begin()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    const size_t packetSize = layout.packet_size;
+    if (maxSamples == 0) return ESP_OK;
+    const int64_t now = esp_timer_get_time();
+    // count and the rest of the next packet in a single burst
+    const size_t speculative = packetSize - pending;
+    uint16_t fifoCount       = 0;
+    if (MPU_ERR_CHECK(mpu->readFIFOWithCount(speculative, buffer + pending, &fifoCount))) {
+        return mpu->lastError();
+    }
+    const size_t received = fifoCount < speculative ? fifoCount : speculative;
+    size_t consumed       = received;
+    bool newest           = true;  // whether the FIFO holds the newest sample
+    // overflow check, the FIFO always ends on a packet boundary
+    const bool misaligned = (pending + fifoCount) % packetSize != 0;
+    const bool full       = (mode == FIFO_MODE_OVERWRITE) ? fifoCount >= capacity : fifoCount + packetSize > capacity;
+    // a packet written during the previous read, which went past the count, lost its head to it
+    const bool partialRead = speculated && misaligned && !full && !(status & INT_STAT_FIFO_OVERFLOW);
+    speculated             = fifoCount < speculative;
+    if (partialRead) {
+        if (MPU_ERR_CHECK(realign(fifoCount, received, &consumed))) return mpu->lastError();
+        lost = 1;  // the packet partly read
+        sampleIndex += lost;
+        MPU_LOGD("FIFO packet partly read with the count, tail skipped");
+    }
+    else if (misaligned || full || (status & INT_STAT_FIFO_OVERFLOW)) {
+        overflows++;
+        // expected samples, from the bytes left by the previous read and the ones sampled since
+        const size_t produced = (period > 0) ? (now - lastReadUs) / period + 0.5f : 0;
+        const size_t expected = (pending + leftBytes) / packetSize + produced;
+        size_t available      = (pending + fifoCount) / packetSize;
+        if (mode == FIFO_MODE_OVERWRITE || misaligned) {
+            const bool partial = pending > 0 || fifoCount % packetSize != 0;
+            if (MPU_ERR_CHECK(realign(fifoCount, received, &consumed))) return mpu->lastError();
+            available = fifoCount / packetSize;
+            // a partial packet dropped is one lost sample
+            lost = (expected > available) ? expected - available : (partial ? 1 : 0);
+            sampleIndex += lost;  // oldest samples were lost
+        }
+        else {
+            pending += received;
+            lost   = (expected > available) ? expected - available : 0;
+            newest = lost == 0;  // newest samples were lost, counted after this batch
+        }
+        MPU_LOGW("FIFO overflow, %u samples lost", lost);
+    }
+    else {
+        pending += received;
+    }
+    size_t remaining = fifoCount - consumed;
+    // the newest sample was taken at most one period before the count was latched
+    const size_t available = (pending + remaining) / packetSize;
+    if (newest && available > 0) {
+        int64_t newestIndex = sampleIndex + available - 1;
+        if (gapIndex >= sampleIndex && gapIndex <= newestIndex) newestIndex += gapLength;
+        clockObserve(newestIndex, sampleTimeUs ? sampleTimeUs : now - period / 2);
+    }
+    *count += decodePending(samples, columns, 0, maxSamples);
+    // remaining bytes, in as few bursts as possible
+    while (remaining > 0 && *count < maxSamples) {
+        size_t length     = (maxSamples - *count) * packetSize - pending;
+        const size_t room = maxBurst - pending % packetSize;
+        if (length > remaining) length = remaining;
+        if (length > room) length = room;
+        if (length > kBufferSize - pending) length = kBufferSize - pending;
+        if (MPU_ERR_CHECK(mpu->readFIFO(length, buffer + pending))) return mpu->lastError();
+        pending += length;
+        remaining -= length;
+        *count += decodePending(samples, columns, *count, maxSamples - *count);
+    }
+    if (!newest) {
+        // a gap not reached yet is merged, its samples get slightly later timestamps
+        if (gapIndex < sampleIndex) gapLength = 0;
+        gapIndex = sampleIndex + available - *count;
+        gapLength += lost;
+    }
+    leftBytes  = remaining;
+    lastReadUs = now;
+    return ESP_OK;
+}
+
+/**
+ * @brief Sleep until the FIFO is expected to hold the watermark.
+ *
+ * The wake-up time is the timestamp of the last sample of the batch (see timestamp()),
+ * rounded up to the next tick. Returns right away if the watermark is 0 or already reached.
+ */
+esp_err_t FIFOReader::waitWatermark()
+{
+    if (layout.packet_size == 0) {
+        MPU_LOGEMSG(msgs::INVALID_STATE, ", no FIFO packet layout, call begin()");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (watermark == 0) return ESP_OK;
+    const int64_t last    = sampleIndex + watermark - 1;
+    const int64_t sampled = (fit.w > 0) ? timestamp(last) : lastReadUs + (int64_t)(watermark * period);
+    // half a period later, the fit is only accurate to a fraction of the period when polling
+    const int64_t wakeUs = sampled + period / 2;
+    const int64_t waitUs = wakeUs - esp_timer_get_time();
+    if (waitUs <= 0) return ESP_OK;
+    constexpr int64_t kTickUs = portTICK_PERIOD_MS * 1000;
+    vTaskDelay((waitUs + kTickUs - 1) / kTickUs);
+    return ESP_OK;
+}
+
+/**
+ * @brief Batching mode: wait for the watermark, then drain the FIFO.
+ * @see waitWatermark(), read()
+ */
+esp_err_t FIFOReader::readBatch(fifo_sample_t* samples, size_t maxSamples, size_t* count)
+{
+    *count        = 0;
+    esp_err_t err = waitWatermark();
+    if (MPU_ERR_CHECK(err)) return err;
+    return read(samples, maxSamples, count);
+}
+
+/**
+ * @brief Drop the partial packet at the head of the FIFO after an overflow.
+ *
+ * The bytes of the pending packet and the `fifoCount % packetSize` oldest bytes in the FIFO
+ * belong to packets which were partially overwritten. The `received` bytes just read
+ * (at `buffer + pending`) are kept from the next packet boundary on.
+ *
+ * @param consumed Bytes taken from the FIFO, updated with the ones discarded here.
+ */
+esp_err_t FIFOReader::realign(uint16_t fifoCount, size_t received, size_t* consumed)
+{
+    const size_t packetSize = layout.packet_size;
+    size_t skip             = fifoCount % packetSize;
+    if (skip <= received) {
+        memmove(buffer, buffer + pending + skip, received - skip);
+        pending = received - skip;
+        return ESP_OK;
+    }
+    pending = 0;
+    skip -= received;
+    *consumed += skip;
+    return mpu->readFIFO(skip, buffer);
+}
+
+/**
+ * @brief Decode complete packets in the buffer and keep the bytes of an incomplete one.
+ * @param first Output index of the first sample, in `samples` or, if null, in `columns`.
+ * @return Number of samples decoded.
+ */
+size_t FIFOReader::decodePending(fifo_sample_t* samples, const sample_columns_t* columns, size_t first,
+                                 size_t maxSamples)
+{
+    const size_t packetSize = layout.packet_size;
+    size_t packets          = pending / packetSize;
+    if (packets > maxSamples) packets = maxSamples;
+    if (samples)
+        decode(buffer, packets, samples + first);
+    else
+        decode(buffer, packets, *columns, first);
+    int64_t* times = samples ? nullptr : columns->timestamp;
+    for (size_t i = 0; i < packets; i++) {
+        if (sampleIndex == gapIndex) sampleIndex += gapLength;
+        const int64_t time = timestamp(sampleIndex++);
+        if (samples)
+            samples[first + i].timestamp = time;
+        else if (times)
+            times[first + i] = time;
+    }
+    const size_t used = packets * packetSize;
+    if (used > 0 && pending > used) memmove(buffer, buffer + used, pending - used);
+    pending -= used;
+    return packets;
+}
+
+/**
+ * @brief Decode packets of the usual layout, accel and gyro X, Y, Z, optional temperature and compass.
+ * Offsets are constant, so each packet is a run of straight loads and byte swaps.
+ */
+template <bool kTemp>
+void FIFOReader::decodeKernel(const uint8_t* packets, size_t packetSize, size_t count, int mag,
+                              fifo_sample_t* samples)
+{
+    constexpr int kGyro = kTemp ? 8 : 6;
+    for (size_t n = 0; n < count; n++, packets += packetSize) {
+        fifo_sample_t& sample = samples[n];
+        be16Axes(packets, &sample.accel);
+        be16Axes(packets + kGyro, &sample.gyro);
+        sample.temp = kTemp ? be16(packets + 6) : 0;
+#if defined CONFIG_MPU_AK89xx
+        if (mag >= 0)
+            le16Axes(packets + mag, &sample.mag);
+        else
+            sample.mag.x = sample.mag.y = sample.mag.z = 0;
+#endif
+        sample.timestamp = 0;
+    }
+}
+
+/**
+ * @brief Decode a single FIFO packet according to the current layout.
+ */
+void FIFOReader::decode(const uint8_t* packet, fifo_sample_t* sample)
+{
+    decode(packet, 1, sample);
+}
+
+/**
+ * @brief Decode consecutive FIFO packets according to the current layout.
+ *
+ * Layout checks are done once per batch, not per packet. Accel + gyro (+ temp) layouts, with or
+ * without compass, go through a kernel with constant offsets; any other layout is decoded one
+ * field at a time for all packets (see utils::be16Decode()). Timestamps are left to zero.
+ */
+void FIFOReader::decode(const uint8_t* packets, size_t count, fifo_sample_t* samples)
+{
+    const size_t ps    = layout.packet_size;
+    const bool gyroXYZ = layout.gyro[0] >= 0 && layout.gyro[1] >= 0 && layout.gyro[2] >= 0;
+#if defined CONFIG_MPU_AK89xx
+    const int mag = layout.mag;
+#else
+    const int mag = -1;
+#endif
+    if (layout.accel == 0 && gyroXYZ) {
+        if (layout.temp == 6 && layout.gyro[0] == 8) return decodeKernel<true>(packets, ps, count, mag, samples);
+        if (layout.temp < 0 && layout.gyro[0] == 6) return decodeKernel<false>(packets, ps, count, mag, samples);
+    }
+    // any other layout, one field at a time
+    constexpr size_t kStride = sizeof(fifo_sample_t) / sizeof(int16_t);
+    static_assert(sizeof(fifo_sample_t) % sizeof(int16_t) == 0, "fifo_sample_t stride");
+    for (int i = 0; i < 3; i++) {
+        if (layout.accel >= 0)
+            be16Decode(packets + layout.accel + 2 * i, ps, count, &samples->accel.xyz[i], kStride);
+        else
+            fillColumn(0, count, &samples->accel.xyz[i], kStride);
+        if (layout.gyro[i] >= 0)
+            be16Decode(packets + layout.gyro[i], ps, count, &samples->gyro.xyz[i], kStride);
+        else
+            fillColumn(0, count, &samples->gyro.xyz[i], kStride);
+#if defined CONFIG_MPU_AK89xx
+        if (mag >= 0)
+            le16Decode(packets + mag + 2 * i, ps, count, &samples->mag.xyz[i], kStride);
+        else
+            fillColumn(0, count, &samples->mag.xyz[i], kStride);
+#endif
+    }
+    if (layout.temp >= 0)
+        be16Decode(packets + layout.temp, ps, count, &samples->temp, kStride);
+    else
+        fillColumn(0, count, &samples->temp, kStride);
+    for (size_t n = 0; n < count; n++) samples[n].timestamp = 0;
+}
+
+/**
+ * @brief Decode consecutive FIFO packets into structure-of-arrays columns, from index `first` on.
+ *
+ * Each field is decoded for all packets in one loop into its contiguous column
+ * (see utils::be16Decode()). Null columns are skipped, timestamps are not written.
+ */
+void FIFOReader::decode(const uint8_t* packets, size_t count, const sample_columns_t& columns, size_t first)
+{
+    const size_t ps = layout.packet_size;
+    auto column     = [&](int offset, int16_t* dst, bool bigEndian) {
+        if (dst == nullptr) return;
+        if (offset < 0)
+            fillColumn(0, count, dst + first, 1);
+        else if (bigEndian)
+            be16Decode(packets + offset, ps, count, dst + first, 1);
+        else
+            le16Decode(packets + offset, ps, count, dst + first, 1);
+    };
+    for (int i = 0; i < 3; i++) {
+        column((layout.accel >= 0) ? layout.accel + 2 * i : -1, columns.accel[i], true);
+        column(layout.gyro[i], columns.gyro[i], true);
+#if defined CONFIG_MPU_AK89xx
+        column((layout.mag >= 0) ? layout.mag + 2 * i : -1, columns.mag[i], false);
+#endif
+    }
+    column(layout.temp, columns.temp, true);
+}
+
+/**
+ * @brief Add an observation to the clock fit: sample `index` was taken at `time`.
+ *
+ * The sums decay so that the fit follows the drift of the MPU clock (e.g. with temperature)
+ * over the last `kClockFitWindow` observations. The reference is moved before the sums grow
+ * large enough to lose precision.
+ */
+void FIFOReader::clockObserve(int64_t index, int64_t time)
+{
+    constexpr double kDecay = 1.0 - 1.0 / kClockFitWindow;
+    if (fit.count == 0) {
+        fit.index = index;
+        fit.time  = time;
+    }
+    else if (index - fit.index > (1 << 20)) {
+        const double dx = index - fit.index;
+        const double dy = time - fit.time;
+        fit.xx += dx * dx * fit.w - 2 * dx * fit.x;
+        fit.xy += dx * dy * fit.w - dx * fit.y - dy * fit.x;
+        fit.x -= dx * fit.w;
+        fit.y -= dy * fit.w;
+        fit.index = index;
+        fit.time  = time;
+    }
+    const double x = index - fit.index;
+    const double y = time - fit.time;
+    fit.w          = fit.w * kDecay + 1;
+    fit.x          = fit.x * kDecay + x;
+    fit.y          = fit.y * kDecay + y;
+    fit.xx         = fit.xx * kDecay + x * x;
+    fit.xy         = fit.xy * kDecay + x * y;
+    fit.count++;
+    if (fit.count < kClockFitMin) return;
+    const double den = fit.w * fit.xx - fit.x * fit.x;
+    if (den <= 0) return;
+    const float slope = (fit.w * fit.xy - fit.x * fit.y) / den;
+    // keep out of the fit what cannot be a clock error (e.g. lost samples miscounted)
+    if (slope > nominalPeriod * 0.9f && slope < nominalPeriod * 1.1f) period = slope;
+}
+
+/**
+ * @brief Return the estimated sampling time [us] of the sample with the given index.
+ *
+ * Sample indexes count from clear(), lost samples included. Before the first read, or with an
+ * unknown sample rate, timestamps are 0.
+ */
+int64_t FIFOReader::timestamp(int64_t index)
+{
+    if (fit.w == 0) return 0;
+    const double x = index - fit.index;
+    return fit.time + (fit.y + period * (x * fit.w - fit.x)) / fit.w;
+}
+
+}  // namespace mpud
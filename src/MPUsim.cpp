@@ -0,0 +1,835 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUsim.cpp
+ * Implement virtual MPU device and bus.
+ */
+
+#include "mpu/sim.hpp"
+#include <math.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "mpu/math.hpp"
+#include "mpu/registers.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/*! Simulation namespace */
+namespace sim
+{
+VirtualMPU mpu0;
+VirtualBus vbus0{mpu0};
+
+// WHO_AM_I value of the chip selected in menuconfig
+#if defined CONFIG_MPU6000 || defined CONFIG_MPU6050 || defined CONFIG_MPU9150
+static constexpr uint8_t kWhoAmI = 0x68;
+#elif defined CONFIG_MPU9255
+static constexpr uint8_t kWhoAmI = 0x73;
+#elif defined CONFIG_MPU9250
+static constexpr uint8_t kWhoAmI = 0x71;
+#elif defined CONFIG_MPU6555
+static constexpr uint8_t kWhoAmI = 0x7C;
+#elif defined CONFIG_MPU6500
+static constexpr uint8_t kWhoAmI = 0x70;
+#endif
+
+// One-time programmable registers, preserved through device reset: {register, value}
+static constexpr uint8_t kOTPRegisters[][2] = {
+#if defined CONFIG_MPU6050
+    // Factory accel offsets
+    {regs::XA_OFFSET_H, 0xF8}, {regs::XA_OFFSET_L, 0x9A}, {regs::YA_OFFSET_H, 0x05},
+    {regs::YA_OFFSET_L, 0x23}, {regs::ZA_OFFSET_H, 0x0A}, {regs::ZA_OFFSET_L, 0x5C},
+    // Self-test codes: accel 16, 17, 15 | gyro 10, 11, 12
+    {regs::SELF_TEST_X, 0x8A}, {regs::SELF_TEST_Y, 0x8B}, {regs::SELF_TEST_Z, 0x6C},
+    {regs::SELF_TEST_A, 0x07},
+#elif defined CONFIG_MPU6500
+    // Factory accel offsets
+    {regs::XA_OFFSET_H, 0xEC}, {regs::XA_OFFSET_L, 0x3E}, {regs::YA_OFFSET_H, 0x1A},
+    {regs::YA_OFFSET_L, 0x10}, {regs::ZA_OFFSET_H, 0x22}, {regs::ZA_OFFSET_L, 0x74},
+    // Self-test codes
+    {regs::SELF_TEST_X_GYRO, 0x5D}, {regs::SELF_TEST_Y_GYRO, 0x5F}, {regs::SELF_TEST_Z_GYRO, 0x5A},
+    {regs::SELF_TEST_X_ACCEL, 0x73}, {regs::SELF_TEST_Y_ACCEL, 0x76}, {regs::SELF_TEST_Z_ACCEL, 0x70},
+#endif
+};
+
+static constexpr uint8_t kAccelOffsetRegs[3] = {regs::XA_OFFSET_H, regs::YA_OFFSET_H, regs::ZA_OFFSET_H};
+static constexpr int16_t kNumOfExtSensRegs   = 24;
+
+#if defined CONFIG_MPU_AK89xx
+static constexpr uint8_t kCompassASA[3] = {0xB0, 0xB2, 0xA8};
+// Field generated by the internal magnetic source in self-test mode [uT]
+static constexpr float kCompassSelfTestField[3] = {4.5f, -7.5f, -180.f};
+#endif
+
+static uint8_t otpValue(uint8_t regAddr)
+{
+    for (const auto& otp : kOTPRegisters) {
+        if (otp[0] == regAddr) return otp[1];
+    }
+    return 0;
+}
+
+static inline int16_t clampToInt16(float value)
+{
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return static_cast<int16_t>(lroundf(value));
+}
+
+static inline int16_t readInt16(const uint8_t* data)
+{
+    return static_cast<int16_t>(data[0] << 8 | data[1]);
+}
+
+static inline void writeInt16(uint8_t* data, int16_t value)
+{
+    data[0] = static_cast<uint16_t>(value) >> 8;
+    data[1] = static_cast<uint16_t>(value) & 0xFF;
+}
+
+/**
+ * Self-test response of a sensor axis, from its OTP shift code.
+ * Accel in [g], gyro in [º/s]. Code zero means there is no production value, return a typical one.
+ */
+static float accelSelfTestResponse(uint8_t code)
+{
+    if (code == 0) return 0.5f;
+#if defined CONFIG_MPU6050
+    return 0.34f * powf(1.034f, code - 1);
+#elif defined CONFIG_MPU6500
+    return 2620.f * powf(1.01f, code - 1) / math::accelSensitivity(ACCEL_FS_2G);
+#endif
+}
+
+static float gyroSelfTestResponse(uint8_t code)
+{
+    if (code == 0) return 40.f;
+#if defined CONFIG_MPU6050
+    return 25.f * powf(1.046f, code - 1);
+#elif defined CONFIG_MPU6500
+    return 2620.f * powf(1.01f, code - 1) / math::gyroSensitivity(GYRO_FS_250DPS);
+#endif
+}
+
+/*******************************************************************************
+ * VirtualMPU
+ ******************************************************************************/
+
+/**
+ * @brief Construct a powered-on device, lying still and facing up at room temperature.
+ */
+VirtualMPU::VirtualMPU()
+    : scene_{{0.f, 0.f, 1.f}, {0.f, 0.f, 0.f}, {22.f, -5.f, -41.f}, {.02f, -.015f, .03f}, {1.5f, -.8f, .4f}, 25.f, 8, 0},
+      regs_{0},
+      fifo_{0},
+      fifoHead_{0},
+      fifoCount_{0},
+      nextSampleNs_{0},
+      samples_{0},
+      overflows_{0},
+      auxSamples_{0},
+      rng_{0x2545F491}
+{
+    powerOn();
+}
+
+/**
+ * @brief Power-on reset the device (and magnetometer), clear statistics.
+ */
+void VirtualMPU::powerOn()
+{
+    reset();
+    samples_   = 0;
+    overflows_ = 0;
+}
+
+/**
+ * @brief Return the scene measured by the device, modify it to change sensor readings.
+ */
+scene_t& VirtualMPU::scene()
+{
+    return scene_;
+}
+
+/**
+ * @brief Return a register value without side effects (no clear-on-read, no FIFO pop).
+ */
+uint8_t VirtualMPU::peek(uint8_t regAddr) const
+{
+    return regs_[regAddr & 0x7F];
+}
+
+/*! Return number of bytes in the FIFO. */
+uint16_t VirtualMPU::fifoCount() const
+{
+    return fifoCount_;
+}
+
+/*! Return number of samples taken since power-on. */
+uint32_t VirtualMPU::sampleCount() const
+{
+    return samples_;
+}
+
+/*! Return number of samples which overflowed the FIFO since power-on. */
+uint32_t VirtualMPU::overflowCount() const
+{
+    return overflows_;
+}
+
+/*! Return time of the next sample [us], i.e. when the next data-ready interrupt would fire. */
+int64_t VirtualMPU::nextSampleUs()
+{
+    update();
+    return (nextSampleNs_ + 999) / 1000;
+}
+
+/**
+ * @brief Read a sequence of registers.
+ * @details
+ *  Register address auto-increments after each byte, except at FIFO_R_W, so a burst
+ *  starting at FIFO_COUNT_H returns the count followed by FIFO data.
+ *  The magnetometer is reachable directly when in bypass mode.
+ * @note Both AD0 addresses are acknowledged, AD0 pin level is not modeled.
+ * */
+esp_err_t VirtualMPU::read(uint8_t devAddr, uint8_t regAddr, size_t length, uint8_t* data)
+{
+    update();
+    if (devAddr == MPU_I2CADDRESS_AD0_LOW || devAddr == MPU_I2CADDRESS_AD0_HIGH) {
+        for (size_t i = 0; i < length; i++) {
+            data[i] = readRegister(regAddr);
+            if (regAddr != regs::FIFO_R_W) regAddr = (regAddr + 1) & 0x7F;
+        }
+        return ESP_OK;
+    }
+#if defined CONFIG_MPU_AK89xx
+    if (devAddr == COMPASS_I2CADDRESS && bypassEnabled()) {
+        for (size_t i = 0; i < length; i++) data[i] = compassReadRegister(regAddr++);
+        return ESP_OK;
+    }
+#endif
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Write a sequence of registers.
+ * @details Same addressing rules as read().
+ * */
+esp_err_t VirtualMPU::write(uint8_t devAddr, uint8_t regAddr, size_t length, const uint8_t* data)
+{
+    update();
+    if (devAddr == MPU_I2CADDRESS_AD0_LOW || devAddr == MPU_I2CADDRESS_AD0_HIGH) {
+        for (size_t i = 0; i < length; i++) {
+            writeRegister(regAddr, data[i]);
+            if (regAddr != regs::FIFO_R_W) regAddr = (regAddr + 1) & 0x7F;
+        }
+        return ESP_OK;
+    }
+#if defined CONFIG_MPU_AK89xx
+    if (devAddr == COMPASS_I2CADDRESS && bypassEnabled()) {
+        for (size_t i = 0; i < length; i++) compassWriteRegister(regAddr++, data[i]);
+        return ESP_OK;
+    }
+#endif
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Restore registers to default start-up state, keeping OTP values.
+ */
+void VirtualMPU::reset()
+{
+    memset(regs_, 0, sizeof(regs_));
+    for (const auto& otp : kOTPRegisters) regs_[otp[0]] = otp[1];
+    regs_[regs::WHO_AM_I] = kWhoAmI;
+#if defined CONFIG_MPU6050
+    regs_[regs::PWR_MGMT1] = 1 << regs::PWR1_SLEEP_BIT;
+#elif defined CONFIG_MPU6500
+    regs_[regs::PWR_MGMT1] = 0x01;
+#endif
+    fifoHead_   = 0;
+    fifoCount_  = 0;
+    auxSamples_ = 0;
+#if defined CONFIG_MPU_AK89xx
+    compassReset();
+#endif
+}
+
+/**
+ * @brief Take all samples due since last transaction, according to `esp_timer_get_time()`.
+ */
+void VirtualMPU::update()
+{
+    // bound the catch-up work, older samples would be lost in the FIFO anyway
+    constexpr int64_t kMaxPendingSamples = kFIFOSizeMax;
+    const int64_t nowNs                  = esp_timer_get_time() * 1000;
+    const int64_t periodNs               = samplePeriodNs();
+    if (regs_[regs::PWR_MGMT1] & (1 << regs::PWR1_SLEEP_BIT)) {
+        nextSampleNs_ = nowNs + periodNs;
+        return;
+    }
+    if (nowNs - nextSampleNs_ > kMaxPendingSamples * periodNs) {
+        const int64_t skipped = (nowNs - nextSampleNs_) / periodNs - kMaxPendingSamples;
+        samples_ += skipped;
+        nextSampleNs_ += skipped * periodNs;
+    }
+    while (nextSampleNs_ <= nowNs) {
+        sample();
+        nextSampleNs_ += periodNs;
+    }
+}
+
+/**
+ * @brief Sample period from SMPLRT_DIV, DLPF and Fchoice.
+ * @details Sample Rate = Internal Output Rate / (1 + SMPLRT_DIV)
+ */
+int64_t VirtualMPU::samplePeriodNs() const
+{
+#if defined CONFIG_MPU6500
+    // Fchoice_b != 0 bypasses the DLPF and the sample rate divider
+    if (regs_[regs::GYRO_CONFIG] & 0x3) return 1000000000LL * 1000000 / (32000LL * (1000000 + scene_.clockDrift));
+#endif
+    const uint8_t dlpf          = regs_[regs::CONFIG] & 0x7;
+    const int64_t internalRate  = (dlpf == 0 || dlpf == 7) ? 8000 : 1000;
+    return 1000000000LL * (1 + regs_[regs::SMPLRT_DIV]) * 1000000 / (internalRate * (1000000 + scene_.clockDrift));
+}
+
+/**
+ * @brief Update sensor registers, run Aux I2C Master, push to FIFO and flag data ready.
+ */
+void VirtualMPU::sample()
+{
+    samples_++;
+    const accel_fs_t accelFS = (accel_fs_t)((regs_[regs::ACCEL_CONFIG] >> 3) & 0x3);
+    const gyro_fs_t gyroFS   = (gyro_fs_t)((regs_[regs::GYRO_CONFIG] >> 3) & 0x3);
+    const uint8_t standby    = regs_[regs::PWR_MGMT2];
+#if defined CONFIG_MPU6050
+    uint8_t accelSTCode[3], gyroSTCode[3];
+    for (int i = 0; i < 3; i++) {
+        accelSTCode[i] = ((regs_[regs::SELF_TEST_X + i] & 0xE0) >> 3) | ((regs_[regs::SELF_TEST_A] >> (4 - 2 * i)) & 0x3);
+        gyroSTCode[i]  = regs_[regs::SELF_TEST_X + i] & 0x1F;
+    }
+#elif defined CONFIG_MPU6500
+    const uint8_t* accelSTCode = &regs_[regs::SELF_TEST_X_ACCEL];
+    const uint8_t* gyroSTCode  = &regs_[regs::SELF_TEST_X_GYRO];
+#endif
+    for (int i = 0; i < 3; i++) {
+        // accelerometer
+        if (!(standby & (1 << (regs::PWR2_STBY_XA_BIT - i)))) {
+            float value = (scene_.accel[i] + scene_.accelBias[i]) * math::accelSensitivity(accelFS);
+            // offset registers are in 16G format, bit 0 is reserved
+            const uint8_t factory[2] = {otpValue(kAccelOffsetRegs[i]), otpValue(kAccelOffsetRegs[i] + 1)};
+            const int16_t offset     = readInt16(&regs_[kAccelOffsetRegs[i]]) & ~1;
+            value += (offset - (readInt16(factory) & ~1)) * (8 >> accelFS);
+            if (regs_[regs::ACCEL_CONFIG] & (1 << (regs::ACONFIG_XA_ST_BIT - i))) {
+                value += accelSelfTestResponse(accelSTCode[i]) * math::accelSensitivity(accelFS);
+            }
+            writeInt16(&regs_[regs::ACCEL_XOUT_H + 2 * i], clampToInt16(value + noise()));
+        }
+        // gyroscope
+        if (!(standby & (1 << (regs::PWR2_STBY_XG_BIT - i)))) {
+            float value = (scene_.gyro[i] + scene_.gyroBias[i]) * math::gyroSensitivity(gyroFS);
+            // offset registers are in 1000DPS format
+            value += readInt16(&regs_[regs::XG_OFFSET_H + 2 * i]) * 4.f / (1 << gyroFS);
+            if (regs_[regs::GYRO_CONFIG] & (1 << (regs::GCONFIG_XG_ST_BIT - i))) {
+                value += gyroSelfTestResponse(gyroSTCode[i]) * math::gyroSensitivity(gyroFS);
+            }
+            writeInt16(&regs_[regs::GYRO_XOUT_H + 2 * i], clampToInt16(value + noise()));
+        }
+    }
+    // temperature
+    if (!(regs_[regs::PWR_MGMT1] & (1 << regs::PWR1_TEMP_DIS_BIT))) {
+        const float temp = (scene_.temp - math::kCelsiusOffset) * math::kTempSensitivity + math::kRoomTempOffset;
+        writeInt16(&regs_[regs::TEMP_OUT_H], clampToInt16(temp));
+    }
+    // external sensors
+    auxI2CSample();
+    // FIFO, order: accel, temp, gyro x, y, z, slave 0, 1, 2, 3
+    if (regs_[regs::USER_CTRL] & (1 << regs::USERCTRL_FIFO_EN_BIT)) {
+        const uint8_t fifoEn = regs_[regs::FIFO_EN];
+        uint8_t packet[14 + kNumOfExtSensRegs];
+        size_t length = 0;
+        auto append   = [&](uint8_t regAddr, size_t count) {
+            memcpy(packet + length, &regs_[regAddr], count);
+            length += count;
+        };
+        if (fifoEn & (1 << regs::FIFO_ACCEL_EN_BIT)) append(regs::ACCEL_XOUT_H, 6);
+        if (fifoEn & (1 << regs::FIFO_TEMP_EN_BIT)) append(regs::TEMP_OUT_H, 2);
+        if (fifoEn & (1 << regs::FIFO_XGYRO_EN_BIT)) append(regs::GYRO_XOUT_H, 2);
+        if (fifoEn & (1 << regs::FIFO_YGYRO_EN_BIT)) append(regs::GYRO_YOUT_H, 2);
+        if (fifoEn & (1 << regs::FIFO_ZGYRO_EN_BIT)) append(regs::GYRO_ZOUT_H, 2);
+        uint8_t extsens = 0;
+        for (int slv = 0; slv < 4; slv++) {
+            const uint8_t slvAddr = regs_[regs::I2C_SLV0_ADDR + 3 * slv];
+            const uint8_t slvCtrl = regs_[regs::I2C_SLV0_CTRL + 3 * slv];
+            if (!(slvCtrl & (1 << regs::I2C_SLV_EN_BIT)) || !(slvAddr & (1 << regs::I2C_SLV_RNW_BIT))) continue;
+            uint8_t slvLen = slvCtrl & 0xF;
+            if (extsens + slvLen > kNumOfExtSensRegs) slvLen = kNumOfExtSensRegs - extsens;
+            const bool slvFIFOEn = (slv < 3) ? (fifoEn & (1 << (regs::FIFO_SLV_0_EN_BIT + slv)))
+                                             : (regs_[regs::I2C_MST_CTRL] & (1 << regs::I2CMST_CTRL_SLV_3_FIFO_EN_BIT));
+            if (slvFIFOEn) append(regs::EXT_SENS_DATA_00 + extsens, slvLen);
+            extsens += slvLen;
+        }
+        if (length > 0) fifoPush(packet, length);
+    }
+    regs_[regs::INT_STATUS] |= 1 << regs::INT_STATUS_RAW_DATA_RDY_BIT;
+}
+
+/**
+ * @brief Run Auxiliary I2C Master Slaves 0-3 transfers of a sample cycle.
+ * @details Reads fill EXT_SENS_DATA registers in order of slave number.
+ */
+void VirtualMPU::auxI2CSample()
+{
+    if (!(regs_[regs::USER_CTRL] & (1 << regs::USERCTRL_I2C_MST_EN_BIT))) return;
+#if defined CONFIG_MPU_AK8963
+    // continuous measurement modes
+    const uint8_t compassMode = compassRegs_[regs::mag::CONTROL1] & 0xF;
+    if (compassMode == 0x2 || compassMode == 0x6) compassMeasure(false);
+#endif
+    const uint8_t sampleDelay = regs_[regs::I2C_SLV4_CTRL] & 0x1F;
+    const bool delayed        = (auxSamples_++ % (sampleDelay + 1)) != 0;
+    uint8_t extsens           = 0;
+    for (int slv = 0; slv < 4; slv++) {
+        const uint8_t slvAddr = regs_[regs::I2C_SLV0_ADDR + 3 * slv];
+        const uint8_t slvReg  = regs_[regs::I2C_SLV0_REG + 3 * slv];
+        const uint8_t slvCtrl = regs_[regs::I2C_SLV0_CTRL + 3 * slv];
+        if (!(slvCtrl & (1 << regs::I2C_SLV_EN_BIT))) continue;
+        const bool read = slvAddr & (1 << regs::I2C_SLV_RNW_BIT);
+        uint8_t slvLen  = slvCtrl & 0xF;
+        if (read && extsens + slvLen > kNumOfExtSensRegs) slvLen = kNumOfExtSensRegs - extsens;
+        const bool skip = delayed && (regs_[regs::I2C_MST_DELAY_CRTL] & (1 << slv));
+        if (!skip && slvLen > 0) {
+            uint8_t* rxdata = &regs_[regs::EXT_SENS_DATA_00 + extsens];
+            if (!auxI2CTransfer(slvAddr, slvReg, slvLen, regs_[regs::I2C_SLV0_DO + slv], rxdata)) {
+                regs_[regs::I2C_MST_STATUS] |= 1 << (regs::I2CMST_STAT_SLV0_NACK_BIT + slv);
+            }
+        }
+        if (read) extsens += slvLen;
+    }
+}
+
+/**
+ * @brief Perform a transfer on the Auxiliary I2C bus.
+ * @param slvLen number of bytes to read, writes are always one byte.
+ * @return `false` if no slave acknowledged.
+ */
+bool VirtualMPU::auxI2CTransfer(uint8_t slvAddr, uint8_t slvReg, uint8_t slvLen, uint8_t slvDO, uint8_t* rxdata)
+{
+#if defined CONFIG_MPU_AK89xx
+    if ((slvAddr & 0x7F) == COMPASS_I2CADDRESS) {
+        if (slvAddr & (1 << regs::I2C_SLV_RNW_BIT)) {
+            for (uint8_t i = 0; i < slvLen; i++) rxdata[i] = compassReadRegister(slvReg + i);
+        }
+        else {
+            compassWriteRegister(slvReg, slvDO);
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+/**
+ * @brief Write data to FIFO according to FIFO mode, flag overflow.
+ */
+void VirtualMPU::fifoPush(const uint8_t* data, size_t length)
+{
+    const size_t capacity = fifoCapacity();
+    if (fifoCount_ + length > capacity) {
+        overflows_++;
+        regs_[regs::INT_STATUS] |= 1 << regs::INT_STATUS_FIFO_OFLOW_BIT;
+        if (regs_[regs::CONFIG] & (1 << regs::CONFIG_FIFO_MODE_BIT)) return;  // stop when full
+        // replace the oldest data
+        const size_t drop = fifoCount_ + length - capacity;
+        fifoHead_         = (fifoHead_ + drop) % kFIFOSizeMax;
+        fifoCount_ -= drop;
+    }
+    for (size_t i = 0; i < length; i++) {
+        fifo_[(fifoHead_ + fifoCount_) % kFIFOSizeMax] = data[i];
+        fifoCount_++;
+    }
+}
+
+/**
+ * @brief Read a byte from FIFO, an empty FIFO returns 0xFF.
+ */
+uint8_t VirtualMPU::fifoPop()
+{
+    if (fifoCount_ == 0) return 0xFF;
+    const uint8_t data = fifo_[fifoHead_];
+    fifoHead_          = (fifoHead_ + 1) % kFIFOSizeMax;
+    fifoCount_--;
+    return data;
+}
+
+/**
+ * @brief FIFO size, MPU6500 based models configure it in ACCEL_CONFIG2.
+ */
+size_t VirtualMPU::fifoCapacity() const
+{
+#if defined CONFIG_MPU6050
+    return 1024;
+#elif defined CONFIG_MPU6500
+    return 512 << ((regs_[regs::ACCEL_CONFIG2] >> 6) & 0x3);
+#endif
+}
+
+/**
+ * @brief Read a register, apply read side effects.
+ */
+uint8_t VirtualMPU::readRegister(uint8_t regAddr)
+{
+    uint8_t data = regs_[regAddr];
+    switch (regAddr) {
+        case regs::INT_STATUS:
+            regs_[regAddr] = 0;
+            break;
+        case regs::I2C_MST_STATUS:
+            regs_[regAddr] &= 1 << regs::I2CMST_STAT_PASS_THROUGH_BIT;
+            break;
+        case regs::FIFO_COUNT_H:
+            data = (fifoCount_ >> 8) & 0x1F;
+            break;
+        case regs::FIFO_COUNT_L:
+            data = fifoCount_ & 0xFF;
+            break;
+        case regs::FIFO_R_W:
+            data = fifoPop();
+            break;
+#if defined CONFIG_MPU6050
+        case regs::MOTION_DETECT_STATUS:
+            regs_[regAddr] &= 1 << regs::MOT_STATUS_ZRMOT_BIT;
+            break;
+#endif
+        default:
+            break;
+    }
+    return data;
+}
+
+/**
+ * @brief Write a register, apply write side effects. Read-only registers are ignored.
+ */
+void VirtualMPU::writeRegister(uint8_t regAddr, uint8_t data)
+{
+    if (regAddr >= regs::INT_STATUS && regAddr <= regs::EXT_SENS_DATA_23) return;
+    switch (regAddr) {
+        case regs::I2C_MST_STATUS:
+        case regs::FIFO_COUNT_H:
+        case regs::FIFO_COUNT_L:
+        case regs::WHO_AM_I:
+            return;
+        case regs::FIFO_R_W:
+            fifoPush(&data, 1);
+            return;
+        case regs::PWR_MGMT1:
+            if (data & (1 << regs::PWR1_DEVICE_RESET_BIT)) {
+                reset();
+                return;
+            }
+            break;
+        case regs::SIGNAL_PATH_RESET:
+            if (data) memset(&regs_[regs::ACCEL_XOUT_H], 0, regs::GYRO_ZOUT_L - regs::ACCEL_XOUT_H + 1);
+            data = 0;
+            break;
+        case regs::USER_CTRL:
+            if (data & (1 << regs::USERCTRL_FIFO_RESET_BIT)) {
+                fifoHead_  = 0;
+                fifoCount_ = 0;
+            }
+            if (data & (1 << regs::USERCTRL_I2C_MST_RESET_BIT)) auxSamples_ = 0;
+            if (data & (1 << regs::USERCTRL_SIG_COND_RESET_BIT)) {
+                memset(&regs_[regs::ACCEL_XOUT_H], 0, regs::GYRO_ZOUT_L - regs::ACCEL_XOUT_H + 1);
+            }
+            data &= 0xF0;  // reset bits auto clear
+            break;
+        case regs::I2C_SLV4_CTRL:
+            // Slave 4 single transfer, done right away instead of at next sample
+            if ((data & (1 << regs::I2C_SLV4_EN_BIT)) && (regs_[regs::USER_CTRL] & (1 << regs::USERCTRL_I2C_MST_EN_BIT))) {
+                if (auxI2CTransfer(regs_[regs::I2C_SLV4_ADDR], regs_[regs::I2C_SLV4_REG], 1, regs_[regs::I2C_SLV4_DO],
+                                   &regs_[regs::I2C_SLV4_DI])) {
+                    regs_[regs::I2C_MST_STATUS] |= 1 << regs::I2CMST_STAT_SLV4_DONE_BIT;
+                }
+                else {
+                    regs_[regs::I2C_MST_STATUS] |= 1 << regs::I2CMST_STAT_SLV4_NACK_BIT;
+                }
+                if (data & (1 << regs::I2C_SLV4_DONE_INT_BIT)) {
+                    regs_[regs::INT_STATUS] |= 1 << regs::INT_STATUS_I2C_MST_BIT;
+                }
+                data &= ~(1 << regs::I2C_SLV4_EN_BIT);
+            }
+            break;
+        default:
+            break;
+    }
+    regs_[regAddr] = data;
+}
+
+/**
+ * @brief Uniform noise in the range [-noise, +noise] LSB (xorshift32).
+ */
+int16_t VirtualMPU::noise()
+{
+    if (scene_.noise == 0) return 0;
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return static_cast<int16_t>(rng_ % (2 * scene_.noise + 1)) - scene_.noise;
+}
+
+/**
+ * @brief Auxiliary I2C bus is connected to the primary bus when bypass is on and master is off.
+ */
+bool VirtualMPU::bypassEnabled() const
+{
+    return (regs_[regs::INT_PIN_CONFIG] & (1 << regs::INT_CFG_I2C_BYPASS_EN_BIT)) &&
+           !(regs_[regs::USER_CTRL] & (1 << regs::USERCTRL_I2C_MST_EN_BIT));
+}
+
+#if defined CONFIG_MPU_AK89xx
+/**
+ * @brief Restore magnetometer registers to power-down state.
+ */
+void VirtualMPU::compassReset()
+{
+    memset(compassRegs_, 0, sizeof(compassRegs_));
+    compassRegs_[regs::mag::WHO_I_AM] = 0x48;
+    memcpy(&compassRegs_[regs::mag::ASAX], kCompassASA, sizeof(kCompassASA));
+}
+
+/**
+ * @brief Take a single magnetometer measurement, in normal or self-test mode.
+ */
+void VirtualMPU::compassMeasure(bool selftest)
+{
+#if defined CONFIG_MPU_AK8975
+    constexpr float kResolution[2] = {0.3f, 0.3f};  // uT/LSB
+    constexpr int16_t kRange[2]    = {4095, 4095};
+#elif defined CONFIG_MPU_AK8963
+    constexpr float kResolution[2] = {0.6f, 0.15f};  // [0] = 14-bit, [1] = 16-bit
+    constexpr int16_t kRange[2]    = {8190, 32760};
+#endif
+    const int sensy = (compassRegs_[regs::mag::CONTROL1] >> 4) & 0x1;
+    bool overflow   = false;
+    for (int i = 0; i < 3; i++) {
+        const float field = selftest ? kCompassSelfTestField[i] : scene_.mag[i];
+        const float adj   = (compassRegs_[regs::mag::ASAX + i] - 128) * (0.5f / 128) + 1;
+        int16_t value     = clampToInt16(field / kResolution[sensy] / adj);
+        if (value > kRange[sensy] || value < -kRange[sensy]) overflow = true;
+        compassRegs_[regs::mag::HXL + 2 * i] = static_cast<uint16_t>(value) & 0xFF;
+        compassRegs_[regs::mag::HXH + 2 * i] = static_cast<uint16_t>(value) >> 8;
+    }
+#if defined CONFIG_MPU_AK8963
+    if (compassRegs_[regs::mag::STATUS1] & (1 << regs::mag::STATUS1_DATA_RDY_BIT)) {
+        compassRegs_[regs::mag::STATUS1] |= 1 << regs::mag::STATUS1_DATA_OVERRUN_BIT;
+    }
+    compassRegs_[regs::mag::STATUS2] = sensy << regs::mag::STATUS2_BIT_OUTPUT_M_BIT;
+#else
+    compassRegs_[regs::mag::STATUS2] = 0;
+#endif
+    if (overflow) compassRegs_[regs::mag::STATUS2] |= 1 << regs::mag::STATUS2_OVERFLOW_BIT;
+    compassRegs_[regs::mag::STATUS1] |= 1 << regs::mag::STATUS1_DATA_RDY_BIT;
+}
+
+/**
+ * @brief Read a magnetometer register, reading STATUS2 releases the data.
+ */
+uint8_t VirtualMPU::compassReadRegister(uint8_t regAddr)
+{
+    if (regAddr >= sizeof(compassRegs_)) return 0;
+    const uint8_t data = compassRegs_[regAddr];
+    if (regAddr == regs::mag::STATUS2) compassRegs_[regs::mag::STATUS1] = 0;
+    return data;
+}
+
+/**
+ * @brief Write a magnetometer register, single measurement and self-test modes
+ *  complete immediately and return to power-down.
+ */
+void VirtualMPU::compassWriteRegister(uint8_t regAddr, uint8_t data)
+{
+    switch (regAddr) {
+        case regs::mag::CONTROL1: {
+            compassRegs_[regAddr] = data;
+            const uint8_t mode    = data & 0xF;
+            if (mode == 0x1 || mode == 0x8) {
+                compassMeasure(mode == 0x8 && (compassRegs_[regs::mag::ASTC] & (1 << regs::mag::ASTC_SELF_TEST_BIT)));
+                compassRegs_[regAddr] &= 0xF0;
+            }
+            break;
+        }
+#if defined CONFIG_MPU_AK8963
+        case regs::mag::CONTROL2:
+            if (data & (1 << regs::mag::CONTROL2_SOFT_RESET_BIT)) compassReset();
+            break;
+#endif
+        case regs::mag::ASTC:
+        case regs::mag::TEST1:
+        case regs::mag::TEST2:
+        case regs::mag::I2CDIS:
+            compassRegs_[regAddr] = data;
+            break;
+        default:
+            break;
+    }
+}
+#endif  // AK89xx
+
+/*******************************************************************************
+ * VirtualBus
+ ******************************************************************************/
+
+/**
+ * @brief Construct a bus connected to the given device.
+ * @param clockSpeed I2C clock used to compute bus time.
+ */
+VirtualBus::VirtualBus(VirtualMPU& device, uint32_t clockSpeed)
+    : device_{&device}, clockSpeed_{clockSpeed}, overheadUs_{0}, stats_{}, elapsedNs_{0}
+{
+}
+
+/*! Does nothing, present for interface compatibility. */
+esp_err_t VirtualBus::close()
+{
+    return ESP_OK;
+}
+
+/*! Return the connected device. */
+VirtualMPU& VirtualBus::device()
+{
+    return *device_;
+}
+
+/*! Set I2C clock used to compute bus time. */
+void VirtualBus::setClockSpeed(uint32_t clockSpeed)
+{
+    clockSpeed_ = clockSpeed;
+}
+
+/*! Set a fixed time added to each transaction, to account for driver and task overhead. */
+void VirtualBus::setTransactionOverhead(uint32_t overheadUs)
+{
+    overheadUs_ = overheadUs;
+}
+
+/*! Return traffic statistics since last resetStats(). */
+const bus_stats_t& VirtualBus::stats() const
+{
+    return stats_;
+}
+
+/*! Clear traffic statistics. */
+void VirtualBus::resetStats()
+{
+    stats_ = bus_stats_t{};
+}
+
+/*! Return total bus time since construction, not affected by resetStats(). */
+int64_t VirtualBus::elapsedUs() const
+{
+    return elapsedNs_ / 1000;
+}
+
+/**
+ * @brief Count a transaction and its time on the wire.
+ * @details
+ *  9 clocks per byte (8 bits + ACK), plus start and stop conditions. \n
+ *  Write: [S, addr+W, reg, data.., P]. Read: [S, addr+W, reg, Sr, addr+R, data.., P]. \n
+ *  Accounted after the device access, so samples due during a transaction land after it,
+ *  as a FIFO being drained by a long burst makes room faster than new samples arrive.
+ */
+void VirtualBus::account(bool read, size_t length)
+{
+    const uint32_t clocks = read ? (9 * (3 + length) + 3) : (9 * (2 + length) + 2);
+    const int64_t timeNs  = 1000000000LL * clocks / clockSpeed_ + overheadUs_ * 1000LL;
+    stats_.transactions++;
+    if (read) {
+        stats_.reads++;
+        stats_.bytesRead += length;
+    }
+    else {
+        stats_.writes++;
+        stats_.bytesWritten += length;
+    }
+    stats_.busTimeNs += timeNs;
+    elapsedNs_ += timeNs;
+}
+
+esp_err_t VirtualBus::writeBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t data, int32_t timeout)
+{
+    uint8_t buffer;
+    esp_err_t err = readByte(devAddr, regAddr, &buffer, timeout);
+    if (err) return err;
+    buffer = data ? (buffer | (1 << bitNum)) : (buffer & ~(1 << bitNum));
+    return writeByte(devAddr, regAddr, buffer, timeout);
+}
+
+esp_err_t VirtualBus::writeBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t data,
+                                int32_t timeout)
+{
+    uint8_t buffer;
+    esp_err_t err = readByte(devAddr, regAddr, &buffer, timeout);
+    if (err) return err;
+    const uint8_t mask = ((1 << length) - 1) << (bitStart - length + 1);
+    data <<= (bitStart - length + 1);
+    data &= mask;
+    buffer &= ~mask;
+    buffer |= data;
+    return writeByte(devAddr, regAddr, buffer, timeout);
+}
+
+esp_err_t VirtualBus::writeByte(uint8_t devAddr, uint8_t regAddr, uint8_t data, int32_t timeout)
+{
+    return writeBytes(devAddr, regAddr, 1, &data, timeout);
+}
+
+esp_err_t VirtualBus::writeBytes(uint8_t devAddr, uint8_t regAddr, size_t length, const uint8_t* data,
+                                 int32_t timeout)
+{
+    const esp_err_t err = device_->write(devAddr, regAddr, length, data);
+    account(false, length);
+    return err;
+}
+
+esp_err_t VirtualBus::readBit(uint8_t devAddr, uint8_t regAddr, uint8_t bitNum, uint8_t* data, int32_t timeout)
+{
+    return readBits(devAddr, regAddr, bitNum, 1, data, timeout);
+}
+
+esp_err_t VirtualBus::readBits(uint8_t devAddr, uint8_t regAddr, uint8_t bitStart, uint8_t length, uint8_t* data,
+                               int32_t timeout)
+{
+    uint8_t buffer;
+    esp_err_t err = readByte(devAddr, regAddr, &buffer, timeout);
+    if (err) return err;
+    const uint8_t mask = ((1 << length) - 1) << (bitStart - length + 1);
+    buffer &= mask;
+    buffer >>= (bitStart - length + 1);
+    *data = buffer;
+    return err;
+}
+
+esp_err_t VirtualBus::readByte(uint8_t devAddr, uint8_t regAddr, uint8_t* data, int32_t timeout)
+{
+    return readBytes(devAddr, regAddr, 1, data, timeout);
+}
+
+esp_err_t VirtualBus::readBytes(uint8_t devAddr, uint8_t regAddr, size_t length, uint8_t* data, int32_t timeout)
+{
+    const esp_err_t err = device_->read(devAddr, regAddr, length, data);
+    account(true, length);
+    return err;
+}
+
+}  // namespace sim
+
+}  // namespace mpud
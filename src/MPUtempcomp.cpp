@@ -0,0 +1,222 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file MPUtempcomp.cpp
+ * Implement TempCompensation class.
+ */
+
+#include "mpu/tempcomp.hpp"
+#include <math.h>
+#include <string.h>
+#include "MPU.hpp"
+#include "esp_err.h"
+#include "mpu/math.hpp"
+#include "mpu/types.hpp"
+#include "sdkconfig.h"
+
+static const char* TAG = CONFIG_MPU_CHIP_MODEL;
+
+#include "mpu/log.hpp"
+
+/*! MPU Driver namespace */
+namespace mpud
+{
+/**
+ * @brief Construct an empty model (no compensation).
+ * @param refTemp Reference temperature of the polynomials [ºC], near the middle of the operating range.
+ */
+TempCompensation::TempCompensation(float refTemp)
+{
+    memset(&model, 0, sizeof(model));
+    model.refTemp = refTemp;
+    reset();
+}
+
+/**
+ * @brief Forget the recorded points, the model is kept until the next fit().
+ */
+void TempCompensation::reset()
+{
+    for (int s = 0; s < 2; s++) {
+        degree[s]  = -1;
+        count[s]   = 0;
+        minTemp[s] = INFINITY;
+        maxTemp[s] = -INFINITY;
+        memset(sumX[s], 0, sizeof(sumX[s]));
+        memset(sumY[s], 0, sizeof(sumY[s]));
+    }
+}
+
+/*! Record the gyro bias [º/s] measured at a temperature [ºC]. */
+void TempCompensation::addGyroPoint(float tempC, const float_axes_t& bias)
+{
+    addPoint(kGyro, tempC, bias);
+}
+
+/*! Record the accel bias [g] (gravity removed) measured at a temperature [ºC]. */
+void TempCompensation::addAccelPoint(float tempC, const float_axes_t& bias)
+{
+    addPoint(kAccel, tempC, bias);
+}
+
+/**
+ * @brief Fit the model to the recorded points, least squares. Sensors without points keep no bias.
+ * @return ESP_ERR_INVALID_STATE if no point was recorded.
+ */
+esp_err_t TempCompensation::fit()
+{
+    if (count[kGyro] == 0 && count[kAccel] == 0) return ESP_ERR_INVALID_STATE;
+    degree[kGyro]  = fitSensor(kGyro, model.gyro);
+    degree[kAccel] = fitSensor(kAccel, model.accel);
+    MPU_LOGD("temperature model fitted, gyro degree %d, accel degree %d", degree[kGyro], degree[kAccel]);
+    return ESP_OK;
+}
+
+/*! Return the polynomial degree of the last gyro fit, -1 if not fitted. */
+int TempCompensation::getGyroDegree()
+{
+    return degree[kGyro];
+}
+
+/*! Return the polynomial degree of the last accel fit, -1 if not fitted. */
+int TempCompensation::getAccelDegree()
+{
+    return degree[kAccel];
+}
+
+/*! Return the model, to be stored by the application. */
+const temp_model_t& TempCompensation::getModel()
+{
+    return model;
+}
+
+/*! Set a model stored before, instead of fitting. */
+void TempCompensation::setModel(const temp_model_t& model)
+{
+    this->model = model;
+}
+
+/*! Return the modeled gyro bias at a temperature [º/s]. */
+float_axes_t TempCompensation::gyroBias(float tempC)
+{
+    const float dT = tempC - model.refTemp;
+    return float_axes_t(evaluate(model.gyro[0], dT), evaluate(model.gyro[1], dT), evaluate(model.gyro[2], dT));
+}
+
+/*! Return the modeled accel bias at a temperature [g]. */
+float_axes_t TempCompensation::accelBias(float tempC)
+{
+    const float dT = tempC - model.refTemp;
+    return float_axes_t(evaluate(model.accel[0], dT), evaluate(model.accel[1], dT), evaluate(model.accel[2], dT));
+}
+
+/**
+ * @brief Remove the modeled biases from an array of samples, in place, at their mean temperature.
+ * The samples need the temperature (FIFO_CFG_TEMPERATURE).
+ */
+void TempCompensation::compensate(fifo_sample_t* samples, size_t count, accel_fs_t accelFS, gyro_fs_t gyroFS)
+{
+    if (count == 0) return;
+    int32_t tempSum = 0;
+    for (size_t i = 0; i < count; i++) tempSum += samples[i].temp;
+    int16_t accel[3], gyro[3];
+    offsets(math::tempCelsius((int16_t)(tempSum / (int32_t) count)), accelFS, gyroFS, accel, gyro);
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < 3; j++) {
+            samples[i].accel[j] = subtract(samples[i].accel[j], accel[j]);
+            samples[i].gyro[j]  = subtract(samples[i].gyro[j], gyro[j]);
+        }
+    }
+}
+
+void TempCompensation::addPoint(int sensor, float tempC, const float_axes_t& bias)
+{
+    // scaled to keep x^4 sums in a comfortable range
+    const double x = (tempC - model.refTemp) / 10.0;
+    double xk      = 1;
+    for (int k = 0; k <= 2 * kMaxDegree; k++, xk *= x) {
+        sumX[sensor][k] += xk;
+        if (k <= kMaxDegree) {
+            for (int i = 0; i < 3; i++) sumY[sensor][i][k] += bias[i] * xk;
+        }
+    }
+    count[sensor]++;
+    if (tempC < minTemp[sensor]) minTemp[sensor] = tempC;
+    if (tempC > maxTemp[sensor]) maxTemp[sensor] = tempC;
+}
+
+/**
+ * @brief Solve the normal equations of one sensor, the degree is limited by the number of points
+ * and the temperature span they cover.
+ * @return Degree fitted, -1 without points (coefficients zeroed).
+ */
+int TempCompensation::fitSensor(int sensor, float coeffs[3][3])
+{
+    memset(coeffs, 0, sizeof(float) * 3 * 3);
+    const uint32_t n = count[sensor];
+    if (n == 0) return -1;
+    const float span = maxTemp[sensor] - minTemp[sensor];
+    int deg          = (span >= kQuadraticSpan && n >= 3) ? 2 : (span >= kLinearSpan && n >= 2) ? 1 : 0;
+    for (; deg >= 0; deg--) {
+        const int size = deg + 1;
+        double a[3][3 + 3];  // [A | y_x y_y y_z]
+        for (int r = 0; r < size; r++) {
+            for (int c = 0; c < size; c++) a[r][c] = sumX[sensor][r + c];
+            for (int i = 0; i < 3; i++) a[r][size + i] = sumY[sensor][i][r];
+        }
+        // Gauss-Jordan with partial pivoting, falls back to a lower degree if singular
+        bool singular = false;
+        for (int p = 0; p < size && !singular; p++) {
+            int best = p;
+            for (int r = p + 1; r < size; r++) {
+                if (fabs(a[r][p]) > fabs(a[best][p])) best = r;
+            }
+            if (fabs(a[best][p]) < 1e-9 * n) {
+                singular = true;
+                break;
+            }
+            if (best != p) {
+                for (int c = 0; c < size + 3; c++) {
+                    const double t = a[p][c];
+                    a[p][c]        = a[best][c];
+                    a[best][c]     = t;
+                }
+            }
+            for (int r = 0; r < size; r++) {
+                if (r == p) continue;
+                const double f = a[r][p] / a[p][p];
+                for (int c = p; c < size + 3; c++) a[r][c] -= f * a[p][c];
+            }
+        }
+        if (singular) continue;
+        for (int i = 0; i < 3; i++) {
+            double scale = 1;  // back from x = dT / 10 to dT
+            for (int k = 0; k < size; k++, scale /= 10) coeffs[i][k] = a[k][size + i] / a[k][k] * scale;
+        }
+        return deg;
+    }
+    return -1;
+}
+
+/*! Return the raw offsets of both sensors at a temperature, in the given full-scale ranges. */
+void TempCompensation::offsets(float tempC, accel_fs_t accelFS, gyro_fs_t gyroFS, int16_t accel[3], int16_t gyro[3])
+{
+    const float dT       = tempC - model.refTemp;
+    const float accelLSB = math::accelSensitivity(accelFS);
+    const float gyroLSB  = math::gyroSensitivity(gyroFS);
+    for (int i = 0; i < 3; i++) {
+        accel[i] = (int16_t) lroundf(evaluate(model.accel[i], dT) * accelLSB);
+        gyro[i]  = (int16_t) lroundf(evaluate(model.gyro[i], dT) * gyroLSB);
+    }
+}
+
+float TempCompensation::evaluate(const float coeffs[3], float dT)
+{
+    return coeffs[0] + dT * (coeffs[1] + dT * coeffs[2]);
+}
+
+}  // namespace mpud
@@ -0,0 +1,1362 @@
+// =========================================================================
+// This library is placed under the MIT License
+// Copyright 2017-2018 Natanael Josue Rabello. All rights reserved.
+// For the license information refer to LICENSE file in root directory.
+// =========================================================================
+
+/**
+ * @file mpu_bench.cpp
+ * Run MPU driver hot paths against the virtual device and report, per sample:
+ * bus transactions, bytes transferred, I2C bus time and host CPU time
+ * (CPU time includes the device model). Exits with failure if a sanity check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "MPU.hpp"
+#include "esp_timer.h"
+#include "mpu/ahrs.hpp"
+#include "mpu/batch.hpp"
+#include "mpu/bias.hpp"
+#include "mpu/calibration.hpp"
+#include "mpu/ekf.hpp"
+#include "mpu/fifo.hpp"
+#include "mpu/math.hpp"
+#include "mpu/registers.hpp"
+#include "mpu/ring.hpp"
+#include "mpu/sim.hpp"
+#include "mpu/tempcomp.hpp"
+#include "mpu/types.hpp"
+#include "mpu/vector.hpp"
+#include "port.hpp"
+
+using namespace mpud;
+
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* expr, int line)
+{
+    if (ok) return;
+    printf("FAIL (line %d): %s\n", line, expr);
+    failures++;
+}
+
+/**
+ * Call `fn(i)` for `calls` times, `fn` returns the number of samples it handled.
+ * Report traffic and time per sample.
+ */
+template <typename F>
+static void measure(const char* name, int calls, F fn)
+{
+    sim::vbus0.resetStats();
+    const int64_t simStart = esp_timer_get_time();
+    const auto cpuStart    = std::chrono::steady_clock::now();
+    long samples           = 0;
+    for (int i = 0; i < calls; i++) samples += fn(i);
+    const auto cpuEnd = std::chrono::steady_clock::now();
+    const double cpuNs = std::chrono::duration_cast<std::chrono::nanoseconds>(cpuEnd - cpuStart).count();
+    const double simMs = (esp_timer_get_time() - simStart) / 1000.0;
+    const sim::bus_stats_t& stats = sim::vbus0.stats();
+    const double n                = samples > 0 ? samples : 1;
+    printf("%-26s %7ld %9.2f %9.1f %10.1f %10.1f %11.0f\n", name, samples, stats.transactions / n,
+           (stats.bytesRead + stats.bytesWritten) / n, stats.busTimeNs / 1000.0 / n, simMs, cpuNs / n);
+}
+
+/* Best time of 5 runs of `fn()` [ns per call] */
+template <typename F>
+static double bestOfNs(F fn)
+{
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int rep = 0; rep < 200; rep++) {
+            fn();
+            asm volatile("" ::: "memory");  // each call must run
+        }
+        const auto end  = std::chrono::steady_clock::now();
+        const double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / 200.0;
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+/* FIFO packet decode with per-field shifts and layout checks, as done before the batch kernel */
+static void referenceDecode(const fifo_layout_t& layout, const uint8_t* packet, fifo_sample_t* sample)
+{
+    auto word = [packet](int offset) { return (int16_t)(packet[offset] << 8 | packet[offset + 1]); };
+    for (int i = 0; i < 3; i++) {
+        sample->accel[i] = (layout.accel >= 0) ? word(layout.accel + 2 * i) : 0;
+        sample->gyro[i]  = (layout.gyro[i] >= 0) ? word(layout.gyro[i]) : 0;
+#if defined CONFIG_MPU_AK89xx
+        const int m    = layout.mag + 2 * i;
+        sample->mag[i] = (layout.mag >= 0) ? (int16_t)(packet[m + 1] << 8 | packet[m]) : 0;
+#endif
+    }
+    sample->temp      = (layout.temp >= 0) ? word(layout.temp) : 0;
+    sample->timestamp = 0;
+}
+
+/* Advance time to the next sample, as if waiting for the data-ready interrupt */
+static void waitDataReady()
+{
+    hostAdvanceTime(sim::mpu0.nextSampleUs() - esp_timer_get_time());
+}
+
+int main()
+{
+    MPU_t MPU;
+    printf("%s on virtual I2C bus @ 400 kHz\n", CONFIG_MPU_CHIP_MODEL);
+    printf("%-26s %7s %9s %9s %10s %10s %11s\n", "operation", "samples", "trans/smp", "bytes/smp", "bus us/smp",
+           "sim ms", "cpu ns/smp");
+
+    CHECK(MPU.testConnection() == ESP_OK);
+    measure("initialize()", 1, [&](int) {
+        CHECK(MPU.initialize() == ESP_OK);
+        return 1;
+    });
+    CHECK(MPU.setSampleRate(1000) == ESP_OK);
+
+    // register reads, one per sample at 1 kHz
+    measure("sensors()", 1000, [&](int) {
+        hostAdvanceTime(1000);
+        sensors_t sensors;
+        CHECK(MPU.sensors(&sensors) == ESP_OK);
+        CHECK(abs(sensors.accel.z - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        return 1;
+    });
+    // data-ready interrupt loop, check status then read sensors
+    measure("getInterruptStatus+sensors()", 1000, [&](int) {
+        waitDataReady();
+        sensors_t sensors;
+        const int_stat_t status = MPU.getInterruptStatus();
+        CHECK(status & INT_STAT_RAWDATA_READY);
+        CHECK(MPU.sensors(&sensors) == ESP_OK);
+        return 1;
+    });
+    measure("sensorsWithStatus()", 1000, [&](int) {
+        waitDataReady();
+        sensors_t sensors;
+        int_stat_t status = 0;
+        CHECK(MPU.sensorsWithStatus(&sensors, &status) == ESP_OK);
+        CHECK(status & INT_STAT_RAWDATA_READY);
+        CHECK(abs(sensors.accel.z - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        return 1;
+    });
+    {
+        // same sample through both paths, sampling stops while asleep
+        sensors_t a, b;
+        int_stat_t status;
+        CHECK(MPU.setSleep(true) == ESP_OK);
+        CHECK(MPU.sensorsWithStatus(&a, &status) == ESP_OK);
+        CHECK(MPU.sensors(&b) == ESP_OK);
+        CHECK(MPU.setSleep(false) == ESP_OK);
+        CHECK(a.accel.x == b.accel.x && a.accel.z == b.accel.z && a.temp == b.temp && a.gyro.z == b.gyro.z);
+#if defined CONFIG_MPU_AK89xx
+        CHECK(a.mag.x == b.mag.x && a.mag.y == b.mag.y && a.mag.z == b.mag.z);
+#endif
+    }
+    measure("motion()", 1000, [&](int) {
+        hostAdvanceTime(1000);
+        raw_axes_t accel, gyro;
+        CHECK(MPU.motion(&accel, &gyro) == ESP_OK);
+        return 1;
+    });
+
+    // FIFO, count-then-read one packet at a time, as in examples/mpu_real
+    constexpr uint16_t kPacketSize = 12;
+    CHECK(MPU.setFIFOConfig(FIFO_CFG_ACCEL | FIFO_CFG_GYRO) == ESP_OK);
+    CHECK(MPU.setFIFOEnabled(true) == ESP_OK);
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    measure("getFIFOCount+readFIFO()", 1000, [&](int) {
+        hostAdvanceTime(1000);
+        uint8_t buffer[kPacketSize];
+        int packets    = 0;
+        uint16_t count = MPU.getFIFOCount();
+        for (; count >= kPacketSize; count -= kPacketSize, packets++) {
+            CHECK(MPU.readFIFO(kPacketSize, buffer) == ESP_OK);
+            const int16_t accelZ = buffer[4] << 8 | buffer[5];
+            CHECK(abs(accelZ - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        }
+        return packets;
+    });
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    measure("readFIFOWithCount()", 1000, [&](int) {
+        waitDataReady();
+        uint8_t buffer[kPacketSize + 2];
+        uint16_t count = 0;
+        CHECK(MPU.readFIFOWithCount(kPacketSize, buffer, &count) == ESP_OK);
+        CHECK(count == kPacketSize);
+        const int16_t accelZ = buffer[4] << 8 | buffer[5];
+        CHECK(abs(accelZ - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        return count / kPacketSize;
+    });
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    measure("readFIFOPackets(), 10 ms", 100, [&](int) {
+        constexpr size_t kMaxPackets = 16;
+        hostAdvanceTime(10000);
+        uint8_t buffer[kMaxPackets * kPacketSize + 2];
+        size_t packets;
+        CHECK(MPU.readFIFOPackets(kPacketSize, kMaxPackets, buffer, &packets) == ESP_OK);
+        CHECK(packets >= 9 && packets <= kMaxPackets);
+        for (size_t i = 0; i < packets; i++) {
+            const int16_t accelZ = buffer[i * kPacketSize + 4] << 8 | buffer[i * kPacketSize + 5];
+            CHECK(abs(accelZ - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        }
+        return packets;
+    });
+    // a packet written while a burst reads past the count loses its head, the tail is skipped next
+    {
+        uint8_t buffer[4 * kPacketSize + 2];
+        size_t packets;
+        do {  // drained, the last read went past the count
+            CHECK(MPU.readFIFOPackets(kPacketSize, 4, buffer, &packets) == ESP_OK);
+        } while (packets > 0);
+        hostAdvanceTime(3000);
+        CHECK(MPU.readFIFO(5, buffer) == ESP_OK);  // taken by the speculative read
+        CHECK(MPU.readFIFOPackets(kPacketSize, 4, buffer, &packets) == ESP_OK && packets >= 1);
+        for (size_t i = 0; i < packets; i++) {
+            const int16_t accelZ = buffer[i * kPacketSize + 4] << 8 | buffer[i * kPacketSize + 5];
+            CHECK(abs(accelZ - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        }
+    }
+    // FIFOReader, packet size from the FIFO configuration, batches decoded
+    FIFOReader fifo(MPU);
+    CHECK(fifo.begin() == ESP_OK);
+    CHECK(fifo.getPacketSize() == kPacketSize);
+    CHECK(fifo.getLayout().accel == 0 && fifo.getLayout().temp == -1 && fifo.getLayout().gyro[2] == 10);
+    auto drain = [&](int) {
+        constexpr size_t kMaxSamples = 32;
+        hostAdvanceTime(10000);
+        fifo_sample_t samples[kMaxSamples];
+        size_t count;
+        CHECK(fifo.read(samples, kMaxSamples, &count) == ESP_OK);
+        CHECK(count >= 8 && count <= 16);
+        for (size_t i = 0; i < count; i++) {
+            CHECK(abs(samples[i].accel.z - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+            CHECK(abs(samples[i].gyro.x) < 400);
+        }
+        return count;
+    };
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    measure("FIFOReader::read(), 10 ms", 100, drain);
+    {
+        fifo_sample_t samples[16];
+        size_t count;
+        do {
+            CHECK(fifo.read(samples, 16, &count) == ESP_OK);
+        } while (count > 0);
+        hostAdvanceTime(3000);
+        uint8_t head[5];
+        CHECK(MPU.readFIFO(sizeof(head), head) == ESP_OK);  // taken by the speculative read
+        const uint32_t overflows = fifo.getOverflowCount();
+        CHECK(fifo.read(samples, 16, &count) == ESP_OK && count >= 1);
+        CHECK(fifo.getLostSamples() == 1 && fifo.getOverflowCount() == overflows);
+        for (size_t i = 0; i < count; i++) {
+            CHECK(abs(samples[i].accel.z - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+        }
+    }
+    // bus with a small maximum transfer, packets split across reads
+    fifo.setMaxBurstLength(32);
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    fifo.clear();
+    measure("FIFOReader::read(), 32 B max", 100, drain);
+    fifo.setMaxBurstLength(0);
+    // all sensors, packet size changes with the configuration
+    CHECK(MPU.setFIFOConfig(FIFO_CFG_ACCEL | FIFO_CFG_TEMPERATURE | FIFO_CFG_GYRO) == ESP_OK);
+    CHECK(fifo.begin() == ESP_OK);
+    CHECK(fifo.getPacketSize() == 14);
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    measure("FIFOReader::read(), +temp", 100, drain);
+    CHECK(MPU.setFIFOConfig(FIFO_CFG_GYRO) == ESP_OK);
+    CHECK(fifo.begin() == ESP_OK);
+    CHECK(fifo.getPacketSize() == 6 && fifo.getLayout().accel == -1 && fifo.getLayout().gyro[0] == 0);
+    CHECK(MPU.setFIFOConfig(FIFO_CFG_NONE) == ESP_OK);
+    CHECK(fifo.begin() == ESP_OK);
+    size_t none;
+    CHECK(fifo.read(nullptr, 1, &none) == ESP_ERR_INVALID_STATE);
+
+    // overflow recovery, stalls of 50 ms and 300 ms while polling every 10 ms, FIFO holds ~85 packets
+    // of 12 bytes (misaligned after overflow) or 128 packets of 8 bytes (aligned, detected when full)
+    const fifo_config_t kConfigs[] = {FIFO_CFG_ACCEL | FIFO_CFG_GYRO, FIFO_CFG_ACCEL | FIFO_CFG_TEMPERATURE};
+    const fifo_mode_t kModes[]     = {FIFO_MODE_OVERWRITE, FIFO_MODE_STOP_FULL};
+    for (fifo_config_t config : kConfigs) {
+        for (fifo_mode_t mode : kModes) {
+            CHECK(MPU.setFIFOConfig(config) == ESP_OK);
+            CHECK(MPU.setFIFOMode(mode) == ESP_OK);
+            CHECK(fifo.begin() == ESP_OK);
+            sim::mpu0.nextSampleUs();
+            const uint32_t firstSample = sim::mpu0.sampleCount();
+            CHECK(MPU.resetFIFO() == ESP_OK);
+            fifo.clear();
+            long delivered = 0, lost = 0, resetLost = 0;
+            for (int i = 0; i < 30; i++) {
+                constexpr size_t kMaxSamples = 160;
+                const int64_t stallUs        = (i == 10) ? 50000 : (i == 20) ? 300000 : 10000;
+                hostAdvanceTime(stallUs);
+                fifo_sample_t samples[kMaxSamples];
+                size_t count;
+                CHECK(fifo.read(samples, kMaxSamples, &count) == ESP_OK);
+                for (size_t j = 0; j < count; j++) {
+                    CHECK(abs(samples[j].accel.z - math::accelSensitivity(ACCEL_FS_4G)) < 400);
+                }
+                delivered += count;
+                lost += fifo.getLostSamples();
+                // resetting the FIFO on overflow would drop the samples read as well
+                if (fifo.getLostSamples() > 0) resetLost += fifo.getLostSamples() + count;
+                if (i == 10) CHECK(fifo.getLostSamples() == 0);
+                if (i == 20) CHECK(fifo.getLostSamples() > 0 && count > 0);
+            }
+            CHECK(MPU.setFIFOEnabled(false) == ESP_OK);
+            const long left = (MPU.getFIFOCount() + fifo.getPending()) / fifo.getPacketSize();
+            const long produced = sim::mpu0.sampleCount() - firstSample;
+            CHECK(fifo.getOverflowCount() == 1);
+            // lost samples are estimated from time, rounded at both ends
+            CHECK(abs(delivered + lost + left - produced) <= 2);
+            printf("  overflow, %2zu B %s: %4ld sampled, %4ld lost, %4ld lost with resetFIFO()\n",
+                   fifo.getPacketSize(), mode == FIFO_MODE_OVERWRITE ? "overwrite" : "stop-full", produced, lost,
+                   resetLost);
+            CHECK(MPU.setFIFOEnabled(true) == ESP_OK);
+        }
+    }
+    CHECK(MPU.setFIFOMode(FIFO_MODE_OVERWRITE) == ESP_OK);
+
+    // timestamps, MPU clock 1500 ppm fast, polled every 10~13 ms or read at each data-ready interrupt
+    sim::mpu0.scene().clockDrift = 1500;
+    const double truePeriodUs    = 1000.0 * 1e6 / (1e6 + sim::mpu0.scene().clockDrift);
+    CHECK(MPU.setFIFOConfig(FIFO_CFG_ACCEL | FIFO_CFG_GYRO) == ESP_OK);
+    CHECK(fifo.begin() == ESP_OK);
+    for (int interrupt = 0; interrupt < 2; interrupt++) {
+        CHECK(MPU.resetFIFO() == ESP_OK);
+        fifo.clear();
+        double maxError = 0, maxStep = 0;
+        auto timestamps = [&](int i) {
+            constexpr size_t kMaxSamples = 32;
+            if (interrupt)
+                waitDataReady();
+            else
+                hostAdvanceTime(10000 + (i * 7919) % 3000);
+            const double newestUs = sim::mpu0.nextSampleUs() - truePeriodUs;
+            fifo_sample_t samples[kMaxSamples];
+            size_t count;
+            CHECK(fifo.read(samples, kMaxSamples, &count, 0, interrupt ? esp_timer_get_time() : 0) == ESP_OK);
+            CHECK(count > 0 && fifo.getLostSamples() == 0);
+            if (count == 0 || i < 200) return count;
+            // after convergence
+            const double error = samples[count - 1].timestamp - newestUs;
+            if (abs(error) > maxError) maxError = abs(error);
+            for (size_t j = 1; j < count; j++) {
+                const double step = samples[j].timestamp - samples[j - 1].timestamp - truePeriodUs;
+                if (abs(step) > maxStep) maxStep = abs(step);
+            }
+            return count;
+        };
+        measure(interrupt ? "FIFOReader, data-ready" : "FIFOReader, 10~13 ms", interrupt ? 4000 : 1000, timestamps);
+        printf("  timestamps: drift %+.0f ppm (true %+d), newest sample error %.1f us, step error %.1f us\n",
+               fifo.getClockDrift(), sim::mpu0.scene().clockDrift, maxError, maxStep);
+        CHECK(abs(fifo.getClockDrift() - sim::mpu0.scene().clockDrift) < (interrupt ? 5 : 50));
+        CHECK(maxError < (interrupt ? 2 : 150));
+    }
+    sim::mpu0.scene().clockDrift = 0;
+
+    // batching, wake on watermark instead of every data-ready interrupt, 1 kHz for 2 s
+    const size_t kWatermarks[] = {8, 32, 0};  // 0: maximum
+    for (size_t watermark : kWatermarks) {
+        if (watermark == 0) watermark = fifo.getMaxWatermark();
+        CHECK(fifo.setWatermark(watermark) == ESP_OK);
+        CHECK(MPU.resetFIFO() == ESP_OK);
+        fifo.clear();
+        int wakeups = 0;
+        double maxLatencyUs = 0;
+        char name[32];
+        snprintf(name, sizeof(name), "readBatch(), watermark %u", (unsigned) watermark);
+        const int64_t start = esp_timer_get_time();
+        measure(name, 2000 / watermark, [&](int) {
+            constexpr size_t kMaxSamples = 256;
+            fifo_sample_t samples[kMaxSamples];
+            size_t count;
+            CHECK(fifo.readBatch(samples, kMaxSamples, &count) == ESP_OK);
+            CHECK(count >= watermark && fifo.getLostSamples() == 0);
+            wakeups++;
+            if (count > 0 && esp_timer_get_time() - samples[0].timestamp > maxLatencyUs) {
+                maxLatencyUs = esp_timer_get_time() - samples[0].timestamp;
+            }
+            return count;
+        });
+        printf("  %.0f wake-ups/s, oldest sample latency max %.1f ms\n",
+               wakeups * 1e6 / (esp_timer_get_time() - start), maxLatencyUs / 1000);
+    }
+    CHECK(fifo.setWatermark(fifo.getMaxWatermark() + 1) == ESP_ERR_INVALID_SIZE);
+#if defined CONFIG_MPU6500
+    CHECK(MPU.setFIFOSize(FIFO_SIZE_4K) == ESP_OK);
+    CHECK(fifo.begin() == ESP_OK);
+    CHECK(fifo.getMaxWatermark() == 4096 * 3 / 4 / 12);
+    CHECK(MPU.setFIFOSize(FIFO_SIZE_1K) == ESP_OK);
+#endif
+
+    // sample ring, reader producing every 3 ms, consumer draining every 5th read in batches of 7,
+    // so the free space of the ring wraps at varying positions
+    {
+        static SampleRing<64> ring;
+        CHECK(fifo.begin() == ESP_OK);
+        CHECK(MPU.resetFIFO() == ESP_OK);
+        fifo.clear();
+        long produced = 0, consumed = 0;
+        int64_t prevTimestamp = 0;
+        double maxStep        = 0;
+        measure("FIFOReader -> SampleRing", 1000, [&](int i) {
+            hostAdvanceTime(3000);
+            size_t count;
+            CHECK(fifo.read(ring, &count) == ESP_OK);
+            CHECK(fifo.getLostSamples() == 0);
+            produced += count;
+            if (i % 5 != 4) return count;
+            fifo_sample_t batch[7];
+            while (size_t n = ring.pop(batch, 7)) {
+                for (size_t j = 0; j < n; j++) {
+                    if (i >= 200 && abs(batch[j].timestamp - prevTimestamp - 1000) > maxStep) {
+                        maxStep = abs(batch[j].timestamp - prevTimestamp - 1000);
+                    }
+                    prevTimestamp = batch[j].timestamp;
+                }
+                consumed += n;
+            }
+            return count;
+        });
+        printf("  ring: %ld produced, %ld consumed, timestamp step error max %.1f us\n", produced, consumed, maxStep);
+        CHECK(produced == consumed && ring.size() == 0 && ring.getDropped() == 0);
+        CHECK(maxStep < 20);
+    }
+
+    // sample ring across threads, sequence must arrive intact (yield when full / empty, the host may have a single core)
+    {
+        static SPSCRing<uint32_t, 1024> ring;
+        constexpr uint32_t kItems = 4000000;
+        const auto cpuStart       = std::chrono::steady_clock::now();
+        std::thread producer([] {
+            uint32_t next = 0;
+            while (next < kItems) {
+                size_t room;
+                uint32_t* dest = ring.prepare(&room);
+                if (room == 0) std::this_thread::yield();
+                if (room > 16) room = 16;
+                for (size_t i = 0; i < room; i++) dest[i] = next++;
+                ring.commit(room);
+            }
+        });
+        uint32_t expected = 0, errors = 0;
+        while (expected < kItems) {
+            uint32_t batch[32];
+            const size_t n = ring.pop(batch, 32);
+            if (n == 0) std::this_thread::yield();
+            for (size_t i = 0; i < n; i++) {
+                if (batch[i] != expected) errors++;
+                expected = batch[i] + 1;
+            }
+        }
+        producer.join();
+        const double cpuNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - cpuStart).count();
+        printf("SPSCRing, 2 threads         %u items, %.1f ns/item, %u sequence errors\n", kItems, cpuNs / kItems,
+               errors);
+        CHECK(errors == 0 && ring.size() == 0);
+    }
+
+    // decode throughput, a full 4 kB FIFO of accel + temp + gyro (+ compass) packets, batch kernel
+    // against the per-packet reference; then other layouts (generic path, odd packet size) for equality
+    {
+#if defined CONFIG_MPU_AK89xx
+        const fifo_config_t kFull = FIFO_CFG_ACCEL | FIFO_CFG_TEMPERATURE | FIFO_CFG_GYRO | FIFO_CFG_COMPASS;
+#else
+        const fifo_config_t kFull = FIFO_CFG_ACCEL | FIFO_CFG_TEMPERATURE | FIFO_CFG_GYRO;
+#endif
+        const fifo_config_t kConfigs[] = {kFull, FIFO_CFG_ACCEL | FIFO_CFG_GYRO,
+                                          FIFO_CFG_TEMPERATURE | (1 << regs::FIFO_YGYRO_EN_BIT),
+                                          FIFO_CFG_ACCEL | FIFO_CFG_SLAVE1};
+        const uint8_t slaveLength[4] = {8, 3, 0, 0};
+        static uint8_t raw[4096];
+        static fifo_sample_t expected[4096 / 2], decoded[4096 / 2];
+        static SampleBatch<4096 / 2> columns;
+        for (size_t i = 0; i < sizeof(raw); i++) raw[i] = (uint8_t)(i * 131 + 7);
+        int mismatches = 0;
+        for (fifo_config_t config : kConfigs) {
+            CHECK(fifo.begin(config, slaveLength) == ESP_OK);
+            const fifo_layout_t& layout = fifo.getLayout();
+            const size_t ps             = fifo.getPacketSize();
+            const size_t packets        = sizeof(raw) / ps;
+            if (config == kFull) {
+                const double refNs = bestOfNs([&] {
+                    for (size_t i = 0; i < packets; i++) referenceDecode(layout, raw + i * ps, &expected[i]);
+                });
+                const double batchNs = bestOfNs([&] { fifo.decode(raw, packets, decoded); });
+                printf("decode, %2u B packets: reference %.2f ns/sample, batch %.2f ns/sample\n", (unsigned) ps,
+                       refNs / packets, batchNs / packets);
+            }
+            for (size_t i = 0; i < packets; i++) referenceDecode(layout, raw + i * ps, &expected[i]);
+            fifo.decode(raw, packets, decoded);
+            fifo.decode(raw, packets, columns.columns());
+            for (size_t i = 0; i < packets; i++) {
+                fifo_sample_t single;
+                fifo.decode(raw + i * ps, &single);
+                for (int j = 0; j < 3; j++) {
+                    mismatches += expected[i].accel[j] != decoded[i].accel[j] || single.accel[j] != decoded[i].accel[j];
+                    mismatches += expected[i].gyro[j] != decoded[i].gyro[j] || single.gyro[j] != decoded[i].gyro[j];
+#if defined CONFIG_MPU_AK89xx
+                    mismatches += expected[i].mag[j] != decoded[i].mag[j] || single.mag[j] != decoded[i].mag[j];
+#endif
+                }
+                mismatches += expected[i].temp != decoded[i].temp || single.temp != decoded[i].temp;
+                fifo_sample_t soa = columns.sample(i);
+                for (int j = 0; j < 3; j++) {
+                    mismatches += soa.accel[j] != decoded[i].accel[j] || soa.gyro[j] != decoded[i].gyro[j];
+#if defined CONFIG_MPU_AK89xx
+                    mismatches += soa.mag[j] != decoded[i].mag[j];
+#endif
+                }
+                mismatches += soa.temp != decoded[i].temp;
+            }
+        }
+        CHECK(mismatches == 0);
+        CHECK(fifo.begin() == ESP_OK);
+    }
+
+    // structure of arrays, drain a 3/4 full FIFO into a batch, then a per-sample pass over the batch
+    // (accel norm squared and gyro sum) against the same pass over structs
+    {
+        static SampleBatch<512> batch;
+        static fifo_sample_t samples[512];
+        CHECK(MPU.setFIFOConfig(FIFO_CFG_ACCEL | FIFO_CFG_GYRO) == ESP_OK);
+        CHECK(fifo.begin() == ESP_OK);
+        CHECK(MPU.resetFIFO() == ESP_OK);
+        fifo.clear();
+        batch.clear();
+        size_t count = 0;
+        hostAdvanceTime(1024 * 3 / 4 / 12 * 1000);
+        measure("FIFOReader -> SampleBatch", 1, [&](int) {
+            CHECK(fifo.read(batch, &count) == ESP_OK);
+            return count;
+        });
+        CHECK(count > 50 && batch.count == count && fifo.getLostSamples() == 0);
+        bool ordered = true;
+        for (size_t i = 1; i < batch.count; i++) ordered &= batch.timestamp[i] > batch.timestamp[i - 1];
+        CHECK(ordered);
+        // fill the rest with copies, full batch for the pass
+        for (size_t i = batch.count; i < batch.capacity(); i++) {
+            for (int j = 0; j < 3; j++) {
+                batch.accel[j][i] = batch.accel[j][i % count];
+                batch.gyro[j][i]  = batch.gyro[j][i % count];
+            }
+        }
+        batch.count = batch.capacity();
+        for (size_t i = 0; i < batch.count; i++) samples[i] = batch.sample(i);
+        static float normSoA[512], normAoS[512];
+        static int32_t gyroSoA[512], gyroAoS[512];
+        // full batch, trip count known at compile time
+        const double aosNs = bestOfNs([&] {
+            for (size_t i = 0; i < batch.capacity(); i++) {
+                const raw_axes_t& a = samples[i].accel;
+                const raw_axes_t& g = samples[i].gyro;
+                normAoS[i] = (float) a.x * a.x + (float) a.y * a.y + (float) a.z * a.z;
+                gyroAoS[i] = g.x + g.y + g.z;
+            }
+        });
+        const double soaNs = bestOfNs([&] {
+            const int16_t *ax = batch.accel[0], *ay = batch.accel[1], *az = batch.accel[2];
+            const int16_t *gx = batch.gyro[0], *gy = batch.gyro[1], *gz = batch.gyro[2];
+            for (size_t i = 0; i < batch.capacity(); i++) {
+                normSoA[i] = (float) ax[i] * ax[i] + (float) ay[i] * ay[i] + (float) az[i] * az[i];
+                gyroSoA[i] = gx[i] + gy[i] + gz[i];
+            }
+        });
+        printf("  per-sample pass over %u samples: structs %.2f ns/sample, arrays %.2f ns/sample\n",
+               (unsigned) batch.count, aosNs / batch.count, soaNs / batch.count);
+        CHECK(memcmp(normSoA, normAoS, sizeof(normSoA)) == 0 && memcmp(gyroSoA, gyroAoS, sizeof(gyroSoA)) == 0);
+
+        // unit conversion, per-sample API against batch conversion of the columns with precomputed scales
+        static float_axes_t accelG[512], gyroRad[512];
+        static float accelCols[3][512], gyroCols[3][512];
+        const accel_fs_t accelFS = ACCEL_FS_4G;
+        const gyro_fs_t gyroFS   = GYRO_FS_500DPS;
+        const double perSampleNs = bestOfNs([&] {
+            for (size_t i = 0; i < batch.count; i++) {
+                accelG[i]  = math::accelGravity(samples[i].accel, accelFS);
+                gyroRad[i] = math::gyroRadPerSec(samples[i].gyro, gyroFS);
+            }
+        });
+        const scale_t scale = math::makeScale(accelFS, gyroFS);
+        const double batchNs = bestOfNs([&] {
+            for (int j = 0; j < 3; j++) {
+                math::accelGravity(batch.accel[j], batch.count, scale, accelCols[j]);
+                math::gyroRadPerSec(batch.gyro[j], batch.count, scale, gyroCols[j]);
+            }
+        });
+        printf("  unit conversion: per sample %.2f ns/sample, batch %.2f ns/sample\n", perSampleNs / batch.count,
+               batchNs / batch.count);
+        double maxError = 0;
+        for (size_t i = 0; i < batch.count; i++) {
+            for (int j = 0; j < 3; j++) {
+                const double g   = batch.accel[j][i] * (4.0 / INT16_MAX);
+                const double rad = batch.gyro[j][i] * (500.0 / INT16_MAX) * M_PI / 180;
+                const double e[] = {accelCols[j][i] - g, accelG[i][j] - g, gyroCols[j][i] - rad, gyroRad[i][j] - rad};
+                for (double x : e) maxError = fmax(maxError, fabs(x));
+            }
+        }
+        CHECK(maxError < 1e-5);
+
+        // fixed-point conversion of the same columns
+        static math::fixed::q16_t accelQ16[3][512], gyroQ16[3][512];
+        const math::fixed::scale_t scaleQ16 = math::fixed::makeScale(accelFS, gyroFS);
+        const double fixedNs = bestOfNs([&] {
+            for (int j = 0; j < 3; j++) {
+                math::fixed::accelGravity(batch.accel[j], batch.count, scaleQ16, accelQ16[j]);
+                math::fixed::gyroRadPerSec(batch.gyro[j], batch.count, scaleQ16, gyroQ16[j]);
+            }
+        });
+        printf("  unit conversion: batch Q16.16 %.2f ns/sample\n", fixedNs / batch.count);
+    }
+    CHECK(MPU.setFIFOEnabled(false) == ESP_OK);
+
+    // fixed-point accuracy, every raw value and full-scale, against the exact value and the float path
+    {
+        using math::fixed::q16_t;
+        const double lsb = 1.0 / math::fixed::kQ16One;
+        double maxExact = 0, maxFloat = 0;
+        auto compare = [&](q16_t q, float f, double exact) {
+            maxExact = fmax(maxExact, fabs(q * lsb - exact));
+            maxFloat = fmax(maxFloat, fabs(q * lsb - f));
+        };
+        for (int32_t raw = INT16_MIN; raw <= INT16_MAX; raw++) {
+            for (int fs = 0; fs < 4; fs++) {
+                const accel_fs_t afs = (accel_fs_t) fs;
+                const gyro_fs_t gfs  = (gyro_fs_t) fs;
+                const double dps     = raw * (double) math::gyroFSRvalue(gfs) / INT16_MAX;
+                compare(math::fixed::accelGravity(raw, afs), math::accelGravity(raw, afs),
+                        raw * (double) math::accelFSRvalue(afs) / INT16_MAX);
+                compare(math::fixed::gyroDegPerSec(raw, gfs), math::gyroDegPerSec(raw, gfs), dps);
+                compare(math::fixed::gyroRadPerSec(raw, gfs), math::gyroRadPerSec(raw, gfs), dps * M_PI / 180);
+            }
+            const double celsius = (raw - math::kRoomTempOffset) * 98.67 / INT16_MAX + math::kCelsiusOffset;
+            compare(math::fixed::tempCelsius(raw), math::tempCelsius(raw), celsius);
+            compare(math::fixed::tempFahrenheit(raw), math::tempFahrenheit(raw), celsius * 1.8 + 32);
+        }
+        printf("  Q16.16 conversion max error: exact %.2f LSB, float path %.2f LSB\n", maxExact / lsb, maxFloat / lsb);
+        CHECK(maxExact <= lsb);
+        // float path error grows with the magnitude (24-bit mantissa, 2000 º/s and 100+ ºF)
+        CHECK(maxFloat <= 16 * lsb);
+#if defined CONFIG_MPU_AK89xx
+        int magMismatch = 0, magDiff = 0;
+        for (int32_t raw = -4912 * 2; raw <= 4912 * 2; raw++) {
+            for (int adj = 0; adj < 256; adj++) {
+                const int exact = (int) trunc(raw * (adj + 128) / 256.0);
+                if (math::fixed::magAdjust(raw, adj) != exact) magMismatch++;
+                const int diff = abs(math::magAdjust(raw, adj) - exact);
+                if (diff > magDiff) magDiff = diff;
+            }
+        }
+        CHECK(magMismatch == 0 && magDiff <= 1);
+#endif
+    }
+
+    // vector math: fast approximations against libm, quaternion conversions against each other
+    {
+        double invSqrtError = 0, atanError = 0;
+        for (uint32_t bits = 0x1e000000; bits < 0x61000000; bits += 97) {  // ~1e-20 .. 1e20
+            float x;
+            memcpy(&x, &bits, sizeof(x));
+            invSqrtError = fmax(invSqrtError, fabs(math::fastInvSqrt(x) * sqrt((double) x) - 1));
+        }
+        for (int i = 0; i < 100000; i++) {
+            const double angle = -M_PI + 2 * M_PI * i / 100000;
+            for (double r = 1e-3; r < 1e5; r *= 100) {
+                const float y = r * sin(angle), x = r * cos(angle);
+                atanError     = fmax(atanError, fabs(math::fastAtan2(y, x) - atan2((double) y, (double) x)));
+            }
+        }
+        static float in[512], out[512];
+        for (int i = 0; i < 512; i++) in[i] = 0.01f + i * 0.37f;
+        const double invSqrtNs = bestOfNs([&] {
+            for (int i = 0; i < 512; i++) out[i] = math::fastInvSqrt(in[i]);
+            asm volatile("" : : "r"(out) : "memory");
+        });
+        const double libmSqrtNs = bestOfNs([&] {
+            for (int i = 0; i < 512; i++) out[i] = 1.f / sqrtf(in[i]);
+            asm volatile("" : : "r"(out) : "memory");
+        });
+        const double atanNs = bestOfNs([&] {
+            for (int i = 0; i < 512; i++) out[i] = math::fastAtan2(in[i] - 90, in[511 - i] - 100);
+            asm volatile("" : : "r"(out) : "memory");
+        });
+        const double libmAtanNs = bestOfNs([&] {
+            for (int i = 0; i < 512; i++) out[i] = atan2f(in[i] - 90, in[511 - i] - 100);
+            asm volatile("" : : "r"(out) : "memory");
+        });
+        printf("fastInvSqrt: %.2f ns (libm %.2f), relative error %.2g\n", invSqrtNs / 512, libmSqrtNs / 512,
+               invSqrtError);
+        printf("fastAtan2: %.2f ns (libm %.2f), error %.2g rad\n", atanNs / 512, libmAtanNs / 512, atanError);
+        CHECK(invSqrtError < 5e-6 && atanError < 1e-5);
+
+        // random rotations: vector rotation, matrix, Euler angles and gravity must agree
+        double maxError = 0;
+        srand(7);
+        auto random = [] { return 2.f * rand() / RAND_MAX - 1; };
+        for (int i = 0; i < 10000; i++) {
+            const quat_t q      = math::normalize(quat_t{random(), random(), random(), random()});
+            const float_axes_t v(random(), random(), random());
+            const quat_t p      = q * quat_t{0, v.x, v.y, v.z} * math::conjugate(q);
+            const float_axes_t r = math::rotate(q, v);
+            const float_axes_t m = math::toMatrix(q) * v;
+            const float_axes_t g = math::rotate(math::conjugate(q), float_axes_t(0, 0, 1)) - math::gravity(q);
+            const quat_t qm      = math::fromMatrix(math::toMatrix(q));
+            const quat_t qe      = math::fromEuler(math::toEuler(q));
+            const double e[]     = {math::norm(r - float_axes_t(p.x, p.y, p.z)), math::norm(m - r), math::norm(g),
+                                1 - fabs(math::dot(qm, q)), 1 - fabs(math::dot(qe, q))};
+            for (double x : e) maxError = fmax(maxError, x);
+        }
+        printf("quaternion conversions: max disagreement %.2g\n", maxError);
+        CHECK(maxError < 1e-5);
+        constexpr float_axes_t kX(1, 0, 0), kY(0, 1, 0);
+        static_assert(math::dot(math::cross(kX, kY), float_axes_t(0, 0, 1)) == 1, "constexpr vector math");
+    }
+
+    // orientation filters, synthetic motion sampled at 1 kHz: the true orientation turns at a constant
+    // rate from a tilted start, sensors see gravity and a 60º dip magnetic field, quantized to raw LSB
+    {
+        static SampleBatch<4096> motion;
+        static quat_t truth[4096];
+        const accel_fs_t accelFS = ACCEL_FS_4G;
+        const gyro_fs_t gyroFS   = GYRO_FS_500DPS;
+        const double rate[3]     = {0.3, -0.5, 1.5};                         // rad/s, sensor frame
+#if defined CONFIG_MPU_AK89xx
+        const double field[3]    = {cos(M_PI / 3), 0, -sin(M_PI / 3)};      // earth frame, x north z up
+#endif
+        double w = cos(0.2), x = sin(0.2), y = 0, z = 0;                      // 23º roll
+        for (size_t i = 0; i < motion.capacity(); i++) {
+            truth[i] = {(float) w, (float) x, (float) y, (float) z};
+            // earth vector in the sensor frame, transposed rotation matrix
+            const double r[3][3] = {{1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y)},
+                                    {2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x)},
+                                    {2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)}};
+            for (int j = 0; j < 3; j++) {
+                motion.accel[j][i] = lround(r[2][j] * math::accelSensitivity(accelFS));
+                motion.gyro[j][i]  = lround(rate[j] * 180 / M_PI * math::gyroSensitivity(gyroFS));
+#if defined CONFIG_MPU_AK89xx
+                // AK89xx frame: x, y swapped and z reversed
+                const double m = 300 * (r[0][j] * field[0] + r[1][j] * field[1] + r[2][j] * field[2]);
+                motion.mag[j == 2 ? 2 : 1 - j][i] = lround(j == 2 ? -m : m);
+#endif
+            }
+            motion.timestamp[i] = 1000000 + 1000 * (int64_t) i;
+            // q' = q * (0, rate) / 2
+            const double dt = 1e-3 / 2;
+            const double dw = -x * rate[0] - y * rate[1] - z * rate[2];
+            const double dx = w * rate[0] + y * rate[2] - z * rate[1];
+            const double dy = w * rate[1] - x * rate[2] + z * rate[0];
+            const double dz = w * rate[2] + x * rate[1] - y * rate[0];
+            w += dw * dt, x += dx * dt, y += dy * dt, z += dz * dt;
+            const double n = sqrt(w * w + x * x + y * y + z * z);
+            w /= n, x /= n, y /= n, z /= n;
+        }
+        motion.count = motion.capacity();
+        // tilt error: angle between true and estimated gravity direction; full error: rotation angle
+        auto tiltError = [](const quat_t& a, const quat_t& b) {
+            const double ga[3] = {2 * (a.x * a.z - a.w * a.y), 2 * (a.w * a.x + a.y * a.z), 1 - 2 * (a.x * a.x + a.y * a.y)};
+            const double gb[3] = {2 * (b.x * b.z - b.w * b.y), 2 * (b.w * b.x + b.y * b.z), 1 - 2 * (b.x * b.x + b.y * b.y)};
+            return acos(fmin(1.0, ga[0] * gb[0] + ga[1] * gb[1] + ga[2] * gb[2])) * 180 / M_PI;
+        };
+        auto angleError = [](const quat_t& a, const quat_t& b) {
+            return 2 * acos(fmin(1.0, fabs(a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z))) * 180 / M_PI;
+        };
+        const scale_t scale = math::makeScale(accelFS, gyroFS);
+        for (int useMag = 0; useMag < 2; useMag++) {
+#if !defined CONFIG_MPU_AK89xx
+            if (useMag) break;
+#endif
+            for (int f = 0; f < 2; f++) {
+                const ahrs_filter_t filter = f ? AHRS_MAHONY : AHRS_MADGWICK;
+                AHRS ahrs(filter);
+                double best = 1e30;
+                for (int run = 0; run < 5; run++) {
+                    ahrs.reset();
+                    const auto start = std::chrono::steady_clock::now();
+                    ahrs.update(motion, scale, useMag);
+                    const auto end = std::chrono::steady_clock::now();
+                    best = fmin(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                }
+                // error along the run, sample by sample
+                ahrs.reset();
+                double maxError = 0;
+                SampleBatch<1> one;
+                for (size_t i = 0; i < motion.count; i++) {
+                    for (int j = 0; j < 3; j++) {
+                        one.accel[j][0] = motion.accel[j][i];
+                        one.gyro[j][0]  = motion.gyro[j][i];
+#if defined CONFIG_MPU_AK89xx
+                        one.mag[j][0] = motion.mag[j][i];
+#endif
+                    }
+                    one.timestamp[0] = motion.timestamp[i];
+                    one.count        = 1;
+                    ahrs.update(one, scale, useMag);
+                    const double e = useMag ? angleError(ahrs.getQuaternion(), truth[i])
+                                            : tiltError(ahrs.getQuaternion(), truth[i]);
+                    maxError = fmax(maxError, e);
+                }
+                // convergence from a wrong orientation (identity) with higher gains
+                ahrs.reset(quat_t{1, 0, 0, 0});
+                ahrs.setBeta(0.5f).setGains(5.f, 0.f).update(motion, scale, useMag);
+                const quat_t& last = truth[motion.count - 1];
+                const double finalError =
+                    useMag ? angleError(ahrs.getQuaternion(), last) : tiltError(ahrs.getQuaternion(), last);
+                printf("AHRS %s %d-axis: %.1f ns/sample, max %s error %.2f deg, %.2f deg after 4 s from identity\n",
+                       filter == AHRS_MADGWICK ? "Madgwick" : "Mahony  ", useMag ? 9 : 6, best / motion.count,
+                       useMag ? "attitude" : "tilt", maxError, finalError);
+                CHECK(maxError < 2.0 && finalError < 2.0);
+            }
+        }
+
+        // attitude EKF against Madgwick at 500 Hz: same motion with a constant gyro bias, gyro noise and
+        // accelerometer vibration, from a fixed pseudo-random sequence
+        static SampleBatch<16384> noisy;
+        static quat_t noisyTruth[16384];
+        const double gyroBias[3] = {0.02, -0.01, 0.015};  // rad/s
+        uint32_t seed            = 12345;
+        auto gaussian            = [&seed] {  // unit variance, sum of 12 uniforms
+            double sum = 0;
+            for (int k = 0; k < 12; k++) {
+                seed = seed * 1664525u + 1013904223u;
+                sum += (seed >> 8) / 16777216.0;
+            }
+            return sum - 6;
+        };
+        w = cos(0.2), x = sin(0.2), y = 0, z = 0;
+        for (size_t i = 0; i < noisy.capacity(); i++) {
+            noisyTruth[i]        = {(float) w, (float) x, (float) y, (float) z};
+            const double r[3][3] = {{1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y)},
+                                    {2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x)},
+                                    {2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)}};
+            for (int j = 0; j < 3; j++) {
+                const double a = r[2][j] + 0.05 * gaussian();
+                const double g = rate[j] + gyroBias[j] + 0.005 * gaussian();
+                noisy.accel[j][i] = lround(a * math::accelSensitivity(accelFS));
+                noisy.gyro[j][i]  = lround(g * 180 / M_PI * math::gyroSensitivity(gyroFS));
+#if defined CONFIG_MPU_AK89xx
+                const double m = 300 * (r[0][j] * field[0] + r[1][j] * field[1] + r[2][j] * field[2] + 0.02 * gaussian());
+                noisy.mag[j == 2 ? 2 : 1 - j][i] = lround(j == 2 ? -m : m);
+#endif
+            }
+            noisy.timestamp[i] = 1000000 + 2000 * (int64_t) i;
+            const double dt = 2e-3 / 2;
+            const double dw = -x * rate[0] - y * rate[1] - z * rate[2];
+            const double dx = w * rate[0] + y * rate[2] - z * rate[1];
+            const double dy = w * rate[1] - x * rate[2] + z * rate[0];
+            const double dz = w * rate[2] + x * rate[1] - y * rate[0];
+            w += dw * dt, x += dx * dt, y += dy * dt, z += dz * dt;
+            const double n = sqrt(w * w + x * x + y * y + z * z);
+            w /= n, x /= n, y /= n, z /= n;
+        }
+        noisy.count = noisy.capacity();
+        for (int useMag = 0; useMag < 2; useMag++) {
+#if !defined CONFIG_MPU_AK89xx
+            if (useMag) break;
+#endif
+            AttitudeEKF ekf;
+            double best = 1e30;
+            for (int run = 0; run < 5; run++) {
+                ekf.reset();
+                const auto start = std::chrono::steady_clock::now();
+                ekf.update(noisy, scale, useMag);
+                const auto end = std::chrono::steady_clock::now();
+                best = fmin(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+            // RMS error after the first 10 s, sample by sample
+            AHRS ahrs(AHRS_MADGWICK);
+            ekf.reset();
+            double ekfSum = 0, ahrsSum = 0;
+            size_t settled = 0;
+            SampleBatch<1> one;
+            for (size_t i = 0; i < noisy.count; i++) {
+                for (int j = 0; j < 3; j++) {
+                    one.accel[j][0] = noisy.accel[j][i];
+                    one.gyro[j][0]  = noisy.gyro[j][i];
+#if defined CONFIG_MPU_AK89xx
+                    one.mag[j][0] = noisy.mag[j][i];
+#endif
+                }
+                one.timestamp[0] = noisy.timestamp[i];
+                one.count        = 1;
+                ekf.update(one, scale, useMag);
+                ahrs.update(one, scale, useMag);
+                if (noisy.timestamp[i] - noisy.timestamp[0] < 10000000) continue;
+                const double e = useMag ? angleError(ekf.getQuaternion(), noisyTruth[i])
+                                        : tiltError(ekf.getQuaternion(), noisyTruth[i]);
+                const double a = useMag ? angleError(ahrs.getQuaternion(), noisyTruth[i])
+                                        : tiltError(ahrs.getQuaternion(), noisyTruth[i]);
+                ekfSum += e * e, ahrsSum += a * a, settled++;
+            }
+            const float_axes_t bias = ekf.getGyroBias();
+            double biasError        = 0;
+            for (int j = 0; j < 3; j++) biasError = fmax(biasError, fabs(bias[j] - gyroBias[j]));
+            const double ekfRms = sqrt(ekfSum / settled), ahrsRms = sqrt(ahrsSum / settled);
+            printf("AttitudeEKF %d-axis at 500 Hz: %.1f ns/sample, RMS %s error %.2f deg (Madgwick %.2f), "
+                   "gyro bias error %.2g rad/s, bias std %.2g\n",
+                   useMag ? 9 : 6, best / noisy.count, useMag ? "attitude" : "tilt", ekfRms, ahrsRms, biasError,
+                   ekf.getGyroBiasStd().x);
+            CHECK(ekfRms < 0.5 && ekfRms < ahrsRms && biasError < 0.003);
+        }
+    }
+
+    // calibration, expected offsets are the scene biases in 16G / 1000DPS, negated
+    const sim::scene_t& scene = sim::mpu0.scene();
+    auto calibrate            = [&](int) {
+        raw_axes_t accelOffset, gyroOffset;
+        CHECK(MPU.computeOffsets(&accelOffset, &gyroOffset) == ESP_OK);
+        for (int i = 0; i < 3; i++) {
+            const int accelExpected = -scene.accelBias[i] * math::accelSensitivity(ACCEL_FS_16G);
+            const int gyroExpected  = -scene.gyroBias[i] * math::gyroSensitivity(GYRO_FS_1000DPS);
+            CHECK(abs(accelOffset[i] - accelExpected) <= 4);
+            CHECK(abs(gyroOffset[i] - gyroExpected) <= 4);
+        }
+        return 1;
+    };
+    const uint32_t prevOverflows = sim::mpu0.overflowCount();
+    measure("computeOffsets()", 1, calibrate);
+    printf("  FIFO overflows during computeOffsets(): %u\n", sim::mpu0.overflowCount() - prevOverflows);
+    CHECK(sim::mpu0.overflowCount() == prevOverflows);
+
+    measure("selfTest()", 1, [&](int) {
+        selftest_t result;
+        const int64_t start = esp_timer_get_time();
+        CHECK(MPU.selfTest(&result) == ESP_OK);
+        CHECK(result == 0);
+        CHECK(esp_timer_get_time() - start < 300000);
+        return 1;
+    });
+
+    // same procedures as state machines: the caller only spends the bus time of each step, the
+    // settle and fill times are left to the caller, configuration and self-test bits are restored
+    {
+        raw_axes_t accelOffset, gyroOffset, accelPolled, gyroPolled;
+        CHECK(MPU.computeOffsets(&accelOffset, &gyroOffset) == ESP_OK);
+        const uint8_t prevAccelConfig = sim::mpu0.peek(regs::ACCEL_CONFIG);
+        const uint8_t prevGyroConfig  = sim::mpu0.peek(regs::GYRO_CONFIG);
+        const uint16_t prevRate       = MPU.getSampleRate();
+        const accel_fs_t prevAccelFS  = MPU.getAccelFullScale();
+        Calibrator calibrator(MPU);
+        for (int job = 0; job < 2; job++) {
+            CHECK((job ? calibrator.startSelfTest() : calibrator.startOffsets()) == ESP_OK);
+            CHECK(calibrator.startOffsets() == ESP_ERR_INVALID_STATE);
+            const int64_t start = esp_timer_get_time();
+            int64_t inPoll = 0, longestPoll = 0;
+            int polls      = 0;
+            while (calibrator.busy()) {
+                int64_t waitUs;
+                const int64_t before = esp_timer_get_time();
+                CHECK(calibrator.poll(&waitUs) == ESP_OK);
+                const int64_t spent = esp_timer_get_time() - before;
+                inPoll += spent, longestPoll = spent > longestPoll ? spent : longestPoll, polls++;
+                hostAdvanceTime(waitUs < 5000 ? waitUs : 5000);  // application work
+            }
+            CHECK(calibrator.getState() == CALIB_DONE && longestPoll < 10000);
+            printf("Calibrator %s: %d polls over %.1f ms, %.1f ms in poll(), longest %.1f ms\n",
+                   job ? "self-test" : "offsets  ", polls, (esp_timer_get_time() - start) / 1000.0, inPoll / 1000.0,
+                   longestPoll / 1000.0);
+            if (job) {
+                selftest_t result;
+                CHECK(calibrator.getSelfTest(&result) == ESP_OK && result == SELF_TEST_PASS);
+                CHECK(calibrator.getOffsets(&accelPolled, &gyroPolled) == ESP_ERR_INVALID_STATE);
+            }
+            else {
+                CHECK(calibrator.getOffsets(&accelPolled, &gyroPolled) == ESP_OK);
+                for (int i = 0; i < 3; i++) {
+                    CHECK(abs(accelPolled[i] - accelOffset[i]) <= 4);
+                    CHECK(abs(gyroPolled[i] - gyroOffset[i]) <= 4);
+                }
+            }
+            CHECK(sim::mpu0.peek(regs::ACCEL_CONFIG) == prevAccelConfig);
+            CHECK(sim::mpu0.peek(regs::GYRO_CONFIG) == prevGyroConfig);
+        }
+        // abort in the middle of the self-test capture
+        CHECK(calibrator.startSelfTest() == ESP_OK);
+        while (calibrator.busy() && sim::mpu0.peek(regs::ACCEL_CONFIG) == prevAccelConfig) {
+            int64_t waitUs;
+            CHECK(calibrator.poll(&waitUs) == ESP_OK);
+            hostAdvanceTime(waitUs);
+        }
+        CHECK(calibrator.abort() == ESP_OK && calibrator.getState() == CALIB_IDLE);
+        CHECK(sim::mpu0.peek(regs::ACCEL_CONFIG) == prevAccelConfig);
+        CHECK(sim::mpu0.peek(regs::GYRO_CONFIG) == prevGyroConfig);
+        CHECK(MPU.getSampleRate() == prevRate && MPU.getAccelFullScale() == prevAccelFS);
+    }
+
+    // a bump in the middle of the offset capture is left out of the average, the FIFO is drained
+    // while sampling and never overflows
+    {
+        raw_axes_t accelOffset, gyroOffset, accelBumped, gyroBumped;
+        CHECK(MPU.computeOffsets(&accelOffset, &gyroOffset) == ESP_OK);
+        sim::scene_t& scene     = sim::mpu0.scene();
+        const uint32_t overflows = sim::mpu0.overflowCount();
+        Calibrator calibrator(MPU);
+        CHECK(calibrator.startOffsets() == ESP_OK);
+        int64_t samplingStart = 0;
+        bool bumped           = false;
+        while (calibrator.busy()) {
+            int64_t waitUs;
+            CHECK(calibrator.poll(&waitUs) == ESP_OK);
+            if (calibrator.getState() == CALIB_SAMPLING && samplingStart == 0) samplingStart = esp_timer_get_time();
+            if (!bumped && samplingStart && esp_timer_get_time() - samplingStart > 60000) {
+                scene.gyro[0] = 100, scene.accel[0] = 0.5f;
+                hostAdvanceTime(3000);
+                MPU.getFIFOCount();  // device model samples the scene on bus access
+                scene.gyro[0] = 0, scene.accel[0] = 0;
+                bumped        = true;
+                continue;
+            }
+            hostAdvanceTime(waitUs < 5000 ? waitUs : 5000);
+        }
+        CHECK(calibrator.getOffsets(&accelBumped, &gyroBumped) == ESP_OK);
+        for (int i = 0; i < 3; i++) {
+            CHECK(abs(accelBumped[i] - accelOffset[i]) <= 4);
+            CHECK(abs(gyroBumped[i] - gyroOffset[i]) <= 4);
+        }
+        printf("Calibrator offsets with a bump: %d packets averaged, %d rejected, %u FIFO overflows\n",
+               calibrator.getSampleCount(), calibrator.getRejectedCount(), sim::mpu0.overflowCount() - overflows);
+        CHECK(calibrator.getRejectedCount() >= 3 && calibrator.getSampleCount() >= 75);
+        CHECK(calibrator.getSampleCount() + calibrator.getRejectedCount() >= 95);
+        CHECK(sim::mpu0.overflowCount() == overflows);
+    }
+
+    // calibration record: serialized, then re-applied after a reset instead of a new calibration
+    {
+        Calibrator calibrator(MPU);
+        CHECK(calibrator.startOffsets() == ESP_OK && calibrator.run() == ESP_OK);
+        calib_record_t record, restored;
+        CHECK(calibrator.getRecord(&record) == ESP_OK);
+        uint8_t blob[Calibrator::kRecordSize];
+        Calibrator::pack(record, blob);
+        CHECK(Calibrator::unpack(blob, sizeof(blob), &restored) == ESP_OK);
+        CHECK(restored.whoami == record.whoami && restored.temperature == record.temperature);
+        for (int i = 0; i < 3; i++) {
+            CHECK(restored.accelTrim[i] == record.accelTrim[i] && restored.accelOffset[i] == record.accelOffset[i]);
+            CHECK(restored.gyroOffset[i] == record.gyroOffset[i] && restored.magAdjust[i] == record.magAdjust[i]);
+        }
+        CHECK(Calibrator::unpack(blob, sizeof(blob) - 1, &restored) == ESP_ERR_INVALID_SIZE);
+        blob[2]++;
+        CHECK(Calibrator::unpack(blob, sizeof(blob), &restored) == ESP_ERR_INVALID_VERSION);
+        blob[2]--;
+        blob[12] ^= 0x10;
+        CHECK(Calibrator::unpack(blob, sizeof(blob), &restored) == ESP_ERR_INVALID_CRC);
+        blob[12] ^= 0x10;
+        CHECK(Calibrator::unpack(blob, sizeof(blob), &restored) == ESP_OK);
+        CHECK(MPU.initialize() == ESP_OK);
+        measure("check + applyCalibration", 1, [&](int) {
+            CHECK(MPU.checkCalibration(restored) == ESP_OK);
+            CHECK(MPU.applyCalibration(restored) == ESP_OK);
+            return 1;
+        });
+        const raw_axes_t accelOffset = MPU.getAccelOffset(), gyroOffset = MPU.getGyroOffset();
+        for (int i = 0; i < 3; i++) {
+            CHECK(accelOffset[i] == (int16_t)(record.accelTrim[i] + (record.accelOffset[i] & ~1)));
+            CHECK(gyroOffset[i] == record.gyroOffset[i]);
+        }
+        // biases cancelled
+        raw_axes_t accelResidual, gyroResidual;
+        CHECK(MPU.computeOffsets(&accelResidual, &gyroResidual) == ESP_OK);
+        for (int i = 0; i < 3; i++) CHECK(abs(accelResidual[i]) <= 4 && abs(gyroResidual[i]) <= 4);
+        // calibrated again on top of the applied offsets, the record keeps the factory trim
+        Calibrator again(MPU);
+        calib_record_t recalibrated;
+        CHECK(again.startOffsets() == ESP_OK && again.run() == ESP_OK && again.getRecord(&recalibrated) == ESP_OK);
+        for (int i = 0; i < 3; i++) CHECK(recalibrated.accelTrim[i] == record.accelTrim[i]);
+        // already applied, other chip, stale
+        CHECK(MPU.checkCalibration(restored) == ESP_OK);
+        calib_record_t other = restored;
+        other.accelTrim.y += 2;
+        CHECK(MPU.checkCalibration(other) == ESP_ERR_NOT_FOUND && MPU.lastError() == ESP_ERR_NOT_FOUND);
+        other = restored;
+        other.whoami ^= 0x1;
+        CHECK(MPU.checkCalibration(other) == ESP_ERR_NOT_FOUND);
+        sim::mpu0.scene().temp += 15;
+        hostAdvanceTime(20000);  // next sample
+        CHECK(MPU.checkCalibration(restored) == ESP_ERR_INVALID_STATE && MPU.lastError() == ESP_ERR_INVALID_STATE);
+        CHECK(MPU.checkCalibration(restored, 20.f) == ESP_OK);
+        sim::mpu0.scene().temp -= 15;
+        CHECK(MPU.initialize() == ESP_OK);
+    }
+
+    // background gyro bias tracking: learns the scene bias while still, ignores motion and
+    // windows vetoed by zero-motion detection, then moves the bias into the offset registers
+    {
+        sim::scene_t& scene = sim::mpu0.scene();
+        GyroBiasTracker tracker(MPU.getAccelFullScale(), MPU.getGyroFullScale());
+        static fifo_sample_t samples[400];
+        auto capture = [&](size_t count, bool moving) {
+            for (size_t i = 0; i < count; i++) {
+                if (moving) {
+                    const float phase = 0.05f * i;
+                    scene.gyro[0]     = 40 * sinf(phase);
+                    scene.accel[1]    = 0.3f * cosf(phase);
+                }
+                waitDataReady();
+                CHECK(MPU.motion(&samples[i].accel, &samples[i].gyro) == ESP_OK);
+                samples[i].timestamp = esp_timer_get_time();
+            }
+            scene.gyro[0] = scene.accel[1] = 0;
+            return tracker.update(samples, count);
+        };
+        auto biasError = [&] {
+            const float_axes_t bias = tracker.getBias();
+            float error             = 0;
+            for (int i = 0; i < 3; i++) error = fmaxf(error, fabsf(bias[i] - scene.gyroBias[i]));
+            return error;
+        };
+        CHECK(capture(400, false) == 3 && tracker.isStill());
+        const float stillError = biasError();
+        CHECK(stillError < 0.05f);
+        CHECK(capture(400, true) == 0 && !tracker.isStill() && tracker.getStillWindows() == 3);
+        CHECK(biasError() == stillError);
+        tracker.setZeroMotion(false);
+        CHECK(capture(200, false) == 0);
+        tracker.setZeroMotion(true);
+        CHECK(capture(300, false) == 2 && tracker.getStillWindows() == 5);
+        printf("GyroBiasTracker: bias error %.3f deg/s after 3 still windows, %.3f after 5\n", stillError,
+               biasError());
+        const double updateNs = bestOfNs([&] {
+            tracker.update(samples, 300);
+        });
+        printf("GyroBiasTracker update: %.1f ns/sample\n", updateNs / 300);
+        CHECK(biasError() < 0.05f);
+        measure("pushToHardware()", 1, [&](int) {
+            CHECK(tracker.pushToHardware(MPU) == ESP_OK);
+            return 1;
+        });
+        // registers absorbed the bias up to 1 LSB in 1000DPS, estimate keeps the remainder
+        const raw_axes_t gyroOffset = MPU.getGyroOffset();
+        for (int i = 0; i < 3; i++) {
+            const int expected = lroundf(-scene.gyroBias[i] * math::gyroSensitivity(GYRO_FS_1000DPS));
+            CHECK(abs(gyroOffset[i] - expected) <= 2);
+            CHECK(fabsf(tracker.getBiasRaw()[i]) < 1.5f);
+        }
+        CHECK(capture(300, false) == 2);
+        for (int i = 0; i < 3; i++) CHECK(fabsf(tracker.getBias()[i]) < 0.05f);
+        CHECK(MPU.initialize() == ESP_OK);
+    }
+
+    // temperature compensation: biases follow a quadratic curve over a 40 ºC day, the model is
+    // fitted from still captures at a few temperatures and checked in between
+    {
+        sim::scene_t& scene          = sim::mpu0.scene();
+        const sim::scene_t prevScene = scene;
+        const accel_fs_t accelFS     = MPU.getAccelFullScale();
+        const gyro_fs_t gyroFS       = MPU.getGyroFullScale();
+        auto setTemperature          = [&](float temp) {
+            const float dT = temp - 25;
+            for (int i = 0; i < 3; i++) {
+                scene.gyroBias[i]  = prevScene.gyroBias[i] + (0.02f - 0.01f * i) * dT + 0.0004f * dT * dT;
+                scene.accelBias[i] = prevScene.accelBias[i] + (0.0002f + 0.0001f * i) * dT;
+            }
+            scene.temp = temp;
+        };
+        static SampleBatch<256> batch;
+        auto capture = [&] {
+            batch.clear();
+            for (size_t i = 0; i < batch.capacity(); i++, batch.count++) {
+                waitDataReady();
+                raw_axes_t accel, gyro;
+                CHECK(MPU.sensors(&accel, &gyro, &batch.temp[i]) == ESP_OK);
+                for (int j = 0; j < 3; j++) batch.accel[j][i] = accel[j], batch.gyro[j][i] = gyro[j];
+            }
+        };
+        auto mean = [&](const int16_t* column) {
+            int32_t sum = 0;
+            for (size_t i = 0; i < batch.count; i++) sum += column[i];
+            return (float) sum / batch.count;
+        };
+        TempCompensation comp;
+        for (float temp = 5; temp <= 45; temp += 8) {
+            setTemperature(temp);
+            capture();
+            float_axes_t gyroBias, accelBias;
+            for (int i = 0; i < 3; i++) {
+                gyroBias[i]  = mean(batch.gyro[i]) / math::gyroSensitivity(gyroFS);
+                accelBias[i] = mean(batch.accel[i]) / math::accelSensitivity(accelFS) - (i == 2);
+            }
+            const float tempC = math::tempCelsius((int16_t) lroundf(mean(batch.temp)));
+            comp.addGyroPoint(tempC, gyroBias);
+            comp.addAccelPoint(tempC, accelBias);
+        }
+        CHECK(comp.fit() == ESP_OK && comp.getGyroDegree() == 2 && comp.getAccelDegree() == 2);
+        // residual at temperatures between the points, in LSB
+        float gyroResidual = 0, accelResidual = 0;
+        for (float temp = 9; temp <= 41; temp += 8) {
+            setTemperature(temp);
+            capture();
+            comp.compensate(batch, accelFS, gyroFS);
+            for (int i = 0; i < 3; i++) {
+                gyroResidual  = fmaxf(gyroResidual, fabsf(mean(batch.gyro[i])));
+                accelResidual = fmaxf(accelResidual, fabsf(mean(batch.accel[i]) - (i == 2) * math::accelSensitivity(accelFS)));
+            }
+        }
+        printf("TempCompensation: residual gyro %.2f LSB (%.3f deg/s), accel %.2f LSB over 9..41 C\n", gyroResidual,
+               gyroResidual / math::gyroSensitivity(gyroFS), accelResidual);
+        CHECK(gyroResidual < 2 && accelResidual < 4);
+        const double compNs = bestOfNs([&] {
+            comp.compensate(batch, accelFS, gyroFS);
+        });
+        printf("TempCompensation compensate: %.2f ns/sample\n", compNs / batch.count);
+        // stored model, no points
+        TempCompensation loaded;
+        loaded.setModel(comp.getModel());
+        for (int i = 0; i < 3; i++) CHECK(loaded.gyroBias(30)[i] == comp.gyroBias(30)[i]);
+        CHECK(loaded.fit() == ESP_ERR_INVALID_STATE);
+        scene = prevScene;
+        CHECK(MPU.initialize() == ESP_OK);
+    }
+
+#if defined CONFIG_MPU_AK89xx
+    CHECK(MPU.compassTestConnection() == ESP_OK);
+#endif
+
+    // reconfiguration, without and with the register cache
+    auto reconfigure = [&](int i) {
+        CHECK(MPU.setSampleRate(i % 2 ? 200 : 500) == ESP_OK);
+        CHECK(MPU.setDigitalLowPassFilter(i % 2 ? DLPF_42HZ : DLPF_98HZ) == ESP_OK);
+        CHECK(MPU.setAccelFullScale(i % 2 ? ACCEL_FS_4G : ACCEL_FS_8G) == ESP_OK);
+        CHECK(MPU.setGyroFullScale(i % 2 ? GYRO_FS_500DPS : GYRO_FS_1000DPS) == ESP_OK);
+        CHECK(MPU.getSampleRate() == (i % 2 ? 200 : 500));
+        CHECK(MPU.getAccelFullScale() == (i % 2 ? ACCEL_FS_4G : ACCEL_FS_8G));
+        return 1;
+    };
+    measure("reconfigure", 100, reconfigure);
+
+    // configuration snapshot: the same registers come back after a calibration-like change
+    {
+        config_snapshot_t snapshot;
+        uint8_t before[0x80], after[0x80];
+        for (int r = 0; r < 0x80; r++) before[r] = sim::mpu0.peek(r);
+        measure("saveConfig()", 1, [&](int) {
+            CHECK(MPU.saveConfig(&snapshot) == ESP_OK);
+            return 1;
+        });
+        CHECK(MPU.setSampleRate(1000) == ESP_OK);
+        CHECK(MPU.setDigitalLowPassFilter(DLPF_188HZ) == ESP_OK);
+        CHECK(MPU.setAccelFullScale(ACCEL_FS_16G) == ESP_OK);
+        CHECK(MPU.setGyroFullScale(GYRO_FS_2000DPS) == ESP_OK);
+        CHECK(MPU.writeBits(regs::ACCEL_CONFIG, regs::ACONFIG_XA_ST_BIT, 3, 0x7) == ESP_OK);
+        CHECK(MPU.setFIFOConfig(FIFO_CFG_ACCEL | FIFO_CFG_GYRO) == ESP_OK);
+        CHECK(MPU.setFIFOEnabled(true) == ESP_OK);
+        CHECK(MPU.setInterruptEnabled(INT_EN_RAWDATA_READY) == ESP_OK);
+        measure("restoreConfig()", 1, [&](int) {
+            CHECK(MPU.restoreConfig(snapshot) == ESP_OK);
+            return 1;
+        });
+        for (int r = 0; r < 0x80; r++) after[r] = sim::mpu0.peek(r);
+        const uint8_t restored[] = {regs::SMPLRT_DIV, regs::CONFIG,        regs::GYRO_CONFIG, regs::ACCEL_CONFIG,
+                                    regs::FIFO_EN,    regs::I2C_MST_CTRL,  regs::I2C_SLV4_CTRL, regs::INT_ENABLE,
+                                    regs::USER_CTRL,  regs::PWR_MGMT1};
+        for (uint8_t r : restored) CHECK(after[r] == before[r]);
+        CHECK(MPU.getSampleRate() == 200);  // last reconfigure()
+    }
+
+    // declarative profile: only the registers that differ are written, re-applying writes nothing
+    {
+        mpu_config_t logging = MPU_DEFAULT_CONFIG;
+        logging.sample_rate  = 500;
+        logging.dlpf         = DLPF_98HZ;
+        logging.accel_fs     = ACCEL_FS_8G;
+        logging.fifo_config  = FIFO_CFG_ACCEL | FIFO_CFG_GYRO;
+        logging.fifo_enabled = true;
+        logging.int_enabled  = INT_EN_RAWDATA_READY;
+        measure("applyConfig(), switch", 1, [&](int) {
+            CHECK(MPU.applyConfig(logging) == ESP_OK);
+            return 1;
+        });
+        CHECK(MPU.getSampleRate() == 500 && MPU.getDigitalLowPassFilter() == DLPF_98HZ);
+        CHECK(MPU.getAccelFullScale() == ACCEL_FS_8G && MPU.getGyroFullScale() == GYRO_FS_500DPS);
+        CHECK(MPU.getFIFOConfig() == (FIFO_CFG_ACCEL | FIFO_CFG_GYRO) && MPU.getFIFOEnabled());
+        CHECK(MPU.getInterruptEnabled() == INT_EN_RAWDATA_READY && MPU.getSleep() == false);
+        sim::vbus0.resetStats();
+        CHECK(MPU.applyConfig(logging) == ESP_OK);
+        CHECK(sim::vbus0.stats().writes == 0);
+        CHECK(MPU.applyConfig(MPU_DEFAULT_CONFIG) == ESP_OK);
+        CHECK(MPU.getSampleRate() == 100 && MPU.getAccelFullScale() == ACCEL_FS_4G);
+        CHECK(MPU.getFIFOEnabled() == false && MPU.getInterruptEnabled() == INT_EN_NONE);
+    }
+
+    // warm start: after a host-only restart the kept configuration is taken as it is, a power cycle
+    // or another profile falls back to a full initialization
+    {
+        mpu_config_t streaming = MPU_DEFAULT_CONFIG;
+        streaming.sample_rate  = 500;
+        streaming.fifo_config  = FIFO_CFG_ACCEL | FIFO_CFG_GYRO;
+        streaming.fifo_enabled = true;
+        CHECK(MPU.initialize(streaming) == ESP_OK);
+        raw_axes_t gyroOffset;
+        gyroOffset.x = 12, gyroOffset.y = -7, gyroOffset.z = 3;
+        CHECK(MPU.setGyroOffset(gyroOffset) == ESP_OK);
+        hostAdvanceTime(20000);
+        MPU_t rebooted;  // host restarted, device kept power
+        bool warm = false;
+        measure("warmStart(), kept", 1, [&](int) {
+            CHECK(rebooted.warmStart(streaming, &warm) == ESP_OK);
+            return 1;
+        });
+        CHECK(warm && rebooted.getGyroOffset().x == 12 && rebooted.getGyroOffset().z == 3);
+        raw_axes_t trim;
+        CHECK(rebooted.getAccelFactoryTrim(&trim) == ESP_ERR_INVALID_STATE);  // no reset, not read
+        const uint16_t kept = rebooted.getFIFOCount();
+        CHECK(kept >= 9 * 12 && kept % 12 == 0);  // samples of the restart kept
+        sim::vbus0.resetStats();
+        CHECK(rebooted.warmStart(streaming, &warm) == ESP_OK);
+        CHECK(warm && sim::vbus0.stats().transactions <= 6 && sim::vbus0.stats().writes == 0);  // bursts only
+        hostAdvanceTime(300000);  // FIFO overflows
+        CHECK(rebooted.warmStart(streaming, &warm) == ESP_OK);
+        CHECK(warm && rebooted.getFIFOCount() < 2 * 12);
+#if defined CONFIG_MPU_AK89xx
+        // compass changed behind the driver's back is set up again, the rest is kept
+#if defined CONFIG_MPU_AK8963
+        CHECK(rebooted.compassSetSensitivity(MAG_SENSITIVITY_0_6_uT) == ESP_OK);
+#else
+        CHECK(rebooted.compassSetMode(MAG_MODE_POWER_DOWN) == ESP_OK);
+#endif
+        CHECK(rebooted.warmStart(streaming, &warm) == ESP_OK);
+        CHECK(warm && rebooted.compassGetMode() == MAG_MODE_SINGLE_MEASURE);
+#if defined CONFIG_MPU_AK8963
+        CHECK(rebooted.compassGetSensitivity() == MAG_SENSITIVITY_0_15_uT);
+#endif
+#endif
+        streaming.sample_rate = 250;
+        measure("warmStart(), changed", 1, [&](int) {
+            CHECK(rebooted.warmStart(streaming, &warm) == ESP_OK);
+            return 1;
+        });
+        CHECK(!warm && rebooted.getSampleRate() == 250 && rebooted.getFIFOEnabled());
+        sim::mpu0.powerOn();
+        CHECK(rebooted.warmStart(streaming, &warm) == ESP_OK);
+        CHECK(!warm && rebooted.getSampleRate() == 250);
+        CHECK(MPU.initialize() == ESP_OK);
+    }
+
+    MPU.setRegisterCacheEnabled(true);
+    measure("reconfigure, reg cache", 100, reconfigure);
+    // cached values must match the chip, also across a reset
+    CHECK(MPU.initialize() == ESP_OK);
+    CHECK(MPU.getSampleRate() == 100);
+    CHECK(MPU.getGyroFullScale() == ((sim::mpu0.peek(regs::GYRO_CONFIG) >> 3) & 0x3));
+    CHECK(MPU.getDigitalLowPassFilter() == (sim::mpu0.peek(regs::CONFIG) & 0x7));
+    CHECK(MPU.getFIFOEnabled() == false);
+    CHECK(MPU.resetFIFO() == ESP_OK);
+    CHECK(sim::mpu0.peek(regs::USER_CTRL) == MPU.getAuxI2CEnabled() << regs::USERCTRL_I2C_MST_EN_BIT);
+    measure("computeOffsets(), reg cache", 1, calibrate);
+    MPU.setRegisterCacheEnabled(false);
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("OK\n");
+    return EXIT_SUCCESS;
+}
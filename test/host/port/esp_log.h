@@ -0,0 +1,30 @@
+// Host port of esp-idf's esp_log.h, for building MPU driver on Linux.
+#ifndef _HOST_ESP_LOG_H_
+#define _HOST_ESP_LOG_H_
+
+#include <stdio.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define LOG_COLOR_E ""
+#define LOG_COLOR_W ""
+#define LOG_COLOR_I ""
+#define LOG_COLOR_D ""
+#define LOG_COLOR_V ""
+#define LOG_RESET_COLOR ""
+
+#define ESP_LOG_HOST(letter, tag, format, ...) printf(#letter " (%s): " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST(E, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST(W, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST(I, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_HOST(D, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_HOST(V, tag, format, ##__VA_ARGS__)
+
+#endif
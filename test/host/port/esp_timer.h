@@ -0,0 +1,18 @@
+// Host port of esp-idf's esp_timer.h, for building MPU driver on Linux.
+#ifndef _HOST_ESP_TIMER_H_
+#define _HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Simulated time [us], advances with vTaskDelay() and virtual bus transfers */
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,10 @@
+// Host port of FreeRTOS.h, for building MPU driver on Linux.
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+#include <stdint.h>
+#include "freertos/portmacro.h"
+
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(xTimeInMs) / portTICK_PERIOD_MS)
+
+#endif
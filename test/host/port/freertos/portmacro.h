@@ -0,0 +1,13 @@
+// Host port of FreeRTOS portmacro.h, for building MPU driver on Linux.
+#ifndef _HOST_PORTMACRO_H_
+#define _HOST_PORTMACRO_H_
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portTICK_PERIOD_MS ((TickType_t) 1)
+
+#endif
@@ -0,0 +1,19 @@
+// Host port of FreeRTOS task.h, for building MPU driver on Linux.
+#ifndef _HOST_TASK_H_
+#define _HOST_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Delays advance the simulated time, they return right away */
+void vTaskDelay(const TickType_t xTicksToDelay);
+TickType_t xTaskGetTickCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+// Host port of esp-idf / FreeRTOS services used by MPU driver.
+// Simulated time = time spent in delays + time spent on the virtual bus.
+
+#include "port.hpp"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mpu/sim.hpp"
+
+static int64_t s_idleTimeUs = 0;
+
+void hostAdvanceTime(int64_t us)
+{
+    s_idleTimeUs += us;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_idleTimeUs + mpud::sim::vbus0.elapsedUs();
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    hostAdvanceTime((int64_t) xTicksToDelay * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
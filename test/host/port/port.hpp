@@ -0,0 +1,10 @@
+// Host port of esp-idf / FreeRTOS services used by MPU driver.
+#ifndef _HOST_PORT_HPP_
+#define _HOST_PORT_HPP_
+
+#include <stdint.h>
+
+/* Advance simulated time, as if the application was busy for `us` microseconds */
+void hostAdvanceTime(int64_t us);
+
+#endif
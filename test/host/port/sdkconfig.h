@@ -0,0 +1,13 @@
+// Host sdkconfig for MPU driver. Chip model flags are passed by the Makefile.
+#ifndef _HOST_SDKCONFIG_H_
+#define _HOST_SDKCONFIG_H_
+
+#define CONFIG_MPU_I2C 1
+#define CONFIG_MPU_COMM_PROTOCOL "I2C"
+#define CONFIG_MPU_VIRTUAL_DEVICE 1
+
+#ifndef CONFIG_MPU_LOG_LEVEL
+#define CONFIG_MPU_LOG_LEVEL 0
+#endif
+
+#endif
@@ -9,6 +9,7 @@
 #include "esp_attr.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/i2c.h"
 #include "driver/gpio.h"
 #include "driver/spi_master.h"
@@ -18,10 +19,18 @@
 #include "unity.h"
 #include "unity_config.h"
 #include "MPU.hpp"
+#include "mpu/ahrs.hpp"
+#include "mpu/bias.hpp"
+#include "mpu/calibration.hpp"
+#include "mpu/ekf.hpp"
+#include "mpu/fifo.hpp"
 #include "mpu/registers.hpp"
+#include "mpu/ring.hpp"
+#include "mpu/tempcomp.hpp"
 #include "mpu/types.hpp"
 #include "mpu/utils.hpp"
 #include "mpu/math.hpp"
+#include "mpu/vector.hpp"
 
 namespace test {
 /**
@@ -510,7 +519,18 @@ TEST_CASE("MPU sensor data test", "[MPU]")
     test::MPU_t mpu;
     TEST_ESP_OK( mpu.testConnection());
     TEST_ESP_OK( mpu.initialize());
-    // TODO..
+    // interrupt status and sensors in one burst
+    mpud::sensors_t sensors;
+    mpud::int_stat_t status = 0;
+    mpu.getInterruptStatus();  // clear status first
+    TEST_ESP_OK( mpu.lastError());
+    vTaskDelay(20 / portTICK_PERIOD_MS);
+    TEST_ESP_OK( mpu.sensorsWithStatus(&sensors, &status));
+    TEST_ASSERT( status & mpud::INT_STAT_RAWDATA_READY);
+    TEST_ASSERT( !(mpu.getInterruptStatus() & mpud::INT_STAT_RAWDATA_READY));  // cleared by the burst read
+    TEST_ESP_OK( mpu.lastError());
+    printf("accel: %+d %+d %+d, gyro: %+d %+d %+d, temp: %+d\n", sensors.accel.x, sensors.accel.y, sensors.accel.z,
+        sensors.gyro.x, sensors.gyro.y, sensors.gyro.z, sensors.temp);
 }
 
 
@@ -601,6 +621,431 @@ TEST_CASE("MPU FIFO buffer", "[MPU]")
 
 
 
+TEST_CASE("MPU FIFO count and data burst read", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    TEST_ESP_OK( mpu.setSampleRate(100));
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    constexpr size_t kPacketSize = 12;
+    constexpr size_t kMaxPackets = 8;
+    uint8_t buffer[kMaxPackets * kPacketSize + 2];
+    // empty FIFO, nothing is consumed while asleep (no packet can be written during the burst)
+    TEST_ESP_OK( mpu.setSleep(true));
+    TEST_ESP_OK( mpu.resetFIFO());
+    uint16_t count = 0xFFFF;
+    TEST_ESP_OK( mpu.readFIFOWithCount(kPacketSize, buffer, &count));
+    TEST_ASSERT_EQUAL_INT( 0, count);
+    TEST_ESP_OK( mpu.setSleep(false));
+    // fill with a few packets, count must match the one read separately
+    vTaskDelay(50 / portTICK_PERIOD_MS);
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_NONE));
+    const uint16_t fifoCount = mpu.getFIFOCount();
+    TEST_ESP_OK( mpu.lastError());
+    TEST_ASSERT( fifoCount >= kPacketSize && (fifoCount % kPacketSize) == 0);
+    size_t packets = 0;
+    TEST_ESP_OK( mpu.readFIFOPackets(kPacketSize, kMaxPackets, buffer, &packets));
+    TEST_ASSERT_EQUAL_INT( fifoCount / kPacketSize < kMaxPackets ? fifoCount / kPacketSize : kMaxPackets, packets);
+    for (size_t i = 0; i < packets; i++) {
+        const int16_t accelZ = buffer[i * kPacketSize + 4] << 8 | buffer[i * kPacketSize + 5];
+        printf("packet %zu, accel z: %+d\n", i, accelZ);
+    }
+    TEST_ASSERT_EQUAL_INT( fifoCount - packets * kPacketSize, mpu.getFIFOCount());
+    TEST_ESP_OK( mpu.lastError());
+}
+
+
+
+TEST_CASE("MPU FIFO reader packet framing", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    TEST_ESP_OK( mpu.setSampleRate(100));
+    #ifdef CONFIG_MPU_AK89xx
+    // free slaves 0 and 1 in case of MPU9150 or MPU9250
+    TEST_ESP_OK( mpu.compassSetMode(mpud::MAG_MODE_POWER_DOWN));
+    #endif
+    mpud::auxi2c_slv_config_t slvconfig{};
+    slvconfig.slave = mpud::AUXI2C_SLAVE_1;
+    slvconfig.rw = mpud::AUXI2C_READ;
+    slvconfig.rxlength = 3;
+    TEST_ESP_OK( mpu.setAuxI2CSlaveConfig(slvconfig));
+    TEST_ESP_OK( mpu.setAuxI2CSlaveEnabled(slvconfig.slave, true));
+    TEST_ESP_OK( mpu.setAuxI2CEnabled(true));
+    mpud::FIFOReader fifo(mpu);
+    // layout follows the configuration
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_TEMPERATURE | mpud::FIFO_CFG_SLAVE1));
+    TEST_ESP_OK( fifo.begin());
+    TEST_ASSERT_EQUAL_INT( 11, fifo.getPacketSize());
+    TEST_ASSERT_EQUAL_INT( 6, fifo.getLayout().temp);
+    TEST_ASSERT_EQUAL_INT( 8, fifo.getLayout().slave[1]);
+    TEST_ASSERT_EQUAL_INT( -1, fifo.getLayout().gyro[0]);
+    // drain in bursts split across packets, the count must match the one read separately
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
+    TEST_ESP_OK( fifo.begin());
+    TEST_ASSERT_EQUAL_INT( 12, fifo.getPacketSize());
+    fifo.setMaxBurstLength(20);
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    TEST_ESP_OK( mpu.resetFIFO());
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_NONE));
+    const uint16_t fifoCount = mpu.getFIFOCount();
+    TEST_ESP_OK( mpu.lastError());
+    constexpr size_t kMaxSamples = 32;
+    mpud::fifo_sample_t samples[kMaxSamples];
+    size_t count = 0;
+    TEST_ESP_OK( fifo.read(samples, kMaxSamples, &count));
+    TEST_ASSERT_EQUAL_INT( fifoCount / 12, count);
+    TEST_ASSERT_EQUAL_INT( 0, fifo.getPending());
+    for (size_t i = 0; i < count; i++) {
+        printf("sample %zu, accel z: %+d, gyro z: %+d, time: %lld us\n", i, samples[i].accel.z, samples[i].gyro.z,
+            samples[i].timestamp);
+        TEST_ASSERT( samples[i].accel.x != 0 || samples[i].accel.y != 0 || samples[i].accel.z != 0);
+        // 100 Hz, internal clock within 10%
+        if (i > 0) TEST_ASSERT_INT_WITHIN( 1000, 10000, samples[i].timestamp - samples[i - 1].timestamp);
+    }
+    TEST_ASSERT( samples[count - 1].timestamp <= esp_timer_get_time());
+}
+
+
+
+TEST_CASE("MPU FIFO overflow recovery", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    TEST_ESP_OK( mpu.setSampleRate(1000));
+    #ifdef CONFIG_MPU6500
+    TEST_ESP_OK( mpu.setFIFOSize(mpud::FIFO_SIZE_512B));
+    TEST_ASSERT_EQUAL_INT( mpud::FIFO_SIZE_512B, mpu.getFIFOSize());
+    TEST_ESP_OK( mpu.lastError());
+    #endif
+    TEST_ESP_OK( mpu.setFIFOMode(mpud::FIFO_MODE_OVERWRITE));
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    mpud::FIFOReader fifo(mpu);
+    TEST_ESP_OK( fifo.begin());
+    TEST_ESP_OK( mpu.resetFIFO());
+    fifo.clear();
+    // overflow, the FIFO holds less than 100 packets
+    vTaskDelay(300 / portTICK_PERIOD_MS);
+    constexpr size_t kMaxSamples = 100;
+    mpud::fifo_sample_t samples[kMaxSamples];
+    size_t count = 0;
+    TEST_ESP_OK( fifo.read(samples, kMaxSamples, &count));
+    printf("after overflow: %zu samples, %u lost\n", count, fifo.getLostSamples());
+    TEST_ASSERT_EQUAL_INT( 1, fifo.getOverflowCount());
+    TEST_ASSERT( fifo.getLostSamples() > 100);
+    TEST_ASSERT( count > 0);
+    // realigned, no more losses
+    vTaskDelay(20 / portTICK_PERIOD_MS);
+    TEST_ESP_OK( fifo.read(samples, kMaxSamples, &count));
+    TEST_ASSERT_EQUAL_INT( 0, fifo.getLostSamples());
+    TEST_ASSERT_EQUAL_INT( 1, fifo.getOverflowCount());
+    TEST_ASSERT( count > 0);
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT( samples[i].accel.x != 0 || samples[i].accel.y != 0 || samples[i].accel.z != 0);
+    }
+}
+
+
+
+TEST_CASE("MPU FIFO batching", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    TEST_ESP_OK( mpu.setSampleRate(1000));
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    mpud::FIFOReader fifo(mpu);
+    TEST_ESP_OK( fifo.begin());
+    TEST_ASSERT_EQUAL_INT( ESP_ERR_INVALID_SIZE, fifo.setWatermark(fifo.getMaxWatermark() + 1));
+    constexpr size_t kWatermark = 32;
+    TEST_ESP_OK( fifo.setWatermark(kWatermark));
+    TEST_ESP_OK( mpu.resetFIFO());
+    fifo.clear();
+    constexpr size_t kMaxSamples = 64;
+    mpud::fifo_sample_t samples[kMaxSamples];
+    for (int i = 0; i < 20; i++) {
+        size_t count = 0;
+        TEST_ESP_OK( fifo.readBatch(samples, kMaxSamples, &count));
+        printf("batch %d: %zu samples, %lld us old\n", i, count, esp_timer_get_time() - samples[0].timestamp);
+        TEST_ASSERT( count >= kWatermark);
+        TEST_ASSERT_EQUAL_INT( 0, fifo.getLostSamples());
+    }
+}
+
+
+
+TEST_CASE("MPU FIFO batch decode", "[MPU]")
+{
+    test::MPU_t mpu;
+    mpud::FIFOReader fifo(mpu);
+    const uint8_t slaveLength[4] = {0, 0, 0, 0};
+    TEST_ESP_OK( fifo.begin(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_TEMPERATURE | mpud::FIFO_CFG_GYRO, slaveLength));
+    constexpr size_t kPackets = 64;
+    static uint8_t raw[kPackets * 14];
+    static mpud::fifo_sample_t samples[kPackets];
+    for (size_t i = 0; i < sizeof(raw); i++) raw[i] = (uint8_t)(i * 131 + 7);
+    const int64_t start = esp_timer_get_time();
+    for (int rep = 0; rep < 100; rep++) fifo.decode(raw, kPackets, samples);
+    const int64_t elapsed = esp_timer_get_time() - start;
+    printf("batch decode: %.1f ns/sample\n", elapsed * 1000.0 / (100 * kPackets));
+    for (size_t i = 0; i < kPackets; i++) {
+        const uint8_t* packet = raw + i * 14;
+        for (int j = 0; j < 3; j++) {
+            TEST_ASSERT_EQUAL_INT16( mpud::be16(packet + 2 * j), samples[i].accel[j]);
+            TEST_ASSERT_EQUAL_INT16( mpud::be16(packet + 8 + 2 * j), samples[i].gyro[j]);
+        }
+        TEST_ASSERT_EQUAL_INT16( mpud::be16(packet + 6), samples[i].temp);
+    }
+}
+
+
+TEST_CASE("MPU FIFO sample batch", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    TEST_ESP_OK( mpu.setSampleRate(1000));
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    mpud::FIFOReader fifo(mpu);
+    TEST_ESP_OK( fifo.begin());
+    TEST_ESP_OK( mpu.resetFIFO());
+    fifo.clear();
+    static mpud::SampleBatch<128> batch;
+    batch.clear();
+    // fill the batch in a few reads, samples are appended
+    while (batch.room() > 0) {
+        vTaskDelay(20 / portTICK_PERIOD_MS);
+        size_t count = 0;
+        TEST_ESP_OK( fifo.read(batch, &count));
+        TEST_ASSERT_EQUAL_INT( 0, fifo.getLostSamples());
+    }
+    TEST_ASSERT_EQUAL_INT( 128, batch.count);
+    int32_t accelZ = 0;
+    for (size_t i = 0; i < batch.count; i++) {
+        if (i > 0) TEST_ASSERT_INT_WITHIN(100, 1000, batch.timestamp[i] - batch.timestamp[i - 1]);
+        accelZ += batch.accel[2][i];
+    }
+    printf("mean accel Z: %d\n", accelZ / (int32_t) batch.count);
+}
+
+
+TEST_CASE("MPU batch unit conversion", "[MPU]")
+{
+    constexpr size_t kCount = 61;  // not a multiple of the block size
+    int16_t raw[kCount];
+    float out[kCount];
+    for (size_t i = 0; i < kCount; i++) raw[i] = (int16_t)(i * 1031 - 30000);
+    const mpud::scale_t scale = mpud::math::makeScale(mpud::ACCEL_FS_8G, mpud::GYRO_FS_2000DPS);
+    mpud::math::accelGravity(raw, kCount, scale, out);
+    for (size_t i = 0; i < kCount; i++) TEST_ASSERT_EQUAL_FLOAT( mpud::math::accelGravity(raw[i], mpud::ACCEL_FS_8G), out[i]);
+    mpud::math::gyroDegPerSec(raw, kCount, scale, out);
+    for (size_t i = 0; i < kCount; i++) TEST_ASSERT_EQUAL_FLOAT( mpud::math::gyroDegPerSec(raw[i], mpud::GYRO_FS_2000DPS), out[i]);
+    mpud::math::gyroRadPerSec(raw, kCount, scale, out);
+    for (size_t i = 0; i < kCount; i++) TEST_ASSERT_EQUAL_FLOAT( mpud::math::gyroRadPerSec(raw[i], mpud::GYRO_FS_2000DPS), out[i]);
+    mpud::math::tempCelsius(raw, kCount, out);
+    for (size_t i = 0; i < kCount; i++) TEST_ASSERT_FLOAT_WITHIN( 0.001f, mpud::math::tempCelsius(raw[i]), out[i]);
+}
+
+TEST_CASE("MPU fixed-point unit conversion", "[MPU]")
+{
+    // Q16.16 results within 1 LSB of the exact value, so within 1 LSB + float rounding of the float path
+    namespace fixed = mpud::math::fixed;
+    constexpr float kLsb = 1.f / fixed::kQ16One;
+    constexpr size_t kCount = 61;
+    int16_t raw[kCount];
+    fixed::q16_t out[kCount];
+    for (size_t i = 0; i < kCount; i++) raw[i] = (int16_t)(i * 1031 - 30000);
+    raw[0] = INT16_MIN;
+    raw[1] = INT16_MAX;
+    for (int fs = 0; fs < 4; fs++) {
+        const mpud::accel_fs_t accelFS = (mpud::accel_fs_t) fs;
+        const mpud::gyro_fs_t gyroFS   = (mpud::gyro_fs_t) fs;
+        const fixed::scale_t scale     = fixed::makeScale(accelFS, gyroFS);
+        fixed::accelGravity(raw, kCount, scale, out);
+        for (size_t i = 0; i < kCount; i++) {
+            TEST_ASSERT_EQUAL_INT32( fixed::accelGravity(raw[i], accelFS), out[i]);
+            TEST_ASSERT_FLOAT_WITHIN( 2 * kLsb, mpud::math::accelGravity(raw[i], accelFS), fixed::toFloat(out[i]));
+        }
+        fixed::gyroDegPerSec(raw, kCount, scale, out);
+        for (size_t i = 0; i < kCount; i++) {
+            TEST_ASSERT_FLOAT_WITHIN( 16 * kLsb, mpud::math::gyroDegPerSec(raw[i], gyroFS), fixed::toFloat(out[i]));
+        }
+        fixed::gyroRadPerSec(raw, kCount, scale, out);
+        for (size_t i = 0; i < kCount; i++) {
+            TEST_ASSERT_FLOAT_WITHIN( 2 * kLsb, mpud::math::gyroRadPerSec(raw[i], gyroFS), fixed::toFloat(out[i]));
+        }
+    }
+    fixed::tempCelsius(raw, kCount, out);
+    for (size_t i = 0; i < kCount; i++) {
+        TEST_ASSERT_FLOAT_WITHIN( 2 * kLsb, mpud::math::tempCelsius(raw[i]), fixed::toFloat(out[i]));
+        TEST_ASSERT_FLOAT_WITHIN( 4 * kLsb, mpud::math::tempFahrenheit(raw[i]), fixed::toFloat(fixed::tempFahrenheit(raw[i])));
+    }
+#if defined CONFIG_MPU_AK89xx
+    for (int adj = 0; adj < 256; adj += 5) {
+        for (int axis = -4912; axis <= 4912; axis += 307) {
+            TEST_ASSERT_INT_WITHIN( 1, mpud::math::magAdjust(axis, adj), fixed::magAdjust(axis, adj));
+        }
+    }
+#endif
+}
+
+TEST_CASE("MPU vector and quaternion math", "[MPU]")
+{
+    using namespace mpud::math;
+    for (float x = 1e-4f; x < 1e4f; x *= 1.37f) {
+        TEST_ASSERT_FLOAT_WITHIN( 5e-6f, 1.f, fastInvSqrt(x) * sqrtf(x));
+    }
+    for (int i = -180; i <= 180; i += 7) {
+        const float angle = i * kDegToRad;
+        TEST_ASSERT_FLOAT_WITHIN( 1e-5f, atan2f(sinf(angle), cosf(angle)), fastAtan2(sinf(angle), cosf(angle)));
+    }
+    const mpud::float_axes_t x(1, 0, 0), y(0, 1, 0), z(0, 0, 1);
+    TEST_ASSERT_EQUAL_FLOAT( 1.f, dot(cross(x, y), z));
+    // 90º yaw turns x into y, and gravity stays on z
+    const mpud::quat_t q = fromEuler(mpud::float_axes_t(0, 0, 90 * kDegToRad));
+    mpud::float_axes_t v = rotate(q, x);
+    TEST_ASSERT_FLOAT_WITHIN( 1e-6f, 0.f, norm(v - y));
+    v = toMatrix(q) * x;
+    TEST_ASSERT_FLOAT_WITHIN( 1e-6f, 0.f, norm(v - y));
+    TEST_ASSERT_FLOAT_WITHIN( 1e-6f, 0.f, norm(gravity(q) - z));
+    // conversions round trip
+    const mpud::float_axes_t euler(0.3f, -0.7f, 2.5f);
+    const mpud::quat_t p = fromEuler(euler);
+    TEST_ASSERT_FLOAT_WITHIN( 1e-4f, 0.f, norm(toEuler(p) - euler));
+    TEST_ASSERT_FLOAT_WITHIN( 1e-6f, 1.f, fabsf(dot(fromMatrix(toMatrix(p)), p)));
+    TEST_ASSERT_FLOAT_WITHIN( 1e-6f, 1.f, fabsf(dot(p * conjugate(p), kQuatIdentity)));
+}
+
+TEST_CASE("MPU AHRS orientation filter", "[MPU]")
+{
+    // static sensor, roll 30º and pitch -20º
+    constexpr float kRoll = 30, kPitch = -20, kDegToRad = M_PI / 180;
+    mpud::float_axes_t accel, gyro;
+    accel.x = -sinf(kPitch * kDegToRad);
+    accel.y = cosf(kPitch * kDegToRad) * sinf(kRoll * kDegToRad);
+    accel.z = cosf(kPitch * kDegToRad) * cosf(kRoll * kDegToRad);
+    for (int f = 0; f < 2; f++) {
+        mpud::AHRS ahrs(f ? mpud::AHRS_MAHONY : mpud::AHRS_MADGWICK);
+        // the first sample aligns to gravity
+        ahrs.update(gyro, accel, 0.f);
+        mpud::float_axes_t euler = ahrs.getEuler();
+        TEST_ASSERT_FLOAT_WITHIN( 0.1f, kRoll, euler.x);
+        TEST_ASSERT_FLOAT_WITHIN( 0.1f, kPitch, euler.y);
+        TEST_ASSERT_FLOAT_WITHIN( 0.1f, 0.f, euler.z);
+        // from level, converges towards gravity
+        ahrs.reset(mpud::quat_t{1, 0, 0, 0});
+        ahrs.setBeta(0.5f).setGains(5.f, 0.f);
+        const int64_t start = esp_timer_get_time();
+        for (int i = 0; i < 4000; i++) ahrs.update(gyro, accel, 1e-3f);
+        const int64_t elapsed = esp_timer_get_time() - start;
+        printf("%s: %.2f us/sample\n", f ? "Mahony" : "Madgwick", elapsed / 4000.f);
+        euler = ahrs.getEuler();
+        TEST_ASSERT_FLOAT_WITHIN( 1.f, kRoll, euler.x);
+        TEST_ASSERT_FLOAT_WITHIN( 1.f, kPitch, euler.y);
+        TEST_ASSERT_LESS_THAN( 100, elapsed / 4000);  // under 10% of one core at 1 kHz
+    }
+}
+
+TEST_CASE("MPU attitude EKF", "[MPU]")
+{
+    // level sensor with a gyro bias, learned within 2 s at 500 Hz
+    mpud::AttitudeEKF ekf;
+    const mpud::float_axes_t bias(0.01f, -0.02f, 0.f), level(0, 0, 1.f);
+    const int64_t start = esp_timer_get_time();
+    for (int i = 0; i < 1000; i++) ekf.update(bias, level, 2e-3f);
+    const int64_t elapsed = esp_timer_get_time() - start;
+    printf("AttitudeEKF: %.2f us/sample\n", elapsed / 1000.f);
+    mpud::float_axes_t estimate = ekf.getGyroBias();
+    TEST_ASSERT_FLOAT_WITHIN( 0.001f, bias.x, estimate.x);
+    TEST_ASSERT_FLOAT_WITHIN( 0.001f, bias.y, estimate.y);
+    TEST_ASSERT_LESS_THAN( 0.005f, ekf.getGyroBiasStd().x);
+    mpud::float_axes_t euler = ekf.getEuler();
+    TEST_ASSERT_FLOAT_WITHIN( 0.1f, 0.f, euler.x);
+    TEST_ASSERT_FLOAT_WITHIN( 0.1f, 0.f, euler.y);
+    TEST_ASSERT_LESS_THAN( 200, elapsed / 1000);  // under 10% of one core at 500 Hz
+    // static sensor, roll 30º and pitch -20º: the first sample aligns, from level it converges
+    constexpr float kRoll = 30, kPitch = -20, kDegToRad = M_PI / 180;
+    const mpud::float_axes_t accel(-sinf(kPitch * kDegToRad), cosf(kPitch * kDegToRad) * sinf(kRoll * kDegToRad),
+                                   cosf(kPitch * kDegToRad) * cosf(kRoll * kDegToRad));
+    const mpud::float_axes_t still(0, 0, 0);
+    ekf.reset();
+    ekf.update(still, accel, 0.f);
+    euler = ekf.getEuler();
+    TEST_ASSERT_FLOAT_WITHIN( 0.1f, kRoll, euler.x);
+    TEST_ASSERT_FLOAT_WITHIN( 0.1f, kPitch, euler.y);
+    ekf.reset(mpud::quat_t{1, 0, 0, 0}, still);
+    for (int i = 0; i < 2000; i++) ekf.update(still, accel, 2e-3f);
+    euler = ekf.getEuler();
+    TEST_ASSERT_FLOAT_WITHIN( 1.f, kRoll, euler.x);
+    TEST_ASSERT_FLOAT_WITHIN( 1.f, kPitch, euler.y);
+}
+
+
+static mpud::SampleRing<64> sampleRing;
+static volatile bool producerDone;
+static volatile esp_err_t producerError;
+static volatile uint32_t producerLost;
+
+/* Read the FIFO into sampleRing every 5 ms, for 1 second */
+static void ringProducerTask(void* arg)
+{
+    mpud::FIFOReader* fifo = (mpud::FIFOReader*) arg;
+    for (int i = 0; i < 200; i++) {
+        size_t count = 0;
+        if (esp_err_t err = fifo->read(sampleRing, &count)) producerError = err;
+        producerLost += fifo->getLostSamples();
+        vTaskDelay(5 / portTICK_PERIOD_MS);
+    }
+    producerDone = true;
+    vTaskDelete(nullptr);
+}
+
+TEST_CASE("MPU sample ring", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    TEST_ESP_OK( mpu.setSampleRate(1000));
+    TEST_ESP_OK( mpu.setFIFOConfig(mpud::FIFO_CFG_ACCEL | mpud::FIFO_CFG_GYRO));
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    mpud::FIFOReader fifo(mpu);
+    TEST_ESP_OK( fifo.begin());
+    TEST_ESP_OK( mpu.resetFIFO());
+    fifo.clear();
+    producerDone  = false;
+    producerError = ESP_OK;
+    producerLost  = 0;
+    xTaskCreatePinnedToCore(ringProducerTask, "ringProducer", 4 * 1024, &fifo, 6, nullptr, 1);
+    // consume in batches of 7 from this task, samples must come in order and at the sample rate
+    size_t consumed = 0;
+    int64_t prevTimestamp = 0;
+    while (!producerDone || sampleRing.size() > 0) {
+        mpud::fifo_sample_t batch[7];
+        size_t count = sampleRing.pop(batch, 7);
+        for (size_t i = 0; i < count; i++) {
+            if (prevTimestamp != 0) TEST_ASSERT_INT_WITHIN(100, 1000, batch[i].timestamp - prevTimestamp);
+            prevTimestamp = batch[i].timestamp;
+        }
+        consumed += count;
+        if (count == 0) vTaskDelay(1);
+    }
+    printf("consumed %zu samples, %u dropped\n", consumed, sampleRing.getDropped());
+    TEST_ESP_OK( producerError);
+    TEST_ASSERT_EQUAL_INT( 0, producerLost);
+    TEST_ASSERT( consumed > 900);
+    TEST_ASSERT_EQUAL_INT( 0, sampleRing.getDropped());
+}
+
+
+
 TEST_CASE("MPU offset test", "[MPU]")
 {
     test::MPU_t mpu;
@@ -684,10 +1129,188 @@ TEST_CASE("MPU self-test check", "[MPU]")
     TEST_ESP_OK( mpu.initialize());
     /* test */
     mpud::selftest_t selfTestResult;
+    const int64_t start = esp_timer_get_time();
     TEST_ESP_OK( mpu.selfTest(&selfTestResult));
-    printf("[%s] SELF-TEST result: 0x%X\n",
+    const int64_t elapsed = esp_timer_get_time() - start;
+    printf("[%s] SELF-TEST result: 0x%X, %lld ms\n",
         (selfTestResult == mpud::SELF_TEST_PASS) ? (LOG_COLOR_I " OK " LOG_RESET_COLOR) : (LOG_COLOR_E "FAIL" LOG_RESET_COLOR),
-        selfTestResult);
+        selfTestResult, elapsed / 1000);
+    TEST_ASSERT_LESS_THAN( 300000, elapsed);
+}
+
+
+
+TEST_CASE("MPU non-blocking calibration", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    const uint16_t sampleRate = mpu.getSampleRate();
+    mpud::Calibrator calibrator(mpu);
+    for (int job = 0; job < 2; job++) {
+        TEST_ESP_OK( job ? calibrator.startSelfTest() : calibrator.startOffsets());
+        TEST_ASSERT_EQUAL_INT( ESP_ERR_INVALID_STATE, calibrator.startOffsets());
+        // the task keeps running between polls
+        int polls = 0, loops = 0;
+        int64_t longestPoll = 0;
+        while (calibrator.busy()) {
+            int64_t waitUs;
+            const int64_t start = esp_timer_get_time();
+            TEST_ESP_OK( calibrator.poll(&waitUs));
+            const int64_t spent = esp_timer_get_time() - start;
+            if (spent > longestPoll) longestPoll = spent;
+            polls++;
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            loops++;
+        }
+        printf("%s: %d polls, longest %lld us\n", job ? "self-test" : "offsets", polls, longestPoll);
+        TEST_ASSERT_EQUAL_INT( mpud::CALIB_DONE, calibrator.getState());
+        TEST_ASSERT_GREATER_THAN( 20, loops);
+        TEST_ASSERT_LESS_THAN( 20000, longestPoll);
+        if (job) {
+            mpud::selftest_t result;
+            TEST_ESP_OK( calibrator.getSelfTest(&result));
+            printf("self-test result: 0x%X\n", result);
+        }
+        else {
+            mpud::raw_axes_t accelOffset, gyroOffset;
+            TEST_ESP_OK( calibrator.getOffsets(&accelOffset, &gyroOffset));
+            printf("accel: [ %+d %+d %+d ] \t gyro: [ %+d %+d %+d ]\n",
+                accelOffset.x, accelOffset.y, accelOffset.z, gyroOffset.x, gyroOffset.y, gyroOffset.z);
+        }
+        // configuration restored
+        TEST_ASSERT_EQUAL_UINT16( sampleRate, mpu.getSampleRate());
+        TEST_ASSERT_FALSE( mpu.getFIFOEnabled());
+    }
+}
+
+
+
+TEST_CASE("MPU calibration record", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    mpud::Calibrator calibrator(mpu);
+    TEST_ESP_OK( calibrator.startOffsets());
+    TEST_ESP_OK( calibrator.run());
+    mpud::calib_record_t record;
+    TEST_ESP_OK( calibrator.getRecord(&record));
+    uint8_t blob[mpud::Calibrator::kRecordSize];
+    mpud::Calibrator::pack(record, blob);
+    // corrupt blobs are rejected
+    blob[5] ^= 0x1;
+    TEST_ASSERT_EQUAL_INT( ESP_ERR_INVALID_CRC, mpud::Calibrator::unpack(blob, sizeof(blob), &record));
+    blob[5] ^= 0x1;
+    TEST_ASSERT_EQUAL_INT( ESP_ERR_INVALID_SIZE, mpud::Calibrator::unpack(blob, 4, &record));
+    // warm boot: reset, check and apply
+    mpud::calib_record_t restored;
+    TEST_ESP_OK( mpud::Calibrator::unpack(blob, sizeof(blob), &restored));
+    TEST_ESP_OK( mpu.initialize());
+    const int64_t start = esp_timer_get_time();
+    TEST_ESP_OK( mpu.checkCalibration(restored));
+    TEST_ESP_OK( mpu.applyCalibration(restored));
+    const int64_t elapsed = esp_timer_get_time() - start;
+    printf("check + apply: %lld us\n", elapsed);
+    TEST_ASSERT_LESS_THAN( 5000, elapsed);
+    const mpud::raw_axes_t gyroOffset = mpu.getGyroOffset();
+    TEST_ESP_OK( mpu.lastError());
+    TEST_ASSERT_EQUAL_INT16( record.gyroOffset.x, gyroOffset.x);
+    TEST_ASSERT_EQUAL_INT16( record.gyroOffset.y, gyroOffset.y);
+    TEST_ASSERT_EQUAL_INT16( record.gyroOffset.z, gyroOffset.z);
+    // another chip
+    restored.accelTrim.x += 2;
+    TEST_ASSERT_EQUAL_INT( ESP_ERR_NOT_FOUND, mpu.checkCalibration(restored));
+}
+
+
+
+TEST_CASE("MPU gyro bias tracking", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    TEST_ESP_OK( mpu.initialize());
+    // reference from the blocking calibration, in 1000DPS
+    mpud::raw_axes_t accelOffset, gyroOffset;
+    TEST_ESP_OK( mpu.computeOffsets(&accelOffset, &gyroOffset));
+    // learn while the board rests on the table, sampled at 100 Hz
+    mpud::GyroBiasTracker tracker(mpu.getAccelFullScale(), mpu.getGyroFullScale());
+    mpud::fifo_sample_t samples[100];
+    for (int window = 0; window < 4; window++) {
+        for (auto& sample : samples) {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            TEST_ESP_OK( mpu.motion(&sample.accel, &sample.gyro));
+            sample.timestamp = esp_timer_get_time();
+        }
+        tracker.update(samples, 100);
+    }
+    const mpud::float_axes_t bias = tracker.getBias();
+    printf("still windows: %u, bias: [ %+.3f %+.3f %+.3f ] dps\n", tracker.getStillWindows(), bias.x, bias.y, bias.z);
+    TEST_ASSERT_GREATER_THAN( 0, tracker.getStillWindows());
+    const float sensitivity = mpud::math::gyroSensitivity(mpud::GYRO_FS_1000DPS);
+    TEST_ASSERT_FLOAT_WITHIN( 0.3f, -gyroOffset.x / sensitivity, bias.x);
+    TEST_ASSERT_FLOAT_WITHIN( 0.3f, -gyroOffset.y / sensitivity, bias.y);
+    TEST_ASSERT_FLOAT_WITHIN( 0.3f, -gyroOffset.z / sensitivity, bias.z);
+    // registers take the bias, the estimate keeps the remainder
+    TEST_ESP_OK( tracker.pushToHardware(mpu));
+    const mpud::raw_axes_t pushed = mpu.getGyroOffset();
+    TEST_ESP_OK( mpu.lastError());
+    TEST_ASSERT_INT_WITHIN( 8, gyroOffset.x, pushed.x);
+    TEST_ASSERT_INT_WITHIN( 8, gyroOffset.y, pushed.y);
+    TEST_ASSERT_INT_WITHIN( 8, gyroOffset.z, pushed.z);
+    TEST_ASSERT_FLOAT_WITHIN( 0.05f, 0.f, tracker.getBias().x);
+}
+
+
+
+TEST_CASE("MPU temperature compensation", "[MPU]")
+{
+    // quadratic gyro bias and linear accel bias over 0..50 ºC, fitted from points
+    auto gyroCurve = [](float temp, int axis) {
+        const float dT = temp - 25;
+        return 0.5f * axis + 0.02f * dT + 0.0005f * dT * dT;
+    };
+    auto accelCurve = [](float temp, int axis) {
+        return 0.01f * axis + 0.0003f * (temp - 25);
+    };
+    mpud::TempCompensation comp;
+    TEST_ASSERT_EQUAL_INT( ESP_ERR_INVALID_STATE, comp.fit());
+    for (float temp = 0; temp <= 50; temp += 5) {
+        comp.addGyroPoint(temp, mpud::float_axes_t(gyroCurve(temp, 0), gyroCurve(temp, 1), gyroCurve(temp, 2)));
+        comp.addAccelPoint(temp, mpud::float_axes_t(accelCurve(temp, 0), accelCurve(temp, 1), accelCurve(temp, 2)));
+    }
+    TEST_ESP_OK( comp.fit());
+    TEST_ASSERT_EQUAL_INT( 2, comp.getGyroDegree());
+    TEST_ASSERT_EQUAL_INT( 2, comp.getAccelDegree());
+    for (int axis = 0; axis < 3; axis++) {
+        TEST_ASSERT_FLOAT_WITHIN( 1e-3f, gyroCurve(37.5f, axis), comp.gyroBias(37.5f)[axis]);
+        TEST_ASSERT_FLOAT_WITHIN( 1e-4f, accelCurve(-5.f, axis), comp.accelBias(-5.f)[axis]);
+    }
+    // batch at 40 ºC, the biases are removed
+    static mpud::SampleBatch<64> batch;
+    const int16_t rawTemp = mpud::math::kRoomTempOffset + (40 - mpud::math::kCelsiusOffset) / mpud::math::kTempResolution;
+    const float gyroLSB = mpud::math::gyroSensitivity(mpud::GYRO_FS_500DPS);
+    const float accelLSB = mpud::math::accelSensitivity(mpud::ACCEL_FS_4G);
+    const float temp = mpud::math::tempCelsius(rawTemp);
+    for (size_t i = 0; i < batch.capacity(); i++, batch.count++) {
+        for (int axis = 0; axis < 3; axis++) {
+            batch.gyro[axis][i] = lroundf(gyroCurve(temp, axis) * gyroLSB);
+            batch.accel[axis][i] = lroundf(accelCurve(temp, axis) * accelLSB);
+        }
+        batch.temp[i] = rawTemp;
+    }
+    comp.compensate(batch, mpud::ACCEL_FS_4G, mpud::GYRO_FS_500DPS);
+    for (int axis = 0; axis < 3; axis++) {
+        TEST_ASSERT_INT_WITHIN( 1, 0, batch.gyro[axis][0]);
+        TEST_ASSERT_INT_WITHIN( 1, 0, batch.accel[axis][batch.count - 1]);
+    }
+    // a single temperature gives a constant
+    comp.reset();
+    comp.addGyroPoint(30, mpud::float_axes_t(1, 2, 3));
+    TEST_ESP_OK( comp.fit());
+    TEST_ASSERT_EQUAL_INT( 0, comp.getGyroDegree());
+    TEST_ASSERT_EQUAL_INT( -1, comp.getAccelDegree());
+    TEST_ASSERT_FLOAT_WITHIN( 1e-5f, 2.f, comp.gyroBias(0).y);
 }
 
 
@@ -857,6 +1480,42 @@ TEST_CASE("MPU zero-motion detection", "[MPU]")
 
 
 
+TEST_CASE("MPU register cache", "[MPU]")
+{
+    test::MPU_t mpu;
+    TEST_ESP_OK( mpu.testConnection());
+    mpu.setRegisterCacheEnabled(true);
+    TEST_ASSERT_TRUE( mpu.getRegisterCacheEnabled());
+    TEST_ESP_OK( mpu.initialize());
+    // cached getters must match the chip
+    TEST_ESP_OK( mpu.setAccelFullScale(mpud::ACCEL_FS_8G));
+    TEST_ESP_OK( mpu.setDigitalLowPassFilter(mpud::DLPF_98HZ));
+    TEST_ESP_OK( mpu.setSampleRate(250));
+    uint8_t config[4];
+    mpu.setRegisterCacheEnabled(false);
+    TEST_ESP_OK( mpu.readBytes(mpud::regs::SMPLRT_DIV, 4, config));
+    mpu.setRegisterCacheEnabled(true);
+    TEST_ASSERT_EQUAL_INT( 1000 / (1 + config[0]), mpu.getSampleRate());
+    TEST_ASSERT_EQUAL_INT( config[1] & 0x7, mpu.getDigitalLowPassFilter());
+    TEST_ASSERT_EQUAL_INT( (config[3] >> 3) & 0x3, mpu.getAccelFullScale());
+    TEST_ESP_OK( mpu.lastError());
+    // self-clearing bits are not kept
+    TEST_ESP_OK( mpu.setFIFOEnabled(true));
+    TEST_ESP_OK( mpu.resetFIFO());
+    TEST_ASSERT_TRUE( mpu.getFIFOEnabled());
+    uint8_t userCtrl;
+    TEST_ESP_OK( mpu.readByte(mpud::regs::USER_CTRL, &userCtrl));
+    TEST_ASSERT_EQUAL_INT( 0, userCtrl & (1 << mpud::regs::USERCTRL_FIFO_RESET_BIT));
+    // reset invalidates
+    TEST_ESP_OK( mpu.reset());
+    TEST_ESP_OK( mpu.setSleep(false));
+    TEST_ASSERT_EQUAL_INT( mpud::ACCEL_FS_2G, mpu.getAccelFullScale());
+    TEST_ASSERT_FALSE( mpu.getFIFOEnabled());
+    TEST_ESP_OK( mpu.lastError());
+}
+
+
+
 #if defined CONFIG_MPU_AK89xx
 TEST_CASE("MPU compass configuration", "[MPU]")
 {